@@ -83,6 +83,7 @@ const char program_name[] = "avconv";
 const int program_birth_year = 2000;
 
 static FILE *vstats_file;
+static AVIOContext *progress_avio;
 
 static int64_t video_size = 0;
 static int64_t audio_size = 0;
@@ -95,6 +96,9 @@ static int nb_frames_drop = 0;
 #if HAVE_PTHREADS
 /* signal to input threads that they should exit; set by the main thread */
 static int transcoding_finished;
+/* serializes muxing and the global statistics between the encoder threads
+ * and the main thread */
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
 #endif
 
 #define DEFAULT_PASS_LOGFILENAME_PREFIX "av2pass"
@@ -144,10 +148,25 @@ static int decode_interrupt_cb(void *ctx)
 
 const AVIOInterruptCB int_cb = { decode_interrupt_cb, NULL };
 
+#if HAVE_PTHREADS
+static void free_input_threads(void);
+static void free_decoder_threads(void);
+static int  free_encoder_threads(void);
+#endif
+
 static void avconv_cleanup(int ret)
 {
     int i, j;
 
+#if HAVE_PTHREADS
+    /* the threads use the streams and filtergraphs freed below */
+    free_input_threads();
+    free_decoder_threads();
+    free_encoder_threads();
+    for (i = 0; i < nb_output_streams; i++)
+        free_output_chunks(output_streams[i]);
+#endif
+
     for (i = 0; i < nb_filtergraphs; i++) {
         avfilter_graph_free(&filtergraphs[i]->graph);
         for (j = 0; j < filtergraphs[i]->nb_inputs; j++) {
@@ -191,8 +210,22 @@ static void avconv_cleanup(int ret)
         av_freep(&output_streams[i]->logfile_prefix);
         av_freep(&output_streams[i]);
     }
+    for (i = 0; i < nb_input_streams; i++) {
+        AVCodecContext *dec_ctx = input_streams[i]->dec_ctx;
+
+        /* the copy of st->codec used by a decoding thread */
+        if (dec_ctx && dec_ctx != input_streams[i]->st->codec) {
+            avcodec_close(dec_ctx);
+            av_freep(&dec_ctx->extradata);
+            av_freep(&dec_ctx->intra_matrix);
+            av_freep(&dec_ctx->inter_matrix);
+            av_freep(&dec_ctx->rc_override);
+            av_freep(&input_streams[i]->dec_ctx);
+        }
+    }
     for (i = 0; i < nb_input_files; i++) {
         avformat_close_input(&input_files[i]->ctx);
+        av_dict_free(&input_files[i]->format_opts);
         av_freep(&input_files[i]);
     }
     for (i = 0; i < nb_input_streams; i++) {
@@ -207,6 +240,9 @@ static void avconv_cleanup(int ret)
     if (vstats_file)
         fclose(vstats_file);
     av_free(vstats_filename);
+    if (progress_avio)
+        avio_close(progress_avio);
+    av_freep(&progress_url);
 
     av_freep(&input_streams);
     av_freep(&input_files);
@@ -306,7 +342,59 @@ static void update_sample_fmt(AVCodecContext *dec, AVCodec *dec_codec,
     }
 }
 
-static void write_frame(AVFormatContext *s, AVPacket *pkt, OutputStream *ost)
+static int64_t getutime(void)
+{
+#if HAVE_GETRUSAGE
+    struct rusage rusage;
+
+    getrusage(RUSAGE_SELF, &rusage);
+    return (rusage.ru_utime.tv_sec * 1000000LL) + rusage.ru_utime.tv_usec;
+#elif HAVE_GETPROCESSTIMES
+    HANDLE proc;
+    FILETIME c, e, k, u;
+    proc = GetCurrentProcess();
+    GetProcessTimes(proc, &c, &e, &k, &u);
+    return ((int64_t) u.dwHighDateTime << 32 | u.dwLowDateTime) / 10;
+#else
+    return av_gettime();
+#endif
+}
+
+/* CPU time of the calling thread, so that the stages running in the input,
+ * decoder and encoder threads are accounted separately */
+static int64_t getcputime(void)
+{
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec ts;
+
+    if (!clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+        return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+#endif
+    return getutime();
+}
+
+static void start_timer(StageTimer *t)
+{
+    if (!do_benchmark_all)
+        return;
+    t->wall_start = av_gettime();
+    t->cpu_start  = getcputime();
+}
+
+static void stop_timer(StageTimer *t)
+{
+    if (!do_benchmark_all)
+        return;
+    t->wall += av_gettime() - t->wall_start;
+    t->cpu  += getcputime()  - t->cpu_start;
+    t->calls++;
+}
+
+/*
+ * Write a packet to the muxer, return a negative error code if transcoding
+ * should stop.
+ */
+static int write_frame(AVFormatContext *s, AVPacket *pkt, OutputStream *ost)
 {
     AVBitStreamFilterContext *bsfc = ost->bitstream_filters;
     AVCodecContext          *avctx = ost->st->codec;
@@ -322,7 +410,7 @@ static void write_frame(AVFormatContext *s, AVPacket *pkt, OutputStream *ost)
     if (!(avctx->codec_type == AVMEDIA_TYPE_VIDEO && avctx->codec)) {
         if (ost->frame_number >= ost->max_frames) {
             av_free_packet(pkt);
-            return;
+            return 0;
         }
         ost->frame_number++;
     }
@@ -337,15 +425,19 @@ static void write_frame(AVFormatContext *s, AVPacket *pkt, OutputStream *ost)
             av_free_packet(pkt);
             new_pkt.buf = av_buffer_create(new_pkt.data, new_pkt.size,
                                            av_buffer_default_free, NULL, 0);
-            if (!new_pkt.buf)
-                exit_program(1);
+            if (!new_pkt.buf) {
+                av_free(new_pkt.data);
+                return AVERROR(ENOMEM);
+            }
         } else if (a < 0) {
             av_log(NULL, AV_LOG_ERROR, "%s failed for stream %d, codec %s",
                    bsfc->filter->name, pkt->stream_index,
                    avctx->codec ? avctx->codec->name : "copy");
             print_error("", a);
-            if (exit_on_error)
-                exit_program(1);
+            if (exit_on_error) {
+                av_free_packet(pkt);
+                return a;
+            }
         }
         *pkt = new_pkt;
 
@@ -360,7 +452,8 @@ static void write_frame(AVFormatContext *s, AVPacket *pkt, OutputStream *ost)
                ost->file_index, ost->st->index, ost->last_mux_dts, pkt->dts);
         if (exit_on_error) {
             av_log(NULL, AV_LOG_FATAL, "aborting.\n");
-            exit_program(1);
+            av_free_packet(pkt);
+            return AVERROR(EINVAL);
         }
         av_log(NULL, AV_LOG_WARNING, "changing to %"PRId64". This may result "
                "in incorrect timestamps in the output file.\n",
@@ -372,11 +465,28 @@ static void write_frame(AVFormatContext *s, AVPacket *pkt, OutputStream *ost)
     ost->last_mux_dts = pkt->dts;
 
     pkt->stream_index = ost->index;
+    start_timer(&ost->mux_timer);
     ret = av_interleaved_write_frame(s, pkt);
+    stop_timer(&ost->mux_timer);
     if (ret < 0) {
         print_error("av_interleaved_write_frame()", ret);
-        exit_program(1);
+        return ret;
     }
+    return 0;
+}
+
+static void lock_output(void)
+{
+#if HAVE_PTHREADS
+    pthread_mutex_lock(&output_lock);
+#endif
+}
+
+static void unlock_output(void)
+{
+#if HAVE_PTHREADS
+    pthread_mutex_unlock(&output_lock);
+#endif
 }
 
 static int check_recording_time(OutputStream *ost)
@@ -392,12 +502,12 @@ static int check_recording_time(OutputStream *ost)
     return 1;
 }
 
-static void do_audio_out(AVFormatContext *s, OutputStream *ost,
-                         AVFrame *frame)
+static int do_audio_out(AVFormatContext *s, OutputStream *ost,
+                        AVFrame *frame)
 {
     AVCodecContext *enc = ost->st->codec;
     AVPacket pkt;
-    int got_packet = 0;
+    int got_packet = 0, ret;
 
     av_init_packet(&pkt);
     pkt.data = NULL;
@@ -407,9 +517,12 @@ static void do_audio_out(AVFormatContext *s, OutputStream *ost,
         frame->pts = ost->sync_opts;
     ost->sync_opts = frame->pts + frame->nb_samples;
 
-    if (avcodec_encode_audio2(enc, &pkt, frame, &got_packet) < 0) {
+    start_timer(&ost->encode_timer);
+    ret = avcodec_encode_audio2(enc, &pkt, frame, &got_packet);
+    stop_timer(&ost->encode_timer);
+    if (ret < 0) {
         av_log(NULL, AV_LOG_FATAL, "Audio encoding failed\n");
-        exit_program(1);
+        return ret;
     }
 
     if (got_packet) {
@@ -420,10 +533,14 @@ static void do_audio_out(AVFormatContext *s, OutputStream *ost,
         if (pkt.duration > 0)
             pkt.duration = av_rescale_q(pkt.duration, enc->time_base, ost->st->time_base);
 
-        write_frame(s, &pkt, ost);
-
+        lock_output();
         audio_size += pkt.size;
+        ret = write_frame(s, &pkt, ost);
+        unlock_output();
+        if (ret < 0)
+            return ret;
     }
+    return 0;
 }
 
 static void do_subtitle_out(AVFormatContext *s,
@@ -434,7 +551,7 @@ static void do_subtitle_out(AVFormatContext *s,
 {
     static uint8_t *subtitle_out = NULL;
     int subtitle_out_max_size = 1024 * 1024;
-    int subtitle_out_size, nb, i;
+    int subtitle_out_size, nb, i, ret;
     AVCodecContext *enc;
     AVPacket pkt;
 
@@ -469,8 +586,10 @@ static void do_subtitle_out(AVFormatContext *s,
         sub->pts               += av_rescale_q(sub->start_display_time, (AVRational){ 1, 1000 }, AV_TIME_BASE_Q);
         sub->end_display_time  -= sub->start_display_time;
         sub->start_display_time = 0;
+        start_timer(&ost->encode_timer);
         subtitle_out_size = avcodec_encode_subtitle(enc, subtitle_out,
                                                     subtitle_out_max_size, sub);
+        stop_timer(&ost->encode_timer);
         if (subtitle_out_size < 0) {
             av_log(NULL, AV_LOG_FATAL, "Subtitle encoding failed\n");
             exit_program(1);
@@ -488,14 +607,18 @@ static void do_subtitle_out(AVFormatContext *s,
             else
                 pkt.pts += 90 * sub->end_display_time;
         }
-        write_frame(s, &pkt, ost);
+        lock_output();
+        ret = write_frame(s, &pkt, ost);
+        unlock_output();
+        if (ret < 0)
+            exit_program(1);
     }
 }
 
-static void do_video_out(AVFormatContext *s,
-                         OutputStream *ost,
-                         AVFrame *in_picture,
-                         int *frame_size)
+static int do_video_out(AVFormatContext *s,
+                        OutputStream *ost,
+                        AVFrame *in_picture,
+                        int *frame_size)
 {
     int ret, format_video_sync;
     AVPacket pkt;
@@ -511,9 +634,11 @@ static void do_video_out(AVFormatContext *s,
         ost->frame_number &&
         in_picture->pts != AV_NOPTS_VALUE &&
         in_picture->pts < ost->sync_opts) {
+        lock_output();
         nb_frames_drop++;
+        unlock_output();
         av_log(NULL, AV_LOG_VERBOSE, "*** drop!\n");
-        return;
+        return 0;
     }
 
     if (in_picture->pts == AV_NOPTS_VALUE)
@@ -529,7 +654,7 @@ static void do_video_out(AVFormatContext *s,
     pkt.size = 0;
 
     if (ost->frame_number >= ost->max_frames)
-        return;
+        return 0;
 
     if (s->oformat->flags & AVFMT_RAWPICTURE &&
         enc->codec->id == AV_CODEC_ID_RAWVIDEO) {
@@ -543,7 +668,11 @@ static void do_video_out(AVFormatContext *s,
         pkt.pts    = av_rescale_q(in_picture->pts, enc->time_base, ost->st->time_base);
         pkt.flags |= AV_PKT_FLAG_KEY;
 
-        write_frame(s, &pkt, ost);
+        lock_output();
+        ret = write_frame(s, &pkt, ost);
+        unlock_output();
+        if (ret < 0)
+            return ret;
     } else {
         int got_packet;
 
@@ -559,10 +688,12 @@ static void do_video_out(AVFormatContext *s,
             in_picture->pict_type = AV_PICTURE_TYPE_I;
             ost->forced_kf_index++;
         }
+        start_timer(&ost->encode_timer);
         ret = avcodec_encode_video2(enc, &pkt, in_picture, &got_packet);
+        stop_timer(&ost->encode_timer);
         if (ret < 0) {
             av_log(NULL, AV_LOG_FATAL, "Video encoding failed\n");
-            exit_program(1);
+            return ret;
         }
 
         if (got_packet) {
@@ -571,9 +702,13 @@ static void do_video_out(AVFormatContext *s,
             if (pkt.dts != AV_NOPTS_VALUE)
                 pkt.dts = av_rescale_q(pkt.dts, enc->time_base, ost->st->time_base);
 
-            write_frame(s, &pkt, ost);
-            *frame_size = pkt.size;
+            lock_output();
             video_size += pkt.size;
+            *frame_size = pkt.size;
+            ret = write_frame(s, &pkt, ost);
+            unlock_output();
+            if (ret < 0)
+                return ret;
 
             /* if two pass, output log */
             if (ost->logfile && enc->stats_out) {
@@ -588,6 +723,7 @@ static void do_video_out(AVFormatContext *s,
      * flush, we need to limit them here, before they go into encoder.
      */
     ost->frame_number++;
+    return 0;
 }
 
 static double psnr(double d)
@@ -595,7 +731,7 @@ static double psnr(double d)
     return -10.0 * log(d) / log(10.0);
 }
 
-static void do_video_stats(OutputStream *ost, int frame_size)
+static int do_video_stats(OutputStream *ost, int frame_size)
 {
     AVCodecContext *enc;
     int frame_number;
@@ -606,7 +742,7 @@ static void do_video_stats(OutputStream *ost, int frame_size)
         vstats_file = fopen(vstats_filename, "w");
         if (!vstats_file) {
             perror("fopen");
-            exit_program(1);
+            return AVERROR(errno);
         }
     }
 
@@ -629,8 +765,258 @@ static void do_video_stats(OutputStream *ost, int frame_size)
                (double)video_size / 1024, ti1, bitrate, avg_bitrate);
         fprintf(vstats_file, "type= %c\n", av_get_picture_type_char(enc->coded_frame->pict_type));
     }
+    return 0;
 }
 
+/*
+ * Encode a filtered frame and write the resulting packets. This may run in
+ * the encoder thread of ost, so errors are returned instead of exiting.
+ */
+static int encode_frame(OutputStream *ost, AVFrame *frame)
+{
+    OutputFile *of = output_files[ost->file_index];
+    int frame_size, ret;
+
+    switch (ost->filter->filter->inputs[0]->type) {
+    case AVMEDIA_TYPE_VIDEO:
+        if (!ost->frame_aspect_ratio)
+            ost->st->codec->sample_aspect_ratio = frame->sample_aspect_ratio;
+
+        ret = do_video_out(of->ctx, ost, frame, &frame_size);
+        if (ret >= 0 && vstats_filename && frame_size) {
+            lock_output();
+            ret = do_video_stats(ost, frame_size);
+            unlock_output();
+        }
+        break;
+    case AVMEDIA_TYPE_AUDIO:
+        ret = do_audio_out(of->ctx, ost, frame);
+        break;
+    default:
+        // TODO support subtitle filters
+        av_assert0(0);
+    }
+    return ret;
+}
+
+#if HAVE_PTHREADS
+static void *encoder_thread(void *arg)
+{
+    OutputStream *ost = arg;
+    AVFrame *frame;
+    int ret;
+
+    for (;;) {
+        pthread_mutex_lock(&ost->queue_lock);
+        while (!av_fifo_size(ost->frame_queue) && !ost->queue_finished)
+            pthread_cond_wait(&ost->queue_cond, &ost->queue_lock);
+        if (!av_fifo_size(ost->frame_queue)) {
+            pthread_mutex_unlock(&ost->queue_lock);
+            break;
+        }
+        av_fifo_generic_read(ost->frame_queue, &frame, sizeof(frame), NULL);
+        pthread_cond_signal(&ost->queue_cond);
+        pthread_mutex_unlock(&ost->queue_lock);
+
+        ret = encode_frame(ost, frame);
+        av_frame_free(&frame);
+        if (ret < 0) {
+            /* the main thread exits when it queues the next frame */
+            pthread_mutex_lock(&ost->queue_lock);
+            ost->encode_error = ret;
+            pthread_cond_signal(&ost->queue_cond);
+            pthread_mutex_unlock(&ost->queue_lock);
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Pass a filtered frame to the encoder thread of ost, waiting while its
+ * queue is full. Exit if the thread stopped on an error.
+ */
+static int queue_frame(OutputStream *ost, AVFrame *frame)
+{
+    AVFrame *queued = av_frame_alloc();
+
+    if (!queued)
+        return AVERROR(ENOMEM);
+    av_frame_move_ref(queued, frame);
+
+    if (queued->pts != AV_NOPTS_VALUE)
+        ost->queued_pts = queued->pts;
+    ost->queued_pts += ost->st->codec->codec_type == AVMEDIA_TYPE_AUDIO ?
+                       queued->nb_samples : 1;
+
+    pthread_mutex_lock(&ost->queue_lock);
+    while (!av_fifo_space(ost->frame_queue) && !ost->encode_error)
+        pthread_cond_wait(&ost->queue_cond, &ost->queue_lock);
+    if (ost->encode_error) {
+        pthread_mutex_unlock(&ost->queue_lock);
+        av_frame_free(&queued);
+        exit_program(1);
+    }
+    av_fifo_generic_write(ost->frame_queue, &queued, sizeof(queued), NULL);
+    pthread_cond_signal(&ost->queue_cond);
+    pthread_mutex_unlock(&ost->queue_lock);
+
+    return 0;
+}
+
+/*
+ * Stop the encoder threads once they have encoded the queued frames, return
+ * the error which stopped one of them if any.
+ */
+static int free_encoder_threads(void)
+{
+    AVFrame *frame;
+    int i, ret = 0;
+
+    for (i = 0; i < nb_output_streams; i++) {
+        OutputStream *ost = output_streams[i];
+
+        if (!ost->thread_started)
+            continue;
+
+        pthread_mutex_lock(&ost->queue_lock);
+        ost->queue_finished = 1;
+        pthread_cond_signal(&ost->queue_cond);
+        pthread_mutex_unlock(&ost->queue_lock);
+
+        pthread_join(ost->thread, NULL);
+        ost->thread_started = 0;
+        if (ost->encode_error)
+            ret = ost->encode_error;
+
+        while (av_fifo_size(ost->frame_queue)) {
+            av_fifo_generic_read(ost->frame_queue, &frame, sizeof(frame), NULL);
+            av_frame_free(&frame);
+        }
+        av_fifo_free(ost->frame_queue);
+        ost->frame_queue = NULL;
+        pthread_cond_destroy(&ost->queue_cond);
+        pthread_mutex_destroy(&ost->queue_lock);
+    }
+    return ret;
+}
+
+static int init_encoder_threads(void)
+{
+    int i, ret;
+
+    if (!parallel_encoding)
+        return 0;
+
+    for (i = 0; i < nb_output_streams; i++) {
+        OutputStream *ost = output_streams[i];
+
+        if (!ost->filter || !ost->encoding_needed || ost->nb_chunks)
+            continue;
+
+        if (!(ost->frame_queue = av_fifo_alloc(8 * sizeof(AVFrame*))))
+            return AVERROR(ENOMEM);
+        ost->queued_pts = ost->sync_opts;
+
+        pthread_mutex_init(&ost->queue_lock, NULL);
+        pthread_cond_init (&ost->queue_cond, NULL);
+
+        if ((ret = pthread_create(&ost->thread, NULL, encoder_thread, ost))) {
+            pthread_cond_destroy(&ost->queue_cond);
+            pthread_mutex_destroy(&ost->queue_lock);
+            av_fifo_free(ost->frame_queue);
+            ost->frame_queue = NULL;
+            return AVERROR(ret);
+        }
+        ost->thread_started = 1;
+    }
+    return 0;
+}
+
+/*
+ * Return 1 if the video transcoded with -chunks is more than a second behind
+ * the input, so that the other streams wait for it instead of piling up in
+ * the interleaving queue of the muxer.
+ */
+static int chunks_behind(void)
+{
+    int64_t chunk_dts = INT64_MAX, input_dts = INT64_MAX;
+    int i;
+
+    for (i = 0; i < nb_output_streams; i++) {
+        OutputStream *ost = output_streams[i];
+
+        if (!ost->nb_chunks || ost->finished)
+            continue;
+        if (ost->last_mux_dts == AV_NOPTS_VALUE)
+            return 1;
+        chunk_dts = FFMIN(chunk_dts, av_rescale_q(ost->last_mux_dts, ost->st->time_base,
+                                                  AV_TIME_BASE_Q));
+    }
+    if (chunk_dts == INT64_MAX)
+        return 0;
+
+    for (i = 0; i < nb_input_streams; i++) {
+        InputStream *ist = input_streams[i];
+
+        if (!ist->discard && !input_files[ist->file_index]->eof_reached)
+            input_dts = FFMIN(input_dts, ist->last_dts);
+    }
+    return input_dts != INT64_MAX && input_dts - chunk_dts > AV_TIME_BASE;
+}
+
+/*
+ * Mux the packets encoded by the -chunks threads, in order. If wait is set,
+ * wait for a packet of the first stream which is not finished.
+ */
+static int write_chunk_packets(int wait)
+{
+    AVPacket pkt;
+    int i, ret;
+
+    for (i = 0; i < nb_output_streams; i++) {
+        OutputStream *ost = output_streams[i];
+        OutputFile    *of = output_files[ost->file_index];
+
+        if (!ost->nb_chunks || ost->finished)
+            continue;
+
+        while ((ret = get_chunk_packet(ost, &pkt, wait)) >= 0) {
+            wait = 0;
+
+            /* Each chunk is encoded from scratch, so its first decoding
+             * timestamps may go back to before the end of the previous one.
+             * All the packets of the chunk are shifted by the same amount,
+             * computed from its first packet, to keep their order. */
+            if (ost->nb_shifted_chunks <= ost->cur_chunk) {
+                ost->chunk_dts_shift = 0;
+                if (pkt.dts != AV_NOPTS_VALUE && ost->last_mux_dts != AV_NOPTS_VALUE &&
+                    pkt.dts <= ost->last_mux_dts &&
+                    (pkt.pts == AV_NOPTS_VALUE || pkt.pts > ost->last_mux_dts))
+                    ost->chunk_dts_shift = ost->last_mux_dts + 1 - pkt.dts;
+                ost->nb_shifted_chunks = ost->cur_chunk + 1;
+            }
+            if (pkt.dts != AV_NOPTS_VALUE)
+                pkt.dts += ost->chunk_dts_shift;
+
+            lock_output();
+            video_size += pkt.size;
+            ret = write_frame(of->ctx, &pkt, ost);
+            ost->frame_number++;
+            unlock_output();
+            if (ret < 0)
+                return ret;
+        }
+        if (ret == AVERROR_EOF)
+            ost->finished = 1;
+        else if (ret != AVERROR(EAGAIN))
+            return ret;
+    }
+    return 0;
+}
+#endif
+
 /*
  * Read one frame for lavfi output for ost and encode it.
  */
@@ -638,19 +1024,22 @@ static int poll_filter(OutputStream *ost)
 {
     OutputFile    *of = output_files[ost->file_index];
     AVFrame *filtered_frame = NULL;
-    int frame_size, ret;
+    int ret;
 
     if (!ost->filtered_frame && !(ost->filtered_frame = av_frame_alloc())) {
         return AVERROR(ENOMEM);
     }
     filtered_frame = ost->filtered_frame;
 
+    /* this is where the filter graph actually runs */
+    start_timer(&ost->filter_timer);
     if (ost->enc->type == AVMEDIA_TYPE_AUDIO &&
         !(ost->enc->capabilities & CODEC_CAP_VARIABLE_FRAME_SIZE))
         ret = av_buffersink_get_samples(ost->filter->filter, filtered_frame,
                                          ost->st->codec->frame_size);
     else
         ret = av_buffersink_get_frame(ost->filter->filter, filtered_frame);
+    stop_timer(&ost->filter_timer);
 
     if (ret < 0)
         return ret;
@@ -665,24 +1054,15 @@ static int poll_filter(OutputStream *ost)
                                            ost->st->codec->time_base);
     }
 
-    switch (ost->filter->filter->inputs[0]->type) {
-    case AVMEDIA_TYPE_VIDEO:
-        if (!ost->frame_aspect_ratio)
-            ost->st->codec->sample_aspect_ratio = filtered_frame->sample_aspect_ratio;
-
-        do_video_out(of->ctx, ost, filtered_frame, &frame_size);
-        if (vstats_filename && frame_size)
-            do_video_stats(ost, frame_size);
-        break;
-    case AVMEDIA_TYPE_AUDIO:
-        do_audio_out(of->ctx, ost, filtered_frame);
-        break;
-    default:
-        // TODO support subtitle filters
-        av_assert0(0);
-    }
+#if HAVE_PTHREADS
+    if (ost->thread_started)
+        return queue_frame(ost, filtered_frame);
+#endif
 
+    ret = encode_frame(ost, filtered_frame);
     av_frame_unref(filtered_frame);
+    if (ret < 0)
+        exit_program(1);
 
     return 0;
 }
@@ -709,6 +1089,14 @@ static int poll_filters(void)
 
             if (!output_streams[i]->filter || output_streams[i]->finished)
                 continue;
+#if HAVE_PTHREADS
+            /* sync_opts is updated by the encoder thread */
+            if (output_streams[i]->thread_started)
+                pts = output_streams[i]->queued_pts;
+            /* the chunks are filtered by their own threads */
+            if (output_streams[i]->nb_chunks)
+                continue;
+#endif
 
             pts = av_rescale_q(pts, output_streams[i]->st->codec->time_base,
                                AV_TIME_BASE_Q);
@@ -741,6 +1129,83 @@ static int poll_filters(void)
     return ret;
 }
 
+static void report_stage(const char *name, const char *stage,
+                         const StageTimer *t, int is_last_report)
+{
+    if (progress_avio)
+        avio_printf(progress_avio, "%s.%s.wall_us=%"PRId64"\n"
+                    "%s.%s.cpu_us=%"PRId64"\n",
+                    name, stage, t->wall, name, stage, t->cpu);
+    if (is_last_report && t->calls)
+        av_log(NULL, AV_LOG_INFO, "bench: %-6s %-6s wall=%0.3fs cpu=%0.3fs "
+               "calls=%"PRId64"\n", name, stage,
+               t->wall / 1000000.0, t->cpu / 1000000.0, t->calls);
+}
+
+/* The counters are updated by the other threads without locking, so the
+ * values may be slightly off; they are only meant as an indication. */
+static void report_stages(int is_last_report)
+{
+    char name[32];
+    int i;
+
+    for (i = 0; i < nb_input_files; i++) {
+        InputFile *f = input_files[i];
+
+        snprintf(name, sizeof(name), "i%d", i);
+        if (do_benchmark_all)
+            report_stage(name, "demux", &f->demux_timer, is_last_report);
+#if HAVE_PTHREADS
+        if (progress_avio && f->queue)
+            avio_printf(progress_avio, "%s.queue=%"PRId64"\n", name,
+                        f->nb_packets_sent - f->nb_packets_received);
+#endif
+    }
+
+    for (i = 0; i < nb_input_streams; i++) {
+        InputStream *ist = input_streams[i];
+
+        if (!ist->decoding_needed)
+            continue;
+        snprintf(name, sizeof(name), "i%d:%d", ist->file_index, ist->st->index);
+        if (do_benchmark_all) {
+            report_stage(name, "decode", &ist->decode_timer, is_last_report);
+            report_stage(name, "filter", &ist->filter_timer, is_last_report);
+        }
+#if HAVE_PTHREADS
+        if (progress_avio && ist->thread_started) {
+            pthread_mutex_lock(&ist->queue_lock);
+            avio_printf(progress_avio, "%s.packet_queue=%d\n"
+                        "%s.frame_queue=%"PRId64"\n",
+                        name, av_fifo_size(ist->packet_queue) / (int)sizeof(AVPacket),
+                        name, ist->nb_frames_queued - ist->nb_frames_filtered);
+            pthread_mutex_unlock(&ist->queue_lock);
+        }
+#endif
+    }
+
+    for (i = 0; i < nb_output_streams; i++) {
+        OutputStream *ost = output_streams[i];
+
+        snprintf(name, sizeof(name), "o%d:%d", ost->file_index, ost->index);
+        if (do_benchmark_all) {
+            if (!ost->stream_copy) {
+                report_stage(name, "filter", &ost->filter_timer, is_last_report);
+                report_stage(name, "encode", &ost->encode_timer, is_last_report);
+            }
+            report_stage(name, "mux", &ost->mux_timer, is_last_report);
+        }
+#if HAVE_PTHREADS
+        if (progress_avio && ost->thread_started) {
+            pthread_mutex_lock(&ost->queue_lock);
+            avio_printf(progress_avio, "%s.frame_queue=%d\n", name,
+                        av_fifo_size(ost->frame_queue) / (int)sizeof(AVFrame*));
+            pthread_mutex_unlock(&ost->queue_lock);
+        }
+#endif
+    }
+}
+
 static void print_report(int is_last_report, int64_t timer_start)
 {
     char buf[1024];
@@ -748,12 +1213,12 @@ static void print_report(int is_last_report, int64_t timer_start)
     AVFormatContext *oc;
     int64_t total_size;
     AVCodecContext *enc;
-    int frame_number, vid, i;
-    double bitrate, ti1, pts;
+    int frame_number = 0, vid, i;
+    double bitrate, ti1, pts, fps = 0;
     static int64_t last_time = -1;
     static int qp_histogram[52];
 
-    if (!print_stats && !is_last_report)
+    if (!print_stats && !is_last_report && !progress_url)
         return;
 
     if (!is_last_report) {
@@ -769,6 +1234,14 @@ static void print_report(int is_last_report, int64_t timer_start)
         last_time = cur_time;
     }
 
+    if (progress_url && !progress_avio) {
+        int ret = avio_open2(&progress_avio, progress_url, AVIO_FLAG_WRITE,
+                             &int_cb, NULL);
+        if (ret < 0) {
+            print_error(progress_url, ret);
+            exit_program(1);
+        }
+    }
 
     oc = output_files[0]->ctx;
 
@@ -799,8 +1272,9 @@ static void print_report(int is_last_report, int64_t timer_start)
             float t = (av_gettime() - timer_start) / 1000000.0;
 
             frame_number = ost->frame_number;
+            fps          = t > 1 ? frame_number / t : 0;
             snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "frame=%5d fps=%3d q=%3.1f ",
-                     frame_number, (t > 1) ? (int)(frame_number / t + 0.5) : 0, q);
+                     frame_number, (int)(fps + 0.5), q);
             if (is_last_report)
                 snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "L");
             if (qp_hist) {
@@ -853,9 +1327,21 @@ static void print_report(int is_last_report, int64_t timer_start)
         snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), " dup=%d drop=%d",
                 nb_frames_dup, nb_frames_drop);
 
-    av_log(NULL, AV_LOG_INFO, "%s    \r", buf);
+    if (print_stats || is_last_report) {
+        av_log(NULL, AV_LOG_INFO, "%s    \r", buf);
+        fflush(stderr);
+    }
 
-    fflush(stderr);
+    if (progress_avio) {
+        if (vid)
+            avio_printf(progress_avio, "frame=%d\nfps=%0.2f\n",
+                        frame_number, fps);
+        avio_printf(progress_avio, "total_size=%"PRId64"\n"
+                    "out_time_us=%"PRId64"\n"
+                    "dup_frames=%d\ndrop_frames=%d\n",
+                    total_size, (int64_t)(ti1 * 1000000),
+                    nb_frames_dup, nb_frames_drop);
+    }
 
     if (is_last_report) {
         int64_t raw= audio_size + video_size + extra_size;
@@ -867,6 +1353,14 @@ static void print_report(int is_last_report, int64_t timer_start)
                100.0 * (total_size - raw) / raw
         );
     }
+
+    if (progress_avio || (do_benchmark_all && is_last_report))
+        report_stages(is_last_report);
+    if (progress_avio) {
+        avio_printf(progress_avio, "progress=%s\n",
+                    is_last_report ? "end" : "continue");
+        avio_flush(progress_avio);
+    }
 }
 
 static void flush_encoders(void)
@@ -914,7 +1408,9 @@ static void flush_encoders(void)
                 pkt.data = NULL;
                 pkt.size = 0;
 
+                start_timer(&ost->encode_timer);
                 ret = encode(enc, &pkt, NULL, &got_packet);
+                stop_timer(&ost->encode_timer);
                 if (ret < 0) {
                     av_log(NULL, AV_LOG_FATAL, "%s encoding failed\n", desc);
                     exit_program(1);
@@ -933,7 +1429,8 @@ static void flush_encoders(void)
                     pkt.dts = av_rescale_q(pkt.dts, enc->time_base, ost->st->time_base);
                 if (pkt.duration > 0)
                     pkt.duration = av_rescale_q(pkt.duration, enc->time_base, ost->st->time_base);
-                write_frame(os, &pkt, ost);
+                if (write_frame(os, &pkt, ost) < 0)
+                    exit_program(1);
             }
 
             if (stop_encoding)
@@ -966,6 +1463,7 @@ static void do_streamcopy(InputStream *ist, OutputStream *ost, const AVPacket *p
     int64_t start_time = (of->start_time == AV_NOPTS_VALUE) ? 0 : of->start_time;
     int64_t ost_tb_start_time = av_rescale_q(start_time, AV_TIME_BASE_Q, ost->st->time_base);
     AVPacket opkt;
+    int ret;
 
     av_init_packet(&opkt);
 
@@ -990,12 +1488,14 @@ static void do_streamcopy(InputStream *ist, OutputStream *ost, const AVPacket *p
     }
 
     /* force the input stream PTS */
+    lock_output();
     if (ost->st->codec->codec_type == AVMEDIA_TYPE_AUDIO)
         audio_size += pkt->size;
     else if (ost->st->codec->codec_type == AVMEDIA_TYPE_VIDEO) {
         video_size += pkt->size;
         ost->sync_opts++;
     }
+    unlock_output();
 
     if (pkt->pts != AV_NOPTS_VALUE)
         opkt.pts = av_rescale_q(pkt->pts, ist->st->time_base, ost->st->time_base) - ost_tb_start_time;
@@ -1030,7 +1530,19 @@ static void do_streamcopy(InputStream *ist, OutputStream *ost, const AVPacket *p
         opkt.size = pkt->size;
     }
 
-    write_frame(of->ctx, &opkt, ost);
+    /* Unless the data was rewritten above, the output packet points into the
+     * input packet. Referencing its buffer keeps the muxer from copying it. */
+    if (!opkt.buf && pkt->buf) {
+        opkt.buf = av_buffer_ref(pkt->buf);
+        if (!opkt.buf)
+            exit_program(1);
+    }
+
+    lock_output();
+    ret = write_frame(of->ctx, &opkt, ost);
+    unlock_output();
+    if (ret < 0)
+        exit_program(1);
     ost->st->codec->frame_number++;
 }
 
@@ -1052,54 +1564,82 @@ int guess_input_channel_layout(InputStream *ist)
     return 1;
 }
 
-static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output)
+static int decode_audio_frame(InputStream *ist, AVPacket *pkt, int *got_output,
+                              int64_t *next_dts)
 {
-    AVFrame *decoded_frame, *f;
-    AVCodecContext *avctx = ist->st->codec;
-    int i, ret, err = 0, resample_changed;
+    AVFrame *decoded_frame;
+    AVCodecContext *avctx = ist->dec_ctx;
+    int ret;
 
     if (!ist->decoded_frame && !(ist->decoded_frame = av_frame_alloc()))
         return AVERROR(ENOMEM);
-    if (!ist->filter_frame && !(ist->filter_frame = av_frame_alloc()))
-        return AVERROR(ENOMEM);
     decoded_frame = ist->decoded_frame;
 
+    start_timer(&ist->decode_timer);
     ret = avcodec_decode_audio4(avctx, decoded_frame, got_output, pkt);
-    if (!*got_output || ret < 0) {
-        if (!pkt->size) {
-            for (i = 0; i < ist->nb_filters; i++)
-                av_buffersrc_add_frame(ist->filters[i]->filter, NULL);
-        }
+    stop_timer(&ist->decode_timer);
+    if (!*got_output || ret < 0)
         return ret;
-    }
 
     /* if the decoder provides a pts, use it instead of the last packet pts.
        the decoder could be delaying output by a packet or more. */
     if (decoded_frame->pts != AV_NOPTS_VALUE)
-        ist->next_dts = decoded_frame->pts;
+        *next_dts = decoded_frame->pts;
     else if (pkt->pts != AV_NOPTS_VALUE) {
         decoded_frame->pts = pkt->pts;
         pkt->pts           = AV_NOPTS_VALUE;
     }
 
+    return ret;
+}
+
+/*
+ * Send a decoded audio frame to the filters of ist. channels is the channel
+ * count of the decoder when the frame was output.
+ */
+static int filter_audio_frame(InputStream *ist, AVFrame *decoded_frame, int channels)
+{
+    AVFrame *f;
+    AVCodecContext *avctx = ist->dec_ctx;
+    int threaded = avctx != ist->st->codec;
+    int i, err = 0, resample_changed, guessed = 0;
+
+    if (!ist->filter_frame && !(ist->filter_frame = av_frame_alloc()))
+        return AVERROR(ENOMEM);
+
+    /* the decoder context belongs to the decoding thread, so the layout is
+     * guessed on the frame */
+    if (threaded && !decoded_frame->channel_layout) {
+        decoded_frame->channel_layout = av_get_default_channel_layout(channels);
+        guessed = 1;
+    }
+
     resample_changed = ist->resample_sample_fmt     != decoded_frame->format         ||
-                       ist->resample_channels       != avctx->channels               ||
+                       ist->resample_channels       != channels                      ||
                        ist->resample_channel_layout != decoded_frame->channel_layout ||
                        ist->resample_sample_rate    != decoded_frame->sample_rate;
     if (resample_changed) {
         char layout1[64], layout2[64];
 
-        if (!guess_input_channel_layout(ist)) {
+        if (threaded ? !decoded_frame->channel_layout :
+                       !guess_input_channel_layout(ist)) {
             av_log(NULL, AV_LOG_FATAL, "Unable to find default channel "
                    "layout for Input Stream #%d.%d\n", ist->file_index,
                    ist->st->index);
             exit_program(1);
         }
-        decoded_frame->channel_layout = avctx->channel_layout;
+        if (!threaded) {
+            decoded_frame->channel_layout = avctx->channel_layout;
+        } else if (guessed) {
+            av_get_channel_layout_string(layout1, sizeof(layout1), channels,
+                                         decoded_frame->channel_layout);
+            av_log(NULL, AV_LOG_WARNING, "Guessed Channel Layout for  Input Stream "
+                   "#%d.%d : %s\n", ist->file_index, ist->st->index, layout1);
+        }
 
         av_get_channel_layout_string(layout1, sizeof(layout1), ist->resample_channels,
                                      ist->resample_channel_layout);
-        av_get_channel_layout_string(layout2, sizeof(layout2), avctx->channels,
+        av_get_channel_layout_string(layout2, sizeof(layout2), channels,
                                      decoded_frame->channel_layout);
 
         av_log(NULL, AV_LOG_INFO,
@@ -1108,12 +1648,12 @@ static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output)
                ist->resample_sample_rate,  av_get_sample_fmt_name(ist->resample_sample_fmt),
                ist->resample_channels, layout1,
                decoded_frame->sample_rate, av_get_sample_fmt_name(decoded_frame->format),
-               avctx->channels, layout2);
+               channels, layout2);
 
         ist->resample_sample_fmt     = decoded_frame->format;
         ist->resample_sample_rate    = decoded_frame->sample_rate;
         ist->resample_channel_layout = decoded_frame->channel_layout;
-        ist->resample_channels       = avctx->channels;
+        ist->resample_channels       = channels;
 
         for (i = 0; i < nb_filtergraphs; i++)
             if (ist_in_filtergraph(filtergraphs[i], ist) &&
@@ -1126,7 +1666,121 @@ static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output)
     if (decoded_frame->pts != AV_NOPTS_VALUE)
         decoded_frame->pts = av_rescale_q(decoded_frame->pts,
                                           ist->st->time_base,
-                                          (AVRational){1, ist->st->codec->sample_rate});
+                                          (AVRational){1, decoded_frame->sample_rate});
+    start_timer(&ist->filter_timer);
+    for (i = 0; i < ist->nb_filters; i++) {
+        if (i < ist->nb_filters - 1) {
+            f = ist->filter_frame;
+            err = av_frame_ref(f, decoded_frame);
+            if (err < 0)
+                break;
+        } else
+            f = decoded_frame;
+
+        err = av_buffersrc_add_frame(ist->filters[i]->filter, f);
+        if (err < 0)
+            break;
+    }
+    stop_timer(&ist->filter_timer);
+
+    av_frame_unref(ist->filter_frame);
+    av_frame_unref(decoded_frame);
+    return err;
+}
+
+static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output)
+{
+    int i, ret, err;
+
+    ret = decode_audio_frame(ist, pkt, got_output, &ist->next_dts);
+    if (!*got_output || ret < 0) {
+        if (!pkt->size) {
+            for (i = 0; i < ist->nb_filters; i++)
+                av_buffersrc_add_frame(ist->filters[i]->filter, NULL);
+        }
+        return ret;
+    }
+
+    err = filter_audio_frame(ist, ist->decoded_frame, ist->dec_ctx->channels);
+    return err < 0 ? err : ret;
+}
+
+static int decode_video_frame(InputStream *ist, AVPacket *pkt, int *got_output)
+{
+    AVFrame *decoded_frame;
+    int ret, err;
+
+    if (!ist->decoded_frame && !(ist->decoded_frame = av_frame_alloc()))
+        return AVERROR(ENOMEM);
+    decoded_frame = ist->decoded_frame;
+
+    start_timer(&ist->decode_timer);
+    ret = avcodec_decode_video2(ist->dec_ctx,
+                                decoded_frame, got_output, pkt);
+    stop_timer(&ist->decode_timer);
+    if (!*got_output || ret < 0)
+        return ret;
+
+    if (ist->hwaccel_retrieve_data && decoded_frame->format == ist->hwaccel_pix_fmt) {
+        err = ist->hwaccel_retrieve_data(ist->dec_ctx, decoded_frame);
+        if (err < 0) {
+            av_frame_unref(decoded_frame);
+            return err;
+        }
+    }
+    ist->hwaccel_retrieved_pix_fmt = decoded_frame->format;
+
+    decoded_frame->pts = guess_correct_pts(&ist->pts_ctx, decoded_frame->pkt_pts,
+                                           decoded_frame->pkt_dts);
+    /* with thread_max_delay, a frame can be returned before the packet is used */
+    if (ret)
+        pkt->size = 0;
+
+    if (ist->st->sample_aspect_ratio.num)
+        decoded_frame->sample_aspect_ratio = ist->st->sample_aspect_ratio;
+
+    return ret;
+}
+
+/*
+ * Send a decoded video frame to the filters of ist.
+ */
+static int filter_video_frame(InputStream *ist, AVFrame *decoded_frame)
+{
+    AVFrame *f;
+    int i, ret = 0, err = 0, resample_changed;
+
+    if (!ist->filter_frame && !(ist->filter_frame = av_frame_alloc()))
+        return AVERROR(ENOMEM);
+
+    resample_changed = ist->resample_width   != decoded_frame->width  ||
+                       ist->resample_height  != decoded_frame->height ||
+                       ist->resample_pix_fmt != decoded_frame->format;
+    if (resample_changed) {
+        av_log(NULL, AV_LOG_INFO,
+               "Input stream #%d:%d frame changed from size:%dx%d fmt:%s to size:%dx%d fmt:%s\n",
+               ist->file_index, ist->st->index,
+               ist->resample_width,  ist->resample_height,  av_get_pix_fmt_name(ist->resample_pix_fmt),
+               decoded_frame->width, decoded_frame->height, av_get_pix_fmt_name(decoded_frame->format));
+
+        ret = poll_filters();
+        if (ret < 0 && (ret != AVERROR_EOF && ret != AVERROR(EAGAIN)))
+            av_log(NULL, AV_LOG_ERROR, "Error while filtering.\n");
+
+        ist->resample_width   = decoded_frame->width;
+        ist->resample_height  = decoded_frame->height;
+        ist->resample_pix_fmt = decoded_frame->format;
+        ist->resample_sample_aspect_ratio = decoded_frame->sample_aspect_ratio;
+
+        for (i = 0; i < nb_filtergraphs; i++)
+            if (ist_in_filtergraph(filtergraphs[i], ist) &&
+                configure_filtergraph(filtergraphs[i]) < 0) {
+                av_log(NULL, AV_LOG_FATAL, "Error reinitializing filters!\n");
+                exit_program(1);
+            }
+    }
+
+    start_timer(&ist->filter_timer);
     for (i = 0; i < ist->nb_filters; i++) {
         if (i < ist->nb_filters - 1) {
             f = ist->filter_frame;
@@ -1136,119 +1790,370 @@ static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output)
         } else
             f = decoded_frame;
 
-        err = av_buffersrc_add_frame(ist->filters[i]->filter, f);
-        if (err < 0)
+        err = av_buffersrc_add_frame(ist->filters[i]->filter, f);
+        if (err < 0)
+            break;
+    }
+    stop_timer(&ist->filter_timer);
+
+    av_frame_unref(ist->filter_frame);
+    av_frame_unref(decoded_frame);
+    return err < 0 ? err : ret;
+}
+
+static int decode_video(InputStream *ist, AVPacket *pkt, int *got_output)
+{
+    int i, ret, err;
+
+    ret = decode_video_frame(ist, pkt, got_output);
+    if (!*got_output || ret < 0) {
+        if (!pkt->size) {
+            for (i = 0; i < ist->nb_filters; i++)
+                av_buffersrc_add_frame(ist->filters[i]->filter, NULL);
+        }
+        return ret;
+    }
+
+    err = filter_video_frame(ist, ist->decoded_frame);
+    return err < 0 ? err : ret;
+}
+
+static int transcode_subtitles(InputStream *ist, AVPacket *pkt, int *got_output)
+{
+    AVSubtitle subtitle;
+    int i, ret;
+
+    start_timer(&ist->decode_timer);
+    ret = avcodec_decode_subtitle2(ist->dec_ctx, &subtitle, got_output, pkt);
+    stop_timer(&ist->decode_timer);
+    if (ret < 0)
+        return ret;
+    if (!*got_output)
+        return ret;
+
+    for (i = 0; i < nb_output_streams; i++) {
+        OutputStream *ost = output_streams[i];
+
+        if (!check_output_constraints(ist, ost) || !ost->encoding_needed)
+            continue;
+
+        do_subtitle_out(output_files[ost->file_index]->ctx, ost, ist, &subtitle, pkt->pts);
+    }
+
+    avsubtitle_free(&subtitle);
+    return ret;
+}
+
+#if HAVE_PTHREADS
+/* a decoded frame passed from a decoding thread to the main thread */
+typedef struct QueuedFrame {
+    AVFrame *frame;  /* NULL after the last frame of the stream */
+    int channels;    /* decoder channel count, for audio */
+    int64_t next_dts; /* the next dts from the decoder, for audio */
+} QueuedFrame;
+
+/*
+ * Pass a decoded frame, or the end of stream if frame is NULL, from the
+ * decoding thread of ist to the main thread.
+ */
+static int queue_decoded_frame(InputStream *ist, AVFrame *frame, int64_t next_dts)
+{
+    QueuedFrame qf = { NULL };
+
+    qf.next_dts = next_dts;
+    if (frame) {
+        if (!(qf.frame = av_frame_alloc()))
+            return AVERROR(ENOMEM);
+        av_frame_move_ref(qf.frame, frame);
+        qf.channels = ist->dec_ctx->channels;
+    }
+
+    pthread_mutex_lock(&ist->queue_lock);
+    while (av_fifo_space(ist->frame_queue) < sizeof(qf) && !ist->queue_finished)
+        pthread_cond_wait(&ist->queue_cond, &ist->queue_lock);
+    if (ist->queue_finished) {
+        pthread_mutex_unlock(&ist->queue_lock);
+        av_frame_free(&qf.frame);
+        return AVERROR_EXIT;
+    }
+    av_fifo_generic_write(ist->frame_queue, &qf, sizeof(qf), NULL);
+    ist->nb_frames_queued++;
+    pthread_cond_broadcast(&ist->queue_cond);
+    pthread_mutex_unlock(&ist->queue_lock);
+
+    return 0;
+}
+
+/*
+ * Decode all frames in pkt in the decoding thread of ist. An empty packet
+ * flushes the decoder and ends the stream.
+ */
+static int decode_packet(InputStream *ist, AVPacket *pkt)
+{
+    AVPacket avpkt = *pkt;
+    int eof = !pkt->size;
+    int got_output, ret, err = 0;
+
+    do {
+        int64_t next_dts = AV_NOPTS_VALUE;
+
+        if (avpkt.size && avpkt.size != pkt->size) {
+            av_log(NULL, ist->showed_multi_packet_warning ? AV_LOG_VERBOSE : AV_LOG_WARNING,
+                   "Multiple frames in a packet from stream %d\n", pkt->stream_index);
+            ist->showed_multi_packet_warning = 1;
+        }
+
+        if (ist->st->codec->codec_type == AVMEDIA_TYPE_AUDIO)
+            ret = decode_audio_frame(ist, &avpkt, &got_output, &next_dts);
+        else
+            ret = decode_video_frame(ist, &avpkt, &got_output);
+        if (ret < 0) {
+            err = ret;
+            break;
+        }
+        if (got_output &&
+            (err = queue_decoded_frame(ist, ist->decoded_frame, next_dts)) < 0)
+            break;
+
+        if (!eof) {
+            avpkt.data += ret;
+            avpkt.size -= ret;
+        }
+    } while (avpkt.size > 0 || (eof && got_output));
+
+    /* the main thread waits for the end of the stream */
+    if (eof && err != AVERROR_EXIT) {
+        ret = queue_decoded_frame(ist, NULL, AV_NOPTS_VALUE);
+        if (!err)
+            err = ret;
+    }
+    return err;
+}
+
+static void *decoder_thread(void *arg)
+{
+    InputStream *ist = arg;
+    AVPacket pkt;
+    int ret;
+
+    for (;;) {
+        pthread_mutex_lock(&ist->queue_lock);
+        while (!av_fifo_size(ist->packet_queue) && !ist->queue_finished)
+            pthread_cond_wait(&ist->queue_cond, &ist->queue_lock);
+        if (ist->queue_finished) {
+            pthread_mutex_unlock(&ist->queue_lock);
             break;
+        }
+        av_fifo_generic_read(ist->packet_queue, &pkt, sizeof(pkt), NULL);
+        pthread_cond_broadcast(&ist->queue_cond);
+        pthread_mutex_unlock(&ist->queue_lock);
+
+        ret = decode_packet(ist, &pkt);
+        av_free_packet(&pkt);
+        if (ret == AVERROR_EXIT)
+            break;
+        if (ret < 0) {
+            pthread_mutex_lock(&ist->queue_lock);
+            ist->decode_error = ret;
+            pthread_mutex_unlock(&ist->queue_lock);
+        }
     }
 
-    av_frame_unref(ist->filter_frame);
-    av_frame_unref(decoded_frame);
-    return err < 0 ? err : ret;
+    return NULL;
 }
 
-static int decode_video(InputStream *ist, AVPacket *pkt, int *got_output)
+/*
+ * Send the frames decoded by the decoding thread of ist to the filters. If
+ * wait_eof is set, wait for the end of the stream, else return as soon as the
+ * queue is empty.
+ */
+static int filter_queued_frames(InputStream *ist, int wait_eof)
 {
-    AVFrame *decoded_frame, *f;
-    int i, ret = 0, err = 0, resample_changed;
+    QueuedFrame qf;
+    int i, ret = 0, err = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&ist->queue_lock);
+        while (wait_eof && !av_fifo_size(ist->frame_queue))
+            pthread_cond_wait(&ist->queue_cond, &ist->queue_lock);
+        if (!av_fifo_size(ist->frame_queue)) {
+            pthread_mutex_unlock(&ist->queue_lock);
+            break;
+        }
+        av_fifo_generic_read(ist->frame_queue, &qf, sizeof(qf), NULL);
+        pthread_mutex_unlock(&ist->queue_lock);
 
-    if (!ist->decoded_frame && !(ist->decoded_frame = av_frame_alloc()))
-        return AVERROR(ENOMEM);
-    if (!ist->filter_frame && !(ist->filter_frame = av_frame_alloc()))
-        return AVERROR(ENOMEM);
-    decoded_frame = ist->decoded_frame;
+        /* the audio decoder pts is used instead of the last packet dts,
+         * as in decode_audio() */
+        if (qf.next_dts != AV_NOPTS_VALUE)
+            ist->next_dts = qf.next_dts;
 
-    ret = avcodec_decode_video2(ist->st->codec,
-                                decoded_frame, got_output, pkt);
-    if (!*got_output || ret < 0) {
-        if (!pkt->size) {
+        if (!qf.frame) {
             for (i = 0; i < ist->nb_filters; i++)
                 av_buffersrc_add_frame(ist->filters[i]->filter, NULL);
-        }
-        return ret;
-    }
-
-    if (ist->hwaccel_retrieve_data && decoded_frame->format == ist->hwaccel_pix_fmt) {
-        err = ist->hwaccel_retrieve_data(ist->st->codec, decoded_frame);
+        } else if (ist->st->codec->codec_type == AVMEDIA_TYPE_AUDIO)
+            err = filter_audio_frame(ist, qf.frame, qf.channels);
+        else
+            err = filter_video_frame(ist, qf.frame);
         if (err < 0)
-            goto fail;
-    }
-    ist->hwaccel_retrieved_pix_fmt = decoded_frame->format;
+            ret = err;
 
-    decoded_frame->pts = guess_correct_pts(&ist->pts_ctx, decoded_frame->pkt_pts,
-                                           decoded_frame->pkt_dts);
-    pkt->size = 0;
+        pthread_mutex_lock(&ist->queue_lock);
+        if (qf.frame)
+            ist->nb_frames_filtered++;
+        pthread_cond_broadcast(&ist->queue_cond);
+        pthread_mutex_unlock(&ist->queue_lock);
 
-    if (ist->st->sample_aspect_ratio.num)
-        decoded_frame->sample_aspect_ratio = ist->st->sample_aspect_ratio;
+        if (!qf.frame && wait_eof)
+            break;
+        av_frame_free(&qf.frame);
+    }
 
-    resample_changed = ist->resample_width   != decoded_frame->width  ||
-                       ist->resample_height  != decoded_frame->height ||
-                       ist->resample_pix_fmt != decoded_frame->format;
-    if (resample_changed) {
-        av_log(NULL, AV_LOG_INFO,
-               "Input stream #%d:%d frame changed from size:%dx%d fmt:%s to size:%dx%d fmt:%s\n",
-               ist->file_index, ist->st->index,
-               ist->resample_width,  ist->resample_height,  av_get_pix_fmt_name(ist->resample_pix_fmt),
-               decoded_frame->width, decoded_frame->height, av_get_pix_fmt_name(decoded_frame->format));
+    pthread_mutex_lock(&ist->queue_lock);
+    if (ist->decode_error) {
+        ret = ist->decode_error;
+        ist->decode_error = 0;
+    }
+    pthread_mutex_unlock(&ist->queue_lock);
 
-        ret = poll_filters();
-        if (ret < 0 && (ret != AVERROR_EOF && ret != AVERROR(EAGAIN)))
-            av_log(NULL, AV_LOG_ERROR, "Error while filtering.\n");
+    return ret;
+}
 
-        ist->resample_width   = decoded_frame->width;
-        ist->resample_height  = decoded_frame->height;
-        ist->resample_pix_fmt = decoded_frame->format;
+/*
+ * Pass a packet to the decoding thread of ist, or flush the decoder if pkt is
+ * NULL. Decoded frames are sent to the filters while the queue is full.
+ */
+static int queue_packet(InputStream *ist, const AVPacket *pkt)
+{
+    AVPacket src, queued;
+    int ret = 0;
 
-        for (i = 0; i < nb_filtergraphs; i++)
-            if (ist_in_filtergraph(filtergraphs[i], ist) &&
-                configure_filtergraph(filtergraphs[i]) < 0) {
-                av_log(NULL, AV_LOG_FATAL, "Error reinitializing filters!\n");
-                exit_program(1);
-            }
+    av_init_packet(&queued);
+    queued.data = NULL;
+    queued.size = 0;
+    if (pkt) {
+        src = *pkt;
+        if ((ret = av_packet_ref(&queued, &src)) < 0)
+            return ret;
     }
 
-    for (i = 0; i < ist->nb_filters; i++) {
-        if (i < ist->nb_filters - 1) {
-            f = ist->filter_frame;
-            err = av_frame_ref(f, decoded_frame);
-            if (err < 0)
+    pthread_mutex_lock(&ist->queue_lock);
+    while (!av_fifo_space(ist->packet_queue)) {
+        if (av_fifo_size(ist->frame_queue)) {
+            pthread_mutex_unlock(&ist->queue_lock);
+            ret = filter_queued_frames(ist, 0);
+            pthread_mutex_lock(&ist->queue_lock);
+            if (ret < 0)
                 break;
         } else
-            f = decoded_frame;
-
-        err = av_buffersrc_add_frame(ist->filters[i]->filter, f);
-        if (err < 0)
-            break;
+            pthread_cond_wait(&ist->queue_cond, &ist->queue_lock);
+    }
+    if (ret >= 0) {
+        av_fifo_generic_write(ist->packet_queue, &queued, sizeof(queued), NULL);
+        pthread_cond_broadcast(&ist->queue_cond);
     }
+    pthread_mutex_unlock(&ist->queue_lock);
 
-fail:
-    av_frame_unref(ist->filter_frame);
-    av_frame_unref(decoded_frame);
-    return err < 0 ? err : ret;
+    if (ret < 0)
+        av_free_packet(&queued);
+    return ret;
 }
 
-static int transcode_subtitles(InputStream *ist, AVPacket *pkt, int *got_output)
+/*
+ * Send the frames decoded so far by all decoding threads to the filters.
+ */
+static void filter_decoded_frames(void)
 {
-    AVSubtitle subtitle;
-    int i, ret = avcodec_decode_subtitle2(ist->st->codec,
-                                          &subtitle, got_output, pkt);
-    if (ret < 0)
-        return ret;
-    if (!*got_output)
-        return ret;
+    int i;
 
-    for (i = 0; i < nb_output_streams; i++) {
-        OutputStream *ost = output_streams[i];
+    for (i = 0; i < nb_input_streams; i++) {
+        InputStream *ist = input_streams[i];
 
-        if (!check_output_constraints(ist, ost) || !ost->encoding_needed)
+        if (ist->thread_started && filter_queued_frames(ist, 0) < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Error while decoding stream #%d:%d\n",
+                   ist->file_index, ist->st->index);
+            if (exit_on_error)
+                exit_program(1);
+        }
+    }
+}
+
+static void free_decoder_threads(void)
+{
+    AVPacket pkt;
+    QueuedFrame qf;
+    int i;
+
+    for (i = 0; i < nb_input_streams; i++) {
+        InputStream *ist = input_streams[i];
+
+        if (!ist->thread_started)
             continue;
 
-        do_subtitle_out(output_files[ost->file_index]->ctx, ost, ist, &subtitle, pkt->pts);
+        pthread_mutex_lock(&ist->queue_lock);
+        ist->queue_finished = 1;
+        pthread_cond_broadcast(&ist->queue_cond);
+        pthread_mutex_unlock(&ist->queue_lock);
+
+        pthread_join(ist->thread, NULL);
+        ist->thread_started = 0;
+
+        while (av_fifo_size(ist->packet_queue)) {
+            av_fifo_generic_read(ist->packet_queue, &pkt, sizeof(pkt), NULL);
+            av_free_packet(&pkt);
+        }
+        while (av_fifo_size(ist->frame_queue)) {
+            av_fifo_generic_read(ist->frame_queue, &qf, sizeof(qf), NULL);
+            av_frame_free(&qf.frame);
+        }
+        av_fifo_free(ist->packet_queue);
+        av_fifo_free(ist->frame_queue);
+        ist->packet_queue = ist->frame_queue = NULL;
+        pthread_cond_destroy(&ist->queue_cond);
+        pthread_mutex_destroy(&ist->queue_lock);
     }
+}
 
-    avsubtitle_free(&subtitle);
-    return ret;
+static int init_decoder_threads(void)
+{
+    int i, ret;
+
+    if (!parallel_decoding)
+        return 0;
+
+    for (i = 0; i < nb_input_streams; i++) {
+        InputStream *ist = input_streams[i];
+        enum AVMediaType type = ist->st->codec->codec_type;
+
+        if (!ist->decoding_needed ||
+            (type != AVMEDIA_TYPE_AUDIO && type != AVMEDIA_TYPE_VIDEO))
+            continue;
+
+        ist->packet_queue = av_fifo_alloc(16 * sizeof(AVPacket));
+        ist->frame_queue  = av_fifo_alloc(8  * sizeof(QueuedFrame));
+        if (!ist->packet_queue || !ist->frame_queue) {
+            av_fifo_free(ist->packet_queue);
+            av_fifo_free(ist->frame_queue);
+            ist->packet_queue = ist->frame_queue = NULL;
+            return AVERROR(ENOMEM);
+        }
+
+        pthread_mutex_init(&ist->queue_lock, NULL);
+        pthread_cond_init (&ist->queue_cond, NULL);
+
+        if ((ret = pthread_create(&ist->thread, NULL, decoder_thread, ist))) {
+            pthread_cond_destroy(&ist->queue_cond);
+            pthread_mutex_destroy(&ist->queue_lock);
+            av_fifo_free(ist->packet_queue);
+            av_fifo_free(ist->frame_queue);
+            ist->packet_queue = ist->frame_queue = NULL;
+            return AVERROR(ret);
+        }
+        ist->thread_started = 1;
+    }
+    return 0;
 }
+#endif
 
 /* pkt = NULL means EOF (needed to flush decoder buffers) */
 static int output_packet(InputStream *ist, const AVPacket *pkt)
@@ -1260,6 +2165,13 @@ static int output_packet(InputStream *ist, const AVPacket *pkt)
     if (ist->next_dts == AV_NOPTS_VALUE)
         ist->next_dts = ist->last_dts;
 
+#if HAVE_PTHREADS
+    if (ist->thread_started && !pkt) {
+        int ret = queue_packet(ist, NULL);
+        return ret < 0 ? ret : filter_queued_frames(ist, 1);
+    }
+#endif
+
     if (pkt == NULL) {
         /* EOF handling */
         av_init_packet(&avpkt);
@@ -1273,6 +2185,27 @@ static int output_packet(InputStream *ist, const AVPacket *pkt)
     if (pkt->dts != AV_NOPTS_VALUE)
         ist->next_dts = ist->last_dts = av_rescale_q(pkt->dts, ist->st->time_base, AV_TIME_BASE_Q);
 
+#if HAVE_PTHREADS
+    if (ist->thread_started) {
+        /* an empty packet would flush the decoder */
+        if (pkt->size) {
+            int ret = queue_packet(ist, pkt);
+            if (ret < 0)
+                return ret;
+        }
+
+        /* the decoder context belongs to the decoding thread */
+        if (ist->st->codec->codec_type == AVMEDIA_TYPE_VIDEO) {
+            if (pkt->duration)
+                ist->next_dts += av_rescale_q(pkt->duration, ist->st->time_base, AV_TIME_BASE_Q);
+            else if (ist->st->avg_frame_rate.num)
+                ist->next_dts += av_rescale_q(1, av_inv_q(ist->st->avg_frame_rate),
+                                              AV_TIME_BASE_Q);
+        }
+        avpkt.size = 0;
+    }
+#endif
+
     // while we have more to decode or while the decoder did output something on EOF
     while (ist->decoding_needed && (avpkt.size > 0 || (!pkt && got_output))) {
         int ret = 0;
@@ -1292,6 +2225,8 @@ static int output_packet(InputStream *ist, const AVPacket *pkt)
             break;
         case AVMEDIA_TYPE_VIDEO:
             ret = decode_video    (ist, &avpkt, &got_output);
+            if (pkt && !ret)
+                break;
             if (avpkt.duration)
                 ist->next_dts += av_rescale_q(avpkt.duration, ist->st->time_base, AV_TIME_BASE_Q);
             else if (ist->st->avg_frame_rate.num)
@@ -1448,16 +2383,35 @@ static int init_input_stream(int ist_index, char *error, int error_len)
             }
         }
 
-        ist->st->codec->opaque      = ist;
-        ist->st->codec->get_format  = get_format;
-        ist->st->codec->get_buffer2 = get_buffer;
-        ist->st->codec->thread_safe_callbacks = 1;
+#if HAVE_PTHREADS
+        if (parallel_decoding &&
+            (codec->type == AVMEDIA_TYPE_AUDIO || codec->type == AVMEDIA_TYPE_VIDEO)) {
+            AVCodecContext *dec_ctx = avcodec_alloc_context3(codec);
+
+            /* the demuxer keeps updating st->codec, e.g. from its parser */
+            if (!dec_ctx)
+                return AVERROR(ENOMEM);
+            ist->dec_ctx = dec_ctx;
+            if ((ret = avcodec_copy_context(dec_ctx, ist->st->codec)) < 0)
+                return ret;
+
+            /* frame threading is not reliable for all decoders when they are
+             * fed from a thread of their own, e.g. mpeg4 with B-frames */
+            if (!av_dict_get(ist->opts, "thread_type", NULL, 0))
+                av_dict_set(&ist->opts, "thread_type", "slice", 0);
+        }
+#endif
+
+        ist->dec_ctx->opaque      = ist;
+        ist->dec_ctx->get_format  = get_format;
+        ist->dec_ctx->get_buffer2 = get_buffer;
+        ist->dec_ctx->thread_safe_callbacks = 1;
 
-        av_opt_set_int(ist->st->codec, "refcounted_frames", 1, 0);
+        av_opt_set_int(ist->dec_ctx, "refcounted_frames", 1, 0);
 
         if (!av_dict_get(ist->opts, "threads", NULL, 0))
             av_dict_set(&ist->opts, "threads", "auto", 0);
-        if ((ret = avcodec_open2(ist->st->codec, codec, &ist->opts)) < 0) {
+        if ((ret = avcodec_open2(ist->dec_ctx, codec, &ist->opts)) < 0) {
             char errbuf[128];
             if (ret == AVERROR_EXPERIMENTAL)
                 abort_codec_experimental(codec, 0);
@@ -1473,7 +2427,7 @@ static int init_input_stream(int ist_index, char *error, int error_len)
         assert_avoptions(ist->opts);
     }
 
-    ist->last_dts = ist->st->avg_frame_rate.num ? - ist->st->codec->has_b_frames * AV_TIME_BASE / av_q2d(ist->st->avg_frame_rate) : 0;
+    ist->last_dts = ist->st->avg_frame_rate.num ? - ist->dec_ctx->has_b_frames * AV_TIME_BASE / av_q2d(ist->st->avg_frame_rate) : 0;
     ist->next_dts = AV_NOPTS_VALUE;
     init_pts_correction(&ist->pts_ctx);
     ist->is_start = 1;
@@ -1498,6 +2452,73 @@ static InputStream *get_input_stream(OutputStream *ost)
     return NULL;
 }
 
+static void set_output_frame_rate(OutputStream *ost, InputStream *ist)
+{
+    AVFormatContext *oc = output_files[ost->file_index]->ctx;
+
+    /*
+     * We want CFR output if and only if one of those is true:
+     * 1) user specified output framerate with -r
+     * 2) user specified -vsync cfr
+     * 3) output format is CFR and the user didn't force vsync to
+     *    something else than CFR
+     *
+     * in such a case, set ost->frame_rate
+     */
+    if (ost->st->codec->codec_type == AVMEDIA_TYPE_VIDEO &&
+        !ost->frame_rate.num && ist &&
+        (video_sync_method ==  VSYNC_CFR ||
+         (video_sync_method ==  VSYNC_AUTO &&
+          !(oc->oformat->flags & (AVFMT_NOTIMESTAMPS | AVFMT_VARIABLE_FPS))))) {
+        if (ist->framerate.num)
+            ost->frame_rate = ist->framerate;
+        else if (ist->st->avg_frame_rate.num)
+            ost->frame_rate = ist->st->avg_frame_rate;
+        else {
+            av_log(NULL, AV_LOG_WARNING, "Constant framerate requested "
+                   "for the output stream #%d:%d, but no information "
+                   "about the input framerate is available. Falling "
+                   "back to a default value of 25fps. Use the -r option "
+                   "if you want a different framerate.\n",
+                   ost->file_index, ost->index);
+            ost->frame_rate = (AVRational){ 25, 1 };
+        }
+
+        if (ost->enc && ost->enc->supported_framerates && !ost->force_fps) {
+            int idx = av_find_nearest_q_idx(ost->frame_rate, ost->enc->supported_framerates);
+            ost->frame_rate = ost->enc->supported_framerates[idx];
+        }
+    }
+}
+
+/* Add the following video output streams which encode the same input stream
+ * with the same filters to the simple filtergraph of the output stream
+ * ost_index, so that the filters run once and the scaling is shared. */
+static void share_simple_filtergraph(FilterGraph *fg, int ost_index)
+{
+    OutputStream *ost = output_streams[ost_index];
+    int i;
+
+    if (!ost->st->codec->width != !ost->st->codec->height)
+        return;
+
+    for (i = ost_index + 1; i < nb_output_streams; i++) {
+        OutputStream *o    = output_streams[i];
+        AVCodecContext *enc = o->st->codec;
+
+        if (o->filter || o->stream_copy || !o->enc ||
+            o->source_index != ost->source_index ||
+            enc->codec_type != AVMEDIA_TYPE_VIDEO ||
+            o->sws_flags != ost->sws_flags ||
+            strcmp(o->avfilter, ost->avfilter) ||
+            !enc->width != !enc->height)
+            continue;
+
+        set_output_frame_rate(o, input_streams[o->source_index]);
+        add_simple_filtergraph_output(fg, o);
+    }
+}
+
 static void parse_forced_key_frames(char *kf, OutputStream *ost,
                                     AVCodecContext *avctx)
 {
@@ -1677,45 +2698,15 @@ static int transcode_init(void)
                 ist->decoding_needed = 1;
             ost->encoding_needed = 1;
 
-            /*
-             * We want CFR output if and only if one of those is true:
-             * 1) user specified output framerate with -r
-             * 2) user specified -vsync cfr
-             * 3) output format is CFR and the user didn't force vsync to
-             *    something else than CFR
-             *
-             * in such a case, set ost->frame_rate
-             */
-            if (codec->codec_type == AVMEDIA_TYPE_VIDEO &&
-                !ost->frame_rate.num && ist &&
-                (video_sync_method ==  VSYNC_CFR ||
-                 (video_sync_method ==  VSYNC_AUTO &&
-                  !(oc->oformat->flags & (AVFMT_NOTIMESTAMPS | AVFMT_VARIABLE_FPS))))) {
-                if (ist->framerate.num)
-                    ost->frame_rate = ist->framerate;
-                else if (ist->st->avg_frame_rate.num)
-                    ost->frame_rate = ist->st->avg_frame_rate;
-                else {
-                    av_log(NULL, AV_LOG_WARNING, "Constant framerate requested "
-                           "for the output stream #%d:%d, but no information "
-                           "about the input framerate is available. Falling "
-                           "back to a default value of 25fps. Use the -r option "
-                           "if you want a different framerate.\n",
-                           ost->file_index, ost->index);
-                    ost->frame_rate = (AVRational){ 25, 1 };
-                }
-
-                if (ost->enc && ost->enc->supported_framerates && !ost->force_fps) {
-                    int idx = av_find_nearest_q_idx(ost->frame_rate, ost->enc->supported_framerates);
-                    ost->frame_rate = ost->enc->supported_framerates[idx];
-                }
-            }
+            set_output_frame_rate(ost, ist);
 
             if (!ost->filter &&
                 (codec->codec_type == AVMEDIA_TYPE_VIDEO ||
                  codec->codec_type == AVMEDIA_TYPE_AUDIO)) {
                     FilterGraph *fg;
                     fg = init_simple_filtergraph(ist, ost);
+                    if (shared_scaling && codec->codec_type == AVMEDIA_TYPE_VIDEO)
+                        share_simple_filtergraph(fg, i);
                     if (configure_filtergraph(fg)) {
                         av_log(NULL, AV_LOG_FATAL, "Error opening filters!\n");
                         exit_program(1);
@@ -1812,6 +2803,15 @@ static int transcode_init(void)
                 memcpy(ost->st->codec->subtitle_header, dec->subtitle_header, dec->subtitle_header_size);
                 ost->st->codec->subtitle_header_size = dec->subtitle_header_size;
             }
+#if HAVE_PTHREADS
+            /* before the options are consumed by opening the encoder */
+            if (transcode_chunks > 1 &&
+                (ret = init_output_chunks(ost, transcode_chunks)) < 0) {
+                snprintf(error, sizeof(error), "Error while preparing the chunks "
+                         "of output stream #%d:%d", ost->file_index, ost->index);
+                goto dump_format;
+            }
+#endif
             if (!av_dict_get(ost->opts, "threads", NULL, 0))
                 av_dict_set(&ost->opts, "threads", "auto", 0);
             if ((ret = avcodec_open2(ost->st->codec, codec, &ost->opts)) < 0) {
@@ -1822,6 +2822,9 @@ static int transcode_init(void)
                 goto dump_format;
             }
             assert_avoptions(ost->opts);
+#if HAVE_PTHREADS
+            check_output_chunks(ost);
+#endif
             if (ost->st->codec->bit_rate && ost->st->codec->bit_rate < 1000)
                 av_log(NULL, AV_LOG_WARNING, "The bitrate parameter is set too low."
                                              "It takes bits/s as argument, not kbits/s\n");
@@ -2004,7 +3007,10 @@ static void *input_thread(void *arg)
 
     while (!transcoding_finished && ret >= 0) {
         AVPacket pkt;
+
+        start_timer(&f->demux_timer);
         ret = av_read_frame(f->ctx, &pkt);
+        stop_timer(&f->demux_timer);
 
         if (ret == AVERROR(EAGAIN)) {
             av_usleep(10000);
@@ -2013,17 +3019,15 @@ static void *input_thread(void *arg)
         } else if (ret < 0)
             break;
 
-        pthread_mutex_lock(&f->fifo_lock);
-        while (!av_fifo_space(f->fifo))
-            pthread_cond_wait(&f->fifo_cond, &f->fifo_lock);
-
+        /* only copies the data if the demuxer did not return a reference */
         av_dup_packet(&pkt);
-        av_fifo_generic_write(f->fifo, &pkt, sizeof(pkt), NULL);
-
-        pthread_mutex_unlock(&f->fifo_lock);
+        if ((ret = av_spsc_queue_send(f->queue, &pkt, 0)) < 0)
+            av_free_packet(&pkt);
+        else
+            f->nb_packets_sent++;
     }
 
-    f->finished = 1;
+    av_spsc_queue_set_err_recv(f->queue, AVERROR_EOF);
     return NULL;
 }
 
@@ -2040,25 +3044,16 @@ static void free_input_threads(void)
         InputFile *f = input_files[i];
         AVPacket pkt;
 
-        if (!f->fifo || f->joined)
+        if (!f->queue || f->joined)
             continue;
 
-        pthread_mutex_lock(&f->fifo_lock);
-        while (av_fifo_size(f->fifo)) {
-            av_fifo_generic_read(f->fifo, &pkt, sizeof(pkt), NULL);
-            av_free_packet(&pkt);
-        }
-        pthread_cond_signal(&f->fifo_cond);
-        pthread_mutex_unlock(&f->fifo_lock);
-
+        av_spsc_queue_set_err_send(f->queue, AVERROR_EOF);
         pthread_join(f->thread, NULL);
         f->joined = 1;
 
-        while (av_fifo_size(f->fifo)) {
-            av_fifo_generic_read(f->fifo, &pkt, sizeof(pkt), NULL);
+        while (av_spsc_queue_recv(f->queue, &pkt, AV_SPSC_QUEUE_FLAG_NONBLOCK) >= 0)
             av_free_packet(&pkt);
-        }
-        av_fifo_free(f->fifo);
+        av_spsc_queue_free(&f->queue);
     }
 }
 
@@ -2072,42 +3067,33 @@ static int init_input_threads(void)
     for (i = 0; i < nb_input_files; i++) {
         InputFile *f = input_files[i];
 
-        if (!(f->fifo = av_fifo_alloc(8*sizeof(AVPacket))))
-            return AVERROR(ENOMEM);
-
-        pthread_mutex_init(&f->fifo_lock, NULL);
-        pthread_cond_init (&f->fifo_cond, NULL);
+        if ((ret = av_spsc_queue_alloc(&f->queue, 8, sizeof(AVPacket))) < 0)
+            return ret;
+        /* Waiting for a live input would hold up the other inputs. */
+        f->non_blocking = !f->ctx->pb || !f->ctx->pb->seekable;
 
-        if ((ret = pthread_create(&f->thread, NULL, input_thread, f)))
+        if ((ret = pthread_create(&f->thread, NULL, input_thread, f))) {
+            av_spsc_queue_free(&f->queue);
             return AVERROR(ret);
+        }
     }
     return 0;
 }
 
 static int get_input_packet_mt(InputFile *f, AVPacket *pkt)
 {
-    int ret = 0;
-
-    pthread_mutex_lock(&f->fifo_lock);
-
-    if (av_fifo_size(f->fifo)) {
-        av_fifo_generic_read(f->fifo, pkt, sizeof(*pkt), NULL);
-        pthread_cond_signal(&f->fifo_cond);
-    } else {
-        if (f->finished)
-            ret = AVERROR_EOF;
-        else
-            ret = AVERROR(EAGAIN);
-    }
-
-    pthread_mutex_unlock(&f->fifo_lock);
-
+    int ret = av_spsc_queue_recv(f->queue, pkt,
+                                 f->non_blocking ? AV_SPSC_QUEUE_FLAG_NONBLOCK : 0);
+    if (ret >= 0)
+        f->nb_packets_received++;
     return ret;
 }
 #endif
 
 static int get_input_packet(InputFile *f, AVPacket *pkt)
 {
+    int ret;
+
     if (f->rate_emu) {
         int i;
         for (i = 0; i < f->nb_streams; i++) {
@@ -2123,7 +3109,10 @@ static int get_input_packet(InputFile *f, AVPacket *pkt)
     if (nb_input_files > 1)
         return get_input_packet_mt(f, pkt);
 #endif
-    return av_read_frame(f->ctx, pkt);
+    start_timer(&f->demux_timer);
+    ret = av_read_frame(f->ctx, pkt);
+    stop_timer(&f->demux_timer);
+    return ret;
 }
 
 static int got_eagain(void)
@@ -2268,7 +3257,7 @@ discard_packet:
  */
 static int transcode(void)
 {
-    int ret, i, need_input = 1;
+    int ret, i, need_input = 1, wait_chunks = 0;
     AVFormatContext *os;
     OutputStream *ost;
     InputStream *ist;
@@ -2286,6 +3275,13 @@ static int transcode(void)
 #if HAVE_PTHREADS
     if ((ret = init_input_threads()) < 0)
         goto fail;
+    if ((ret = init_encoder_threads()) < 0)
+        goto fail;
+    if ((ret = init_decoder_threads()) < 0)
+        goto fail;
+    for (i = 0; i < nb_output_streams; i++)
+        if ((ret = start_output_chunks(output_streams[i])) < 0)
+            goto fail;
 #endif
 
     while (!received_sigterm) {
@@ -2295,13 +3291,21 @@ static int transcode(void)
             break;
         }
 
+#if HAVE_PTHREADS
+        wait_chunks = chunks_behind();
+#endif
+
         /* read and process one input packet if needed */
-        if (need_input) {
+        if (need_input && !wait_chunks) {
             ret = process_input();
             if (ret == AVERROR_EOF)
                 need_input = 0;
         }
 
+#if HAVE_PTHREADS
+        filter_decoded_frames();
+#endif
+
         ret = poll_filters();
         if (ret < 0) {
             if (ret == AVERROR_EOF || ret == AVERROR(EAGAIN))
@@ -2311,6 +3315,13 @@ static int transcode(void)
             break;
         }
 
+#if HAVE_PTHREADS
+        if ((ret = write_chunk_packets(wait_chunks || !need_input)) < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Error while transcoding in chunks.\n");
+            break;
+        }
+#endif
+
         /* dump report by using the output first video and audio streams */
         print_report(0, timer_start);
     }
@@ -2325,7 +3336,14 @@ static int transcode(void)
             output_packet(ist, NULL);
         }
     }
+#if HAVE_PTHREADS
+    free_decoder_threads();
+#endif
     poll_filters();
+#if HAVE_PTHREADS
+    if (free_encoder_threads() < 0)
+        exit_program(1);
+#endif
     flush_encoders();
 
     term_exit();
@@ -2352,9 +3370,9 @@ static int transcode(void)
     for (i = 0; i < nb_input_streams; i++) {
         ist = input_streams[i];
         if (ist->decoding_needed) {
-            avcodec_close(ist->st->codec);
+            avcodec_close(ist->dec_ctx);
             if (ist->hwaccel_uninit)
-                ist->hwaccel_uninit(ist->st->codec);
+                ist->hwaccel_uninit(ist->dec_ctx);
         }
     }
 
@@ -2364,6 +3382,10 @@ static int transcode(void)
  fail:
 #if HAVE_PTHREADS
     free_input_threads();
+    free_decoder_threads();
+    free_encoder_threads();
+    for (i = 0; i < nb_output_streams; i++)
+        free_output_chunks(output_streams[i]);
 #endif
 
     if (output_streams) {
@@ -2386,24 +3408,6 @@ static int transcode(void)
     return ret;
 }
 
-static int64_t getutime(void)
-{
-#if HAVE_GETRUSAGE
-    struct rusage rusage;
-
-    getrusage(RUSAGE_SELF, &rusage);
-    return (rusage.ru_utime.tv_sec * 1000000LL) + rusage.ru_utime.tv_usec;
-#elif HAVE_GETPROCESSTIMES
-    HANDLE proc;
-    FILETIME c, e, k, u;
-    proc = GetCurrentProcess();
-    GetProcessTimes(proc, &c, &e, &k, &u);
-    return ((int64_t) u.dwHighDateTime << 32 | u.dwLowDateTime) / 10;
-#else
-    return av_gettime();
-#endif
-}
-
 static int64_t getmaxrss(void)
 {
 #if HAVE_GETRUSAGE && HAVE_STRUCT_RUSAGE_RU_MAXRSS
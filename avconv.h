@@ -40,6 +40,7 @@
 #include "libavutil/avutil.h"
 #include "libavutil/dict.h"
 #include "libavutil/fifo.h"
+#include "libavutil/spsc_queue.h"
 #include "libavutil/pixfmt.h"
 #include "libavutil/rational.h"
 
@@ -183,6 +184,15 @@ typedef struct OptionsContext {
     int        nb_passlogfiles;
 } OptionsContext;
 
+/* cumulative time spent in one processing stage, with -benchmark_all */
+typedef struct StageTimer {
+    int64_t wall;           /* wall clock time, in microseconds */
+    int64_t cpu;            /* CPU time of the calling thread, in microseconds */
+    int64_t calls;
+    int64_t wall_start;
+    int64_t cpu_start;
+} StageTimer;
+
 typedef struct InputFilter {
     AVFilterContext    *filter;
     struct InputStream *ist;
@@ -218,6 +228,9 @@ typedef struct InputStream {
     int discard;             /* true if stream data should be discarded */
     int decoding_needed;     /* true if the packets must be decoded in 'raw_fifo' */
     AVCodec *dec;
+    /* the decoder context, a copy of st->codec when the stream is decoded in
+     * its own thread, since the demuxer keeps updating st->codec */
+    AVCodecContext *dec_ctx;
     AVFrame *decoded_frame;
     AVFrame *filter_frame; /* a ref of decoded_frame, to be sent to filters */
 
@@ -237,6 +250,7 @@ typedef struct InputStream {
     int resample_height;
     int resample_width;
     int resample_pix_fmt;
+    AVRational resample_sample_aspect_ratio;
 
     int      resample_sample_fmt;
     int      resample_sample_rate;
@@ -260,6 +274,22 @@ typedef struct InputStream {
     int  (*hwaccel_retrieve_data)(AVCodecContext *s, AVFrame *frame);
     enum AVPixelFormat hwaccel_pix_fmt;
     enum AVPixelFormat hwaccel_retrieved_pix_fmt;
+
+    StageTimer decode_timer;
+    StageTimer filter_timer;     /* sending decoded frames to the filters */
+
+#if HAVE_PTHREADS
+    pthread_t thread;            /* thread decoding this stream with -parallel_decoding */
+    int thread_started;
+    pthread_mutex_t queue_lock;  /* lock for access to the queues below */
+    pthread_cond_t  queue_cond;  /* signalled when a queue is read or written */
+    AVFifoBuffer *packet_queue;  /* packets waiting to be decoded, an empty one flushes */
+    AVFifoBuffer *frame_queue;   /* decoded frames waiting to be sent to the filters */
+    int queue_finished;          /* the decoding thread should exit */
+    int decode_error;            /* last error from the decoding thread */
+    int64_t nb_frames_queued;    /* frames queued by the decoding thread */
+    int64_t nb_frames_filtered;  /* queued frames sent to the filters */
+#endif
 } InputStream;
 
 typedef struct InputFile {
@@ -275,13 +305,17 @@ typedef struct InputFile {
     int rate_emu;
     int accurate_seek;
 
+    StageTimer demux_timer;
+
+    AVDictionary *format_opts;  /* demuxer options, to open the file again with -chunks */
+
 #if HAVE_PTHREADS
     pthread_t thread;           /* thread reading from this file */
-    int finished;               /* the thread has exited */
     int joined;                 /* the thread has been joined */
-    pthread_mutex_t fifo_lock;  /* lock for access to fifo */
-    pthread_cond_t  fifo_cond;  /* the main thread will signal on this cond after reading from fifo */
-    AVFifoBuffer *fifo;         /* demuxed packets are stored here; freed by the main thread */
+    int non_blocking;           /* do not wait for packets, the input may stall */
+    AVSPSCQueue *queue;         /* demuxed packets are sent here; freed by the main thread */
+    int64_t nb_packets_sent;     /* packets sent to the queue by the thread */
+    int64_t nb_packets_received; /* packets received from the queue */
 #endif
 } InputFile;
 
@@ -337,6 +371,27 @@ typedef struct OutputStream {
     enum AVPixelFormat pix_fmts[2];
 
     AVCodecParserContext *parser;
+
+    StageTimer filter_timer;     /* getting filtered frames from the buffersink */
+    StageTimer encode_timer;
+    StageTimer mux_timer;
+
+#if HAVE_PTHREADS
+    pthread_t thread;            /* thread encoding this stream with -parallel_encoding */
+    int thread_started;
+    pthread_mutex_t queue_lock;  /* lock for access to frame_queue */
+    pthread_cond_t  queue_cond;  /* signalled when a frame is queued or dequeued */
+    AVFifoBuffer *frame_queue;   /* filtered frames (AVFrame*) waiting to be encoded */
+    int queue_finished;          /* no more frames will be queued */
+    int64_t queued_pts;          /* end of the last queued frame, in the encoder time base */
+    int encode_error;            /* error which stopped the encoder thread */
+
+    struct OutputChunk **chunks; /* time ranges transcoded by separate threads with -chunks */
+    int nb_chunks;
+    int cur_chunk;               /* index of the chunk being muxed */
+    int nb_shifted_chunks;       /* chunks whose first packet was muxed */
+    int64_t chunk_dts_shift;     /* added to the dts of the chunk being muxed */
+#endif
 } OutputStream;
 
 typedef struct OutputFile {
@@ -364,6 +419,7 @@ extern FilterGraph **filtergraphs;
 extern int        nb_filtergraphs;
 
 extern char *vstats_filename;
+extern char *progress_url;
 
 extern float audio_drift_threshold;
 extern float dts_delta_threshold;
@@ -372,6 +428,7 @@ extern int audio_volume;
 extern int audio_sync_method;
 extern int video_sync_method;
 extern int do_benchmark;
+extern int do_benchmark_all;
 extern int do_deinterlace;
 extern int do_hex_dump;
 extern int do_pkt_dump;
@@ -380,6 +437,10 @@ extern int copy_tb;
 extern int exit_on_error;
 extern int print_stats;
 extern int qp_hist;
+extern int parallel_encoding;
+extern int parallel_decoding;
+extern int shared_scaling;
+extern int transcode_chunks;
 
 extern const AVIOInterruptCB int_cb;
 
@@ -400,9 +461,18 @@ int configure_filtergraph(FilterGraph *fg);
 int configure_output_filter(FilterGraph *fg, OutputFilter *ofilter, AVFilterInOut *out);
 int ist_in_filtergraph(FilterGraph *fg, InputStream *ist);
 FilterGraph *init_simple_filtergraph(InputStream *ist, OutputStream *ost);
+void add_simple_filtergraph_output(FilterGraph *fg, OutputStream *ost);
 
 int avconv_parse_options(int argc, char **argv);
 
 int vdpau_init(AVCodecContext *s);
 
+#if HAVE_PTHREADS
+int init_output_chunks(OutputStream *ost, int nb_chunks);
+void check_output_chunks(OutputStream *ost);
+int start_output_chunks(OutputStream *ost);
+int get_chunk_packet(OutputStream *ost, AVPacket *pkt, int wait);
+void free_output_chunks(OutputStream *ost);
+#endif
+
 #endif /* AVCONV_H */
@@ -0,0 +1,746 @@
+/*
+ * avconv chunked transcoding
+ *
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * With -chunks, a video output stream is transcoded in time ranges by one
+ * thread each. The ranges start at keyframes of the input stream, and each
+ * thread opens the input file again, seeks to its range and runs a decoder,
+ * a copy of the filters and an encoder of its own. The encoded packets are
+ * spooled to a temporary file and read back by the main thread, which muxes
+ * the ranges one after the other. Only the video is split, the other streams
+ * are transcoded by the main thread as usual.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "avconv.h"
+
+#include "libavfilter/avfilter.h"
+#include "libavfilter/buffersrc.h"
+#include "libavfilter/buffersink.h"
+
+#include "libavutil/cpu.h"
+#include "libavutil/dict.h"
+#include "libavutil/frame.h"
+#include "libavutil/mathematics.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+
+typedef struct OutputChunk {
+    OutputStream *ost;
+    InputStream  *ist;
+    int index;
+
+    /* range of the decoded frames, as timestamps of the input stream
+     * before the offset of the input file is applied */
+    int64_t start;
+    int64_t end;
+
+    AVFormatContext *ic;
+    AVCodecContext  *dec;
+    AVCodecContext  *enc;
+    AVFrame         *frame;
+    PtsCorrectionContext pts_ctx;
+
+    /* a simple filtergraph like the one of ost, but fed by this chunk */
+    FilterGraph   fg;
+    InputFilter   ifilter;
+    InputFilter  *ifilters[1];
+    OutputFilter  ofilter;
+    OutputFilter *ofilters[1];
+
+    int64_t sync_opts;
+    int frame_number;
+    int forced_kf_index;
+    int nb_decoded;         /* number of decoded frames in the range */
+
+    pthread_t thread;
+    int thread_started;
+    pthread_mutex_t lock;   /* lock for the fields below */
+    pthread_cond_t  cond;   /* signalled when a packet is spooled or finished is set */
+    FILE *spool;            /* encoded packets waiting to be muxed */
+    int64_t spool_size;     /* size of the complete packets in the spool */
+    int64_t spool_pos;      /* position of the next packet to be read */
+    int finished;           /* no more packets will be spooled */
+    int abort;              /* the thread should exit as soon as possible */
+    int ret;                /* error which stopped the thread */
+} OutputChunk;
+
+/* a packet in the spool, followed by its data */
+typedef struct SpoolHeader {
+    int64_t pts;
+    int64_t dts;
+    int duration;
+    int flags;
+    int size;
+} SpoolHeader;
+
+/*
+ * Return NULL if the output stream can be transcoded in chunks, the reason
+ * otherwise.
+ */
+static const char *chunks_unsupported(OutputStream *ost, InputStream *ist)
+{
+    InputFile       *f = input_files[ist->file_index];
+    OutputFile     *of = output_files[ost->file_index];
+    AVCodecContext *enc = ost->st->codec;
+    int i;
+
+    if (f->ctx->iformat->flags & AVFMT_TS_DISCONT)
+        return "the input format may have timestamp discontinuities";
+    if (!f->ctx->pb || !f->ctx->pb->seekable || f->ctx->duration == AV_NOPTS_VALUE)
+        return "the input is not seekable or its duration is unknown";
+    if (f->start_time != AV_NOPTS_VALUE || f->recording_time != INT64_MAX ||
+        of->start_time != AV_NOPTS_VALUE || of->recording_time != INT64_MAX ||
+        ost->max_frames != INT64_MAX)
+        return "the start time or the duration is limited";
+    if (f->rate_emu || ist->framerate.num || ist->hwaccel_id != HWACCEL_NONE)
+        return "-re, input -r and -hwaccel are not supported";
+    if (ost->filter->graph->graph_desc || ist->nb_filters > 1)
+        return "the input stream is filtered by a complex filtergraph or "
+               "for other outputs";
+    if (enc->flags & (CODEC_FLAG_PASS1 | CODEC_FLAG_PASS2) || vstats_filename)
+        return "two pass encoding and -vstats are not supported";
+    if (of->ctx->oformat->flags & AVFMT_RAWPICTURE &&
+        enc->codec_id == AV_CODEC_ID_RAWVIDEO)
+        return "raw pictures are not supported";
+
+    for (i = 0; i < nb_output_streams; i++) {
+        OutputStream *o = output_streams[i];
+        if (o != ost && o->encoding_needed &&
+            o->source_index == ost->source_index)
+            return "the input stream is encoded for other outputs";
+    }
+    return NULL;
+}
+
+static int open_chunk_input(InputStream *ist, AVFormatContext **pic)
+{
+    InputFile      *f = input_files[ist->file_index];
+    AVFormatContext *ic = NULL;
+    AVDictionary *opts = NULL;
+    int i, ret;
+
+    av_dict_copy(&opts, f->format_opts, 0);
+    ret = avformat_open_input(&ic, f->ctx->filename, f->ctx->iformat, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        return ret;
+
+    /* the same demuxer is expected to find the same streams */
+    if (ic->nb_streams <= ist->st->index ||
+        ic->streams[ist->st->index]->codec->codec_id != ist->st->codec->codec_id) {
+        avformat_close_input(&ic);
+        return AVERROR(EINVAL);
+    }
+    for (i = 0; i < ic->nb_streams; i++)
+        if (i != ist->st->index)
+            ic->streams[i]->discard = AVDISCARD_ALL;
+
+    *pic = ic;
+    return 0;
+}
+
+/*
+ * Split the input stream in nb_chunks ranges of about the same duration,
+ * starting at the keyframes found by seeking backwards from the evenly
+ * spaced times.
+ */
+static int find_chunk_starts(InputStream *ist, int64_t *starts, int nb_chunks)
+{
+    AVFormatContext *f = input_files[ist->file_index]->ctx;
+    AVFormatContext *ic;
+    AVPacket pkt;
+    int64_t start_time = f->start_time == AV_NOPTS_VALUE ? 0 : f->start_time;
+    int i, ret;
+
+    if ((ret = open_chunk_input(ist, &ic)) < 0)
+        return ret;
+
+    starts[0] = INT64_MIN;
+    for (i = 1; i < nb_chunks; i++) {
+        int64_t t = start_time + av_rescale(f->duration, i, nb_chunks);
+
+        starts[i] = INT64_MAX;
+        ret = av_seek_frame(ic, ist->st->index,
+                            av_rescale_q(t, AV_TIME_BASE_Q, ist->st->time_base),
+                            AVSEEK_FLAG_BACKWARD);
+        while (ret >= 0 && (ret = av_read_frame(ic, &pkt)) >= 0) {
+            int64_t ts = pkt.pts != AV_NOPTS_VALUE ? pkt.pts : pkt.dts;
+            int key    = pkt.stream_index == ist->st->index &&
+                         pkt.flags & AV_PKT_FLAG_KEY && ts != AV_NOPTS_VALUE;
+
+            av_free_packet(&pkt);
+            if (key) {
+                starts[i] = ts;
+                break;
+            }
+        }
+        /* a range may be empty, but never overlap the previous one */
+        starts[i] = FFMAX(starts[i], starts[i - 1]);
+    }
+
+    avformat_close_input(&ic);
+    return 0;
+}
+
+/*
+ * Set the number of threads of a chunk codec, unless the user did, so that
+ * all the chunks together use about one thread per core.
+ */
+static void set_chunk_threads(AVDictionary **opts, int nb_chunks)
+{
+    char threads[16];
+
+    if (!av_dict_get(*opts, "threads", NULL, 0)) {
+        snprintf(threads, sizeof(threads), "%d",
+                 FFMAX(av_cpu_count() / nb_chunks, 1));
+        av_dict_set(opts, "threads", threads, 0);
+    }
+}
+
+static int init_chunk(OutputChunk *c, int nb_chunks)
+{
+    OutputStream *ost = c->ost;
+    InputStream  *ist = c->ist;
+    AVDictionary *opts = NULL;
+    int ret;
+
+    if ((ret = open_chunk_input(ist, &c->ic)) < 0)
+        return ret;
+
+    if (!(c->frame = av_frame_alloc()))
+        return AVERROR(ENOMEM);
+    if (!(c->spool = tmpfile())) {
+        av_log(NULL, AV_LOG_ERROR, "Could not create a temporary file for "
+               "the chunks of output stream #%d:%d\n",
+               ost->file_index, ost->index);
+        return AVERROR(errno);
+    }
+    init_pts_correction(&c->pts_ctx);
+    c->sync_opts = 0;
+
+    /* the decoder */
+    if (!(c->dec = avcodec_alloc_context3(NULL)))
+        return AVERROR(ENOMEM);
+    if ((ret = avcodec_copy_context(c->dec, ist->st->codec)) < 0)
+        return ret;
+    av_opt_set_int(c->dec, "refcounted_frames", 1, 0);
+    av_dict_copy(&opts, ist->opts, 0);
+    set_chunk_threads(&opts, nb_chunks);
+    ret = avcodec_open2(c->dec, ist->dec, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        return ret;
+
+    /* the encoder, with the parameters of the output stream, which is not
+     * open yet */
+    if (!(c->enc = avcodec_alloc_context3(NULL)))
+        return AVERROR(ENOMEM);
+    if ((ret = avcodec_copy_context(c->enc, ost->st->codec)) < 0)
+        return ret;
+    av_dict_copy(&opts, ost->opts, 0);
+    set_chunk_threads(&opts, nb_chunks);
+    ret = avcodec_open2(c->enc, ost->enc, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        return ret;
+
+    /* the filters */
+    c->fg.index      = ost->filter->graph->index;
+    c->ifilter.ist   = ist;
+    c->ifilter.graph = &c->fg;
+    c->ifilters[0]   = &c->ifilter;
+    c->fg.inputs     = c->ifilters;
+    c->fg.nb_inputs  = 1;
+    c->ofilter.ost   = ost;
+    c->ofilter.graph = &c->fg;
+    c->ofilters[0]   = &c->ofilter;
+    c->fg.outputs    = c->ofilters;
+    c->fg.nb_outputs = 1;
+    if ((ret = configure_filtergraph(&c->fg)) < 0)
+        return ret;
+
+    return 0;
+}
+
+static void free_chunk_codec(AVCodecContext **pavctx)
+{
+    AVCodecContext *avctx = *pavctx;
+
+    if (!avctx)
+        return;
+    avcodec_close(avctx);
+    av_freep(&avctx->extradata);
+    av_freep(&avctx->intra_matrix);
+    av_freep(&avctx->inter_matrix);
+    av_freep(&avctx->rc_override);
+    av_freep(pavctx);
+}
+
+static void free_chunk(OutputChunk **pc)
+{
+    OutputChunk *c = *pc;
+
+    if (!c)
+        return;
+
+    if (c->thread_started) {
+        pthread_mutex_lock(&c->lock);
+        c->abort = 1;
+        pthread_mutex_unlock(&c->lock);
+        pthread_join(c->thread, NULL);
+    }
+    pthread_cond_destroy(&c->cond);
+    pthread_mutex_destroy(&c->lock);
+    if (c->spool)
+        fclose(c->spool);
+
+    avfilter_graph_free(&c->fg.graph);
+    free_chunk_codec(&c->enc);
+    free_chunk_codec(&c->dec);
+    av_frame_free(&c->frame);
+    avformat_close_input(&c->ic);
+    av_freep(pc);
+}
+
+static int chunk_aborted(OutputChunk *c)
+{
+    int abort;
+
+    pthread_mutex_lock(&c->lock);
+    abort = c->abort;
+    pthread_mutex_unlock(&c->lock);
+    return abort;
+}
+
+static int spool_packet(OutputChunk *c, const AVPacket *pkt)
+{
+    SpoolHeader h = { pkt->pts, pkt->dts, pkt->duration, pkt->flags, pkt->size };
+    int ret = 0;
+
+    pthread_mutex_lock(&c->lock);
+    if (fseek(c->spool, c->spool_size, SEEK_SET) < 0 ||
+        fwrite(&h, sizeof(h), 1, c->spool) != 1 ||
+        (pkt->size && fwrite(pkt->data, pkt->size, 1, c->spool) != 1)) {
+        ret = AVERROR(EIO);
+    } else {
+        c->spool_size += sizeof(h) + pkt->size;
+        pthread_cond_signal(&c->cond);
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    return ret;
+}
+
+/*
+ * Encode a filtered frame, or flush the encoder if frame is NULL, like
+ * do_video_out() and flush_encoders() do for the whole stream.
+ */
+static int encode_chunk_frame(OutputChunk *c, AVFrame *frame)
+{
+    OutputStream   *ost = c->ost;
+    AVFormatContext *s  = output_files[ost->file_index]->ctx;
+    AVCodecContext *enc = c->enc;
+    AVPacket pkt;
+    int got_packet, ret;
+
+    if (frame) {
+        int format_video_sync = video_sync_method;
+
+        if (format_video_sync == VSYNC_AUTO)
+            format_video_sync = (s->oformat->flags & AVFMT_NOTIMESTAMPS) ? VSYNC_PASSTHROUGH :
+                                (s->oformat->flags & AVFMT_VARIABLE_FPS) ? VSYNC_VFR : VSYNC_CFR;
+        if (format_video_sync != VSYNC_PASSTHROUGH &&
+            c->frame_number &&
+            frame->pts != AV_NOPTS_VALUE &&
+            frame->pts < c->sync_opts)
+            return 0;
+
+        if (frame->pts == AV_NOPTS_VALUE)
+            frame->pts = c->sync_opts;
+        c->sync_opts = frame->pts;
+
+        if (!ost->frame_aspect_ratio)
+            enc->sample_aspect_ratio = frame->sample_aspect_ratio;
+        if (enc->flags & (CODEC_FLAG_INTERLACED_DCT|CODEC_FLAG_INTERLACED_ME) &&
+            ost->top_field_first >= 0)
+            frame->top_field_first = !!ost->top_field_first;
+
+        frame->quality = enc->global_quality;
+        if (!enc->me_threshold)
+            frame->pict_type = 0;
+        /* the chunk may start after several forced keyframes */
+        while (c->forced_kf_index < ost->forced_kf_count &&
+               frame->pts >= ost->forced_kf_pts[c->forced_kf_index]) {
+            frame->pict_type = AV_PICTURE_TYPE_I;
+            c->forced_kf_index++;
+        }
+    }
+
+    do {
+        av_init_packet(&pkt);
+        pkt.data = NULL;
+        pkt.size = 0;
+
+        ret = avcodec_encode_video2(enc, &pkt, frame, &got_packet);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Video encoding failed in chunk %d "
+                   "of output stream #%d:%d\n", c->index,
+                   ost->file_index, ost->index);
+            return ret;
+        }
+        if (!got_packet)
+            break;
+
+        if (pkt.pts != AV_NOPTS_VALUE)
+            pkt.pts = av_rescale_q(pkt.pts, enc->time_base, ost->st->time_base);
+        if (pkt.dts != AV_NOPTS_VALUE)
+            pkt.dts = av_rescale_q(pkt.dts, enc->time_base, ost->st->time_base);
+        if (pkt.duration > 0)
+            pkt.duration = av_rescale_q(pkt.duration, enc->time_base, ost->st->time_base);
+        ret = spool_packet(c, &pkt);
+        av_free_packet(&pkt);
+        if (ret < 0)
+            return ret;
+    } while (!frame);
+
+    if (frame) {
+        c->sync_opts++;
+        c->frame_number++;
+    }
+    return 0;
+}
+
+/*
+ * Encode the frames available from the filters. At the end of the chunk,
+ * flush the filters and the encoder.
+ */
+static int filter_chunk_frames(OutputChunk *c, int flush)
+{
+    AVFilterContext *sink = c->ofilter.filter;
+    AVFrame *frame = c->frame;
+    int ret;
+
+    if (flush && (ret = av_buffersrc_add_frame(c->ifilter.filter, NULL)) < 0)
+        return ret;
+
+    while ((ret = av_buffersink_get_frame(sink, frame)) >= 0) {
+        if (frame->pts != AV_NOPTS_VALUE)
+            frame->pts = av_rescale_q(frame->pts, sink->inputs[0]->time_base,
+                                      c->enc->time_base);
+        ret = encode_chunk_frame(c, frame);
+        av_frame_unref(frame);
+        if (ret < 0)
+            return ret;
+    }
+    if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+        return ret;
+
+    return flush ? encode_chunk_frame(c, NULL) : 0;
+}
+
+/*
+ * Decode a packet, or flush the decoder if pkt is empty, and send the frames
+ * of the range of the chunk to the filters. Set *done once a frame after the
+ * range is decoded.
+ */
+static int decode_chunk_packet(OutputChunk *c, AVPacket *pkt, int *done)
+{
+    InputStream *ist = c->ist;
+    InputFile     *f = input_files[ist->file_index];
+    AVFrame *frame   = c->frame;
+    int64_t offset   = av_rescale_q(f->ts_offset, AV_TIME_BASE_Q, ist->st->time_base);
+    int got_frame, ret, flush = !pkt->size;
+
+    do {
+        ret = avcodec_decode_video2(c->dec, frame, &got_frame, pkt);
+        if (ret < 0) {
+            av_log(NULL, exit_on_error ? AV_LOG_ERROR : AV_LOG_WARNING,
+                   "Error while decoding chunk %d of output stream #%d:%d\n",
+                   c->index, c->ost->file_index, c->ost->index);
+            return exit_on_error ? ret : 0;
+        }
+        pkt->data += ret;
+        pkt->size -= ret;
+        if (!got_frame)
+            continue;
+
+        frame->pts = guess_correct_pts(&c->pts_ctx, frame->pkt_pts,
+                                       frame->pkt_dts);
+        if (frame->pts != AV_NOPTS_VALUE) {
+            /* frames are output in presentation order */
+            if (frame->pts >= c->end) {
+                av_frame_unref(frame);
+                *done = 1;
+                return 0;
+            }
+            if (frame->pts < c->start) {
+                av_frame_unref(frame);
+                continue;
+            }
+            /* as process_input() does for the packets */
+            frame->pts = (frame->pts + offset) * ist->ts_scale;
+        }
+        c->nb_decoded++;
+        if (ist->st->sample_aspect_ratio.num)
+            frame->sample_aspect_ratio = ist->st->sample_aspect_ratio;
+
+        ret = av_buffersrc_add_frame(c->ifilter.filter, frame);
+        av_frame_unref(frame);
+        if (ret < 0)
+            return ret;
+        if ((ret = filter_chunk_frames(c, 0)) < 0)
+            return ret;
+    } while (pkt->size > 0 || (flush && got_frame));
+
+    return 0;
+}
+
+static int transcode_chunk(OutputChunk *c)
+{
+    InputStream *ist = c->ist;
+    AVPacket pkt;
+    int done = 0, ret;
+
+    if (c->start != INT64_MIN &&
+        (ret = av_seek_frame(c->ic, ist->st->index, c->start,
+                             AVSEEK_FLAG_BACKWARD)) < 0)
+        return ret;
+
+    while (!done) {
+        if (chunk_aborted(c))
+            return AVERROR_EXIT;
+        if ((ret = av_read_frame(c->ic, &pkt)) < 0)
+            break;
+        if (pkt.stream_index == ist->st->index) {
+            AVPacket avpkt = pkt;
+            ret = decode_chunk_packet(c, &avpkt, &done);
+        }
+        av_free_packet(&pkt);
+        if (ret < 0)
+            return ret;
+    }
+
+    if (!done) {
+        av_init_packet(&pkt);
+        pkt.data = NULL;
+        pkt.size = 0;
+        if ((ret = decode_chunk_packet(c, &pkt, &done)) < 0)
+            return ret;
+    }
+    /* e.g. the decoder needs headers which are only at the start of the
+     * stream, the range would be silently missing from the output */
+    if (!c->nb_decoded && c->start != INT64_MIN && c->start < c->end) {
+        av_log(NULL, AV_LOG_ERROR, "No frame could be decoded in chunk %d of "
+               "output stream #%d:%d, try again without -chunks\n",
+               c->index, c->ost->file_index, c->ost->index);
+        return AVERROR_INVALIDDATA;
+    }
+    return filter_chunk_frames(c, 1);
+}
+
+static void *chunk_thread(void *arg)
+{
+    OutputChunk *c = arg;
+    int ret = transcode_chunk(c);
+
+    if (ret < 0 && ret != AVERROR_EXIT)
+        av_log(NULL, AV_LOG_ERROR, "Error while transcoding chunk %d of "
+               "output stream #%d:%d\n", c->index,
+               c->ost->file_index, c->ost->index);
+
+    pthread_mutex_lock(&c->lock);
+    c->ret      = ret;
+    c->finished = 1;
+    pthread_cond_signal(&c->cond);
+    pthread_mutex_unlock(&c->lock);
+
+    return NULL;
+}
+
+int init_output_chunks(OutputStream *ost, int nb_chunks)
+{
+    InputStream *ist = ost->source_index >= 0 ? input_streams[ost->source_index] : NULL;
+    const char *reason;
+    int64_t *starts;
+    int i, ret;
+
+    if (!ist || ost->st->codec->codec_type != AVMEDIA_TYPE_VIDEO)
+        return 0;
+    if ((reason = chunks_unsupported(ost, ist))) {
+        av_log(NULL, AV_LOG_WARNING, "Output stream #%d:%d is not transcoded "
+               "in chunks: %s.\n", ost->file_index, ost->index, reason);
+        return 0;
+    }
+
+    if (!(starts = av_malloc(sizeof(*starts) * nb_chunks)))
+        return AVERROR(ENOMEM);
+    if ((ret = find_chunk_starts(ist, starts, nb_chunks)) < 0) {
+        av_log(NULL, AV_LOG_WARNING, "Output stream #%d:%d is not transcoded "
+               "in chunks: the input file could not be opened again.\n",
+               ost->file_index, ost->index);
+        av_free(starts);
+        return 0;
+    }
+
+    if (!(ost->chunks = av_mallocz(sizeof(*ost->chunks) * nb_chunks))) {
+        av_free(starts);
+        return AVERROR(ENOMEM);
+    }
+    ost->nb_chunks = nb_chunks;
+    for (i = 0; i < nb_chunks; i++) {
+        OutputChunk *c = av_mallocz(sizeof(*c));
+
+        if (!(ost->chunks[i] = c)) {
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        pthread_mutex_init(&c->lock, NULL);
+        pthread_cond_init(&c->cond, NULL);
+        c->ost   = ost;
+        c->ist   = ist;
+        c->index = i;
+        c->start = starts[i];
+        c->end   = i + 1 < nb_chunks ? starts[i + 1] : INT64_MAX;
+        if ((ret = init_chunk(c, nb_chunks)) < 0)
+            break;
+        av_log(NULL, AV_LOG_VERBOSE, "Chunk %d of output stream #%d:%d "
+               "starts at %"PRId64"\n", i, ost->file_index, ost->index,
+               c->start == INT64_MIN ? ist->st->start_time : c->start);
+    }
+    av_free(starts);
+    return ret;
+}
+
+/*
+ * Called once the encoder of the output stream is open. Fall back to
+ * transcoding the stream in one piece if a chunk encoder would need other
+ * global headers.
+ */
+void check_output_chunks(OutputStream *ost)
+{
+    AVCodecContext *enc = ost->st->codec;
+    InputStream    *ist;
+    int i;
+
+    if (!ost->nb_chunks)
+        return;
+
+    /* the chunks are muxed as one stream, with the global headers of the
+     * encoder of the output stream */
+    for (i = 0; i < ost->nb_chunks; i++) {
+        AVCodecContext *c = ost->chunks[i]->enc;
+
+        if (c->extradata_size != enc->extradata_size ||
+            (enc->extradata_size &&
+             memcmp(c->extradata, enc->extradata, enc->extradata_size))) {
+            av_log(NULL, AV_LOG_WARNING, "Output stream #%d:%d is not "
+                   "transcoded in chunks: the encoders of the chunks have "
+                   "different global headers.\n", ost->file_index, ost->index);
+            free_output_chunks(ost);
+            return;
+        }
+    }
+
+    /* the main thread does not need to read nor decode the input stream,
+     * unless it is also copied */
+    ist = input_streams[ost->source_index];
+    ist->decoding_needed = 0;
+    for (i = 0; i < nb_output_streams; i++)
+        if (output_streams[i]->stream_copy &&
+            output_streams[i]->source_index == ost->source_index)
+            break;
+    if (i == nb_output_streams) {
+        ist->discard     = 1;
+        ist->st->discard = AVDISCARD_ALL;
+    }
+}
+
+int start_output_chunks(OutputStream *ost)
+{
+    int i, ret;
+
+    for (i = 0; i < ost->nb_chunks; i++) {
+        OutputChunk *c = ost->chunks[i];
+
+        if ((ret = pthread_create(&c->thread, NULL, chunk_thread, c)))
+            return AVERROR(ret);
+        c->thread_started = 1;
+    }
+    return 0;
+}
+
+int get_chunk_packet(OutputStream *ost, AVPacket *pkt, int wait)
+{
+    while (ost->cur_chunk < ost->nb_chunks) {
+        OutputChunk *c = ost->chunks[ost->cur_chunk];
+        int finished, ret;
+
+        pthread_mutex_lock(&c->lock);
+        while (wait && c->spool_pos == c->spool_size && !c->finished)
+            pthread_cond_wait(&c->cond, &c->lock);
+        if (c->spool_pos < c->spool_size) {
+            SpoolHeader h;
+
+            ret = AVERROR(EIO);
+            if (!fseek(c->spool, c->spool_pos, SEEK_SET) &&
+                fread(&h, sizeof(h), 1, c->spool) == 1 &&
+                (ret = av_new_packet(pkt, h.size)) >= 0) {
+                if (h.size && fread(pkt->data, h.size, 1, c->spool) != 1) {
+                    av_free_packet(pkt);
+                    ret = AVERROR(EIO);
+                } else {
+                    pkt->pts      = h.pts;
+                    pkt->dts      = h.dts;
+                    pkt->duration = h.duration;
+                    pkt->flags    = h.flags;
+                    c->spool_pos += sizeof(h) + h.size;
+                }
+            }
+            pthread_mutex_unlock(&c->lock);
+            return ret;
+        }
+        finished = c->finished;
+        ret      = c->ret;
+        pthread_mutex_unlock(&c->lock);
+
+        if (!finished)
+            return AVERROR(EAGAIN);
+        if (ret < 0)
+            return ret;
+
+        /* release the decoder, encoder and temporary file early */
+        free_chunk(&ost->chunks[ost->cur_chunk++]);
+    }
+    return AVERROR_EOF;
+}
+
+void free_output_chunks(OutputStream *ost)
+{
+    int i;
+
+    for (i = 0; i < ost->nb_chunks; i++)
+        free_chunk(&ost->chunks[i]);
+    av_freep(&ost->chunks);
+    ost->nb_chunks = 0;
+}
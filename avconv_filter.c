@@ -105,6 +105,19 @@ FilterGraph *init_simple_filtergraph(InputStream *ist, OutputStream *ost)
     return fg;
 }
 
+void add_simple_filtergraph_output(FilterGraph *fg, OutputStream *ost)
+{
+    OutputFilter *ofilter;
+
+    GROW_ARRAY(fg->outputs, fg->nb_outputs);
+    if (!(ofilter = fg->outputs[fg->nb_outputs - 1] = av_mallocz(sizeof(*ofilter))))
+        exit(1);
+    ofilter->ost   = ost;
+    ofilter->graph = fg;
+
+    ost->filter = ofilter;
+}
+
 static void init_input_filter(FilterGraph *fg, AVFilterInOut *in)
 {
     InputStream *ist = NULL;
@@ -244,7 +257,8 @@ static int configure_output_video_filter(FilterGraph *fg, OutputFilter *ofilter,
     if (ret < 0)
         return ret;
 
-    if (codec->width || codec->height) {
+    /* with -shared_scaling, the output is already scaled by the ladder */
+    if ((codec->width || codec->height) && (fg->graph_desc || fg->nb_outputs == 1)) {
         char args[255];
         AVFilterContext *filter;
 
@@ -427,16 +441,27 @@ static int configure_input_video_filter(FilterGraph *fg, InputFilter *ifilter,
     InputFile     *f = input_files[ist->file_index];
     AVRational tb = ist->framerate.num ? av_inv_q(ist->framerate) :
                                          ist->st->time_base;
-    AVRational sar;
+    AVCodecContext *dec = ist->dec_ctx;
+    AVRational sar = dec->sample_aspect_ratio;
+    int width = dec->width, height = dec->height;
+    int pix_fmt = ist->hwaccel_retrieve_data ? ist->hwaccel_retrieved_pix_fmt : dec->pix_fmt;
     char args[255], name[255];
     int ret, pad_idx = 0;
 
-    sar = ist->st->sample_aspect_ratio.num ?
-          ist->st->sample_aspect_ratio :
-          ist->st->codec->sample_aspect_ratio;
-    snprintf(args, sizeof(args), "%d:%d:%d:%d:%d:%d:%d", ist->st->codec->width,
-             ist->st->codec->height,
-             ist->hwaccel_retrieve_data ? ist->hwaccel_retrieved_pix_fmt : ist->st->codec->pix_fmt,
+#if HAVE_PTHREADS
+    /* The decoder context belongs to the decoding thread, the resample_*
+     * fields hold the properties of the last frame sent to the filters. */
+    if (ist->thread_started) {
+        width   = ist->resample_width;
+        height  = ist->resample_height;
+        pix_fmt = ist->resample_pix_fmt;
+        sar     = ist->resample_sample_aspect_ratio;
+    }
+#endif
+
+    if (ist->st->sample_aspect_ratio.num)
+        sar = ist->st->sample_aspect_ratio;
+    snprintf(args, sizeof(args), "%d:%d:%d:%d:%d:%d:%d", width, height, pix_fmt,
              tb.num, tb.den, sar.num, sar.den);
     snprintf(name, sizeof(name), "graph %d input from stream %d:%d", fg->index,
              ist->file_index, ist->st->index);
@@ -482,15 +507,25 @@ static int configure_input_audio_filter(FilterGraph *fg, InputFilter *ifilter,
     const AVFilter *abuffer_filt = avfilter_get_by_name("abuffer");
     InputStream *ist = ifilter->ist;
     InputFile     *f = input_files[ist->file_index];
+    AVCodecContext *dec = ist->dec_ctx;
+    int sample_rate = dec->sample_rate, sample_fmt = dec->sample_fmt;
+    uint64_t channel_layout = dec->channel_layout;
     char args[255], name[255];
     int ret, pad_idx = 0;
 
+#if HAVE_PTHREADS
+    /* The decoder context belongs to the decoding thread. */
+    if (ist->thread_started) {
+        sample_rate    = ist->resample_sample_rate;
+        sample_fmt     = ist->resample_sample_fmt;
+        channel_layout = ist->resample_channel_layout;
+    }
+#endif
+
     snprintf(args, sizeof(args), "time_base=%d/%d:sample_rate=%d:sample_fmt=%s"
              ":channel_layout=0x%"PRIx64,
-             1, ist->st->codec->sample_rate,
-             ist->st->codec->sample_rate,
-             av_get_sample_fmt_name(ist->st->codec->sample_fmt),
-             ist->st->codec->channel_layout);
+             1, sample_rate, sample_rate,
+             av_get_sample_fmt_name(sample_fmt), channel_layout);
     snprintf(name, sizeof(name), "graph %d input from stream %d:%d", fg->index,
              ist->file_index, ist->st->index);
 
@@ -576,6 +611,140 @@ static int configure_input_filter(FilterGraph *fg, InputFilter *ifilter,
     }
 }
 
+typedef struct LadderStep {
+    int w, h;                   ///< output size, 0x0 for the unscaled input
+    int parent;                 ///< index of the step this one is scaled from
+    int nb_pads;                ///< number of outputs and steps fed by this one
+    AVFilterContext *filter;    ///< filter feeding them
+    int pad_idx;                ///< next unused output pad of filter
+} LadderStep;
+
+static int cmp_ladder_steps(const void *a, const void *b)
+{
+    const LadderStep *sa = a, *sb = b;
+    int64_t area_a = (int64_t)sa->w * sa->h, area_b = (int64_t)sb->w * sb->h;
+
+    return (area_a < area_b) - (area_a > area_b);
+}
+
+static int find_ladder_step(const LadderStep *steps, int nb_steps, int w, int h)
+{
+    int i;
+
+    for (i = 0; i < nb_steps; i++)
+        if (steps[i].w == w && steps[i].h == h)
+            return i;
+    return -1;
+}
+
+/* index of the step feeding an output stream, 0 when it is not scaled */
+static int output_ladder_step(const LadderStep *steps, int nb_steps,
+                              const AVCodecContext *enc)
+{
+    return find_ladder_step(steps + 1, nb_steps - 1, enc->width, enc->height) + 1;
+}
+
+/**
+ * Connect the outputs of a simple filtergraph shared by several output
+ * streams to its filter chain. Each distinct output size is scaled once,
+ * from the smallest larger size when there is one and from the filter chain
+ * otherwise, and split between the outputs and the smaller sizes. Sizes
+ * larger than the input frames are not scaled from, so that no output is
+ * scaled down from an upscaled picture.
+ */
+static int configure_scale_ladder(FilterGraph *fg, AVFilterInOut *out)
+{
+    OutputStream *ost = fg->outputs[0]->ost;
+    InputStream  *ist = fg->inputs[0]->ist;
+    LadderStep *steps;
+    int nb_steps = 1, i, j, ret = 0;
+    char name[255], args[255];
+
+    steps = av_mallocz((fg->nb_outputs + 1) * sizeof(*steps));
+    if (!steps)
+        return AVERROR(ENOMEM);
+
+    /* step 0 is the output of the filter chain, the scaled sizes follow it
+     * from the largest to the smallest */
+    for (i = 0; i < fg->nb_outputs; i++) {
+        AVCodecContext *enc = fg->outputs[i]->ost->st->codec;
+
+        if (enc->width && enc->height &&
+            find_ladder_step(steps + 1, nb_steps - 1, enc->width, enc->height) < 0) {
+            steps[nb_steps].w   = enc->width;
+            steps[nb_steps++].h = enc->height;
+        }
+    }
+    qsort(steps + 1, nb_steps - 1, sizeof(*steps), cmp_ladder_steps);
+
+    for (i = 1; i < nb_steps; i++) {
+        for (j = i - 1; j > 0; j--)
+            if (steps[j].w >= steps[i].w && steps[j].h >= steps[i].h &&
+                steps[j].w <= ist->resample_width &&
+                steps[j].h <= ist->resample_height)
+                break;
+        steps[i].parent = j;
+        steps[j].nb_pads++;
+    }
+    for (i = 0; i < fg->nb_outputs; i++) {
+        AVCodecContext *enc = fg->outputs[i]->ost->st->codec;
+        steps[output_ladder_step(steps, nb_steps, enc)].nb_pads++;
+    }
+
+    for (i = 0; i < nb_steps; i++) {
+        LadderStep *step = &steps[i];
+
+        if (i) {
+            LadderStep *parent = &steps[step->parent];
+
+            snprintf(args, sizeof(args), "%d:%d:0x%X", step->w, step->h,
+                     (unsigned)ost->sws_flags);
+            snprintf(name, sizeof(name), "scaler to %dx%d", step->w, step->h);
+            if ((ret = avfilter_graph_create_filter(&step->filter,
+                                                    avfilter_get_by_name("scale"),
+                                                    name, args, NULL, fg->graph)) < 0 ||
+                (ret = avfilter_link(parent->filter, parent->pad_idx++,
+                                     step->filter, 0)) < 0)
+                goto fail;
+        } else {
+            step->filter  = out->filter_ctx;
+            step->pad_idx = out->pad_idx;
+        }
+
+        if (step->nb_pads > 1) {
+            AVFilterContext *split;
+
+            snprintf(args, sizeof(args), "%d", step->nb_pads);
+            if (i)
+                snprintf(name, sizeof(name), "split after scaler to %dx%d",
+                         step->w, step->h);
+            else
+                snprintf(name, sizeof(name), "split for graph %d", fg->index);
+            if ((ret = avfilter_graph_create_filter(&split,
+                                                    avfilter_get_by_name("split"),
+                                                    name, args, NULL, fg->graph)) < 0 ||
+                (ret = avfilter_link(step->filter, step->pad_idx, split, 0)) < 0)
+                goto fail;
+            step->filter  = split;
+            step->pad_idx = 0;
+        }
+    }
+
+    for (i = 0; i < fg->nb_outputs; i++) {
+        AVCodecContext *enc = fg->outputs[i]->ost->st->codec;
+        LadderStep *step = &steps[output_ladder_step(steps, nb_steps, enc)];
+        AVFilterInOut pad = { .filter_ctx = step->filter,
+                              .pad_idx    = step->pad_idx++ };
+
+        if ((ret = configure_output_filter(fg, fg->outputs[i], &pad)) < 0)
+            goto fail;
+    }
+
+fail:
+    av_free(steps);
+    return ret;
+}
+
 int configure_filtergraph(FilterGraph *fg)
 {
     AVFilterInOut *inputs, *outputs, *cur;
@@ -625,9 +794,16 @@ int configure_filtergraph(FilterGraph *fg)
     if (!init || simple) {
         /* we already know the mappings between lavfi outputs and output streams,
          * so we can finish the setup */
-        for (cur = outputs, i = 0; cur; cur = cur->next, i++)
-            configure_output_filter(fg, fg->outputs[i], cur);
-        avfilter_inout_free(&outputs);
+        if (simple && fg->nb_outputs > 1) {
+            ret = configure_scale_ladder(fg, outputs);
+            avfilter_inout_free(&outputs);
+            if (ret < 0)
+                return ret;
+        } else {
+            for (cur = outputs, i = 0; cur; cur = cur->next, i++)
+                configure_output_filter(fg, fg->outputs[i], cur);
+            avfilter_inout_free(&outputs);
+        }
 
         if ((ret = avfilter_graph_config(fg->graph, NULL)) < 0)
             return ret;
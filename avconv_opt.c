@@ -61,6 +61,7 @@ const HWAccel hwaccels[] = {
 };
 
 char *vstats_filename;
+char *progress_url;
 
 float audio_drift_threshold = 0.1;
 float dts_delta_threshold   = 10;
@@ -69,6 +70,7 @@ int audio_volume      = 256;
 int audio_sync_method = 0;
 int video_sync_method = VSYNC_AUTO;
 int do_benchmark      = 0;
+int do_benchmark_all  = 0;
 int do_hex_dump       = 0;
 int do_pkt_dump       = 0;
 int copy_ts           = 0;
@@ -76,6 +78,10 @@ int copy_tb           = 1;
 int exit_on_error     = 0;
 int print_stats       = 1;
 int qp_hist           = 0;
+int parallel_encoding = 0;
+int parallel_decoding = 0;
+int shared_scaling    = 0;
+int transcode_chunks  = 0;
 
 static int file_overwrite     = 0;
 static int file_skip          = 0;
@@ -479,6 +485,7 @@ static void add_input_streams(OptionsContext *o, AVFormatContext *ic)
         MATCH_PER_STREAM_OPT(ts_scale, dbl, ist->ts_scale, ic, st);
 
         ist->dec = choose_decoder(o, ic, st);
+        ist->dec_ctx = st->codec;
         ist->opts = filter_codec_opts(o->g->codec_opts, ist->st->codec->codec_id, ic, st, ist->dec);
 
         switch (dec->codec_type) {
@@ -486,6 +493,7 @@ static void add_input_streams(OptionsContext *o, AVFormatContext *ic)
             ist->resample_height  = dec->height;
             ist->resample_width   = dec->width;
             ist->resample_pix_fmt = dec->pix_fmt;
+            ist->resample_sample_aspect_ratio = dec->sample_aspect_ratio;
 
             MATCH_PER_STREAM_OPT(frame_rates, str, framerate, ic, st);
             if (framerate && av_parse_video_rate(&ist->framerate,
@@ -620,6 +628,7 @@ static int open_input_file(OptionsContext *o, const char *filename)
     uint8_t buf[128];
     AVDictionary **opts;
     AVDictionary *unused_opts = NULL;
+    AVDictionary *format_opts = NULL;
     AVDictionaryEntry *e = NULL;
     int orig_nb_streams;                     // number of streams before avformat_find_stream_info
 
@@ -677,6 +686,8 @@ static int open_input_file(OptionsContext *o, const char *filename)
     ic->flags |= AVFMT_FLAG_NONBLOCK;
     ic->interrupt_callback = int_cb;
 
+    av_dict_copy(&format_opts, o->g->format_opts, 0);
+
     /* open the input file with generic libav function */
     err = avformat_open_input(&ic, filename, file_iformat, &o->g->format_opts);
     if (err < 0) {
@@ -736,6 +747,7 @@ static int open_input_file(OptionsContext *o, const char *filename)
     f->nb_streams = ic->nb_streams;
     f->rate_emu   = o->rate_emu;
     f->accurate_seek = o->accurate_seek;
+    f->format_opts = format_opts;
 
     /* check if all codec options have been used */
     unused_opts = strip_specifiers(o->g->codec_opts);
@@ -2203,6 +2215,18 @@ const OptionDef options[] = {
         "set the number of data frames to record", "number" },
     { "benchmark",      OPT_BOOL | OPT_EXPERT,                       { &do_benchmark },
         "add timings for benchmarking" },
+    { "benchmark_all",  OPT_BOOL | OPT_EXPERT,                       { &do_benchmark_all },
+        "add timings for each processing stage" },
+    { "progress",       HAS_ARG | OPT_STRING | OPT_EXPERT,           { &progress_url },
+        "write periodic machine-readable progress information to the url", "url" },
+    { "parallel_encoding", OPT_BOOL | OPT_EXPERT,                    { &parallel_encoding },
+        "encode each output stream in a separate thread" },
+    { "parallel_decoding", OPT_BOOL | OPT_EXPERT,                    { &parallel_decoding },
+        "decode each input stream in a separate thread" },
+    { "shared_scaling", OPT_BOOL | OPT_EXPERT,                       { &shared_scaling },
+        "filter once and cascade the scaling for the video outputs of the same input" },
+    { "chunks",         HAS_ARG | OPT_INT | OPT_EXPERT,              { &transcode_chunks },
+        "transcode the video in this many time ranges in parallel", "number" },
     { "timelimit",      HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_timelimit },
         "set max runtime in seconds", "limit" },
     { "dump",           OPT_BOOL | OPT_EXPERT,                       { &do_pkt_dump },
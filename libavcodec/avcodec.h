@@ -780,6 +780,10 @@ typedef struct RcOverride{
 #endif
 /**
  * Codec supports frame-level multithreading.
+ * For encoders, this means that the frames are coded independently of each
+ * other. Frame threading is only used by encoders when thread_type is
+ * FF_THREAD_FRAME alone, and the packets are then output
+ * thread_count * 2 - 1 frames late.
  */
 #define CODEC_CAP_FRAME_THREADS    0x1000
 /**
@@ -2519,6 +2523,8 @@ typedef struct AVCodecContext {
      * Which multithreading methods to use.
      * Use of FF_THREAD_FRAME will increase decoding delay by one frame per thread,
      * so clients which cannot provide future frames should not use it.
+     * Encoders only use FF_THREAD_FRAME if FF_THREAD_SLICE is not set, since
+     * it delays their output too.
      *
      * - encoding: Set by user, otherwise the default is used.
      * - decoding: Set by user, otherwise the default is used.
@@ -2737,6 +2743,33 @@ typedef struct AVCodecContext {
      * - decoding: unused.
      */
     uint64_t vbv_delay;
+
+    /**
+     * Maximum number of frames of delay added by frame threading.
+     * When set, at most thread_max_delay + 1 frames are decoded at the same
+     * time, by any of the thread_count threads. The frames already decoded
+     * are returned first, so the delay only grows while the decoding does
+     * not keep up with the input, and goes down again when it catches up.
+     * A frame can then be returned without using any of the packet data;
+     * avcodec_decode_video2() returns 0 and the same packet must be passed
+     * again.
+     * With 0, frame threading is not used, slice threading is used instead
+     * if the codec supports it.
+     * -1 means no limit, i.e. a delay of thread_count - 1 frames.
+     * - encoding: unused
+     * - decoding: Set by user.
+     */
+    int thread_max_delay;
+
+    /**
+     * Run the slice threading jobs on the thread pool shared by the whole
+     * process (see av_thread_pool_get_shared()) instead of threads owned by
+     * this context. thread_count still limits the number of jobs of this
+     * context running at the same time, 0 means the size of the pool + 1.
+     * - encoding: Set by user.
+     * - decoding: Set by user.
+     */
+    int shared_thread_pool;
 } AVCodecContext;
 
 /**
@@ -90,6 +90,11 @@ typedef struct AVCodecInternal {
 
     void *thread_ctx;
 
+    /**
+     * Worker contexts of a frame threaded encoder.
+     */
+    void *frame_thread_encoder;
+
     /**
      * Current packet as passed into the decoder, to avoid having to pass the
      * packet into every function.
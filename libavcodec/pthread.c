@@ -39,7 +39,8 @@
  *
  * Threading requires more than one thread.
  * Frame threading requires entire frames to be passed to the codec,
- * and introduces extra decoding delay, so is incompatible with low_delay.
+ * and introduces extra decoding delay, so is incompatible with low_delay
+ * and with a thread_max_delay of 0.
  *
  * @param avctx The context.
  */
@@ -48,7 +49,11 @@ static void validate_thread_parameters(AVCodecContext *avctx)
     int frame_threading_supported = (avctx->codec->capabilities & CODEC_CAP_FRAME_THREADS)
                                 && !(avctx->flags & CODEC_FLAG_TRUNCATED)
                                 && !(avctx->flags & CODEC_FLAG_LOW_DELAY)
-                                && !(avctx->flags2 & CODEC_FLAG2_CHUNKS);
+                                && !(avctx->flags2 & CODEC_FLAG2_CHUNKS)
+                                && avctx->thread_max_delay
+                                && (!av_codec_is_encoder(avctx->codec) ||
+                                    (!(avctx->thread_type & FF_THREAD_SLICE) &&
+                                     ff_frame_thread_encoder_supported(avctx)));
     if (avctx->thread_count == 1) {
         avctx->active_thread_type = 0;
     } else if (frame_threading_supported && (avctx->thread_type & FF_THREAD_FRAME)) {
@@ -73,6 +78,9 @@ int ff_thread_init(AVCodecContext *avctx)
 
     if (avctx->active_thread_type&FF_THREAD_SLICE)
         return ff_slice_thread_init(avctx);
+    else if (avctx->active_thread_type&FF_THREAD_FRAME &&
+             av_codec_is_encoder(avctx->codec))
+        return ff_frame_thread_encoder_setup(avctx);
     else if (avctx->active_thread_type&FF_THREAD_FRAME)
         return ff_frame_thread_init(avctx);
 
@@ -103,6 +103,7 @@ typedef struct FrameThreadContext {
 
     int next_decoding;             ///< The next context to submit a packet to.
     int next_finished;             ///< The next context to return output from.
+    int nb_pending;                ///< The number of contexts with output not returned yet.
 
     int delaying;                  /**<
                                     * Set for the first N packets, where N is the number of threads.
@@ -370,9 +371,47 @@ int ff_thread_decode_frame(AVCodecContext *avctx,
 {
     FrameThreadContext *fctx = avctx->internal->thread_ctx;
     int finished = fctx->next_finished;
+    int max_delay = avctx->thread_count - 1;
     PerThreadContext *p;
     int err;
 
+    if (avctx->thread_max_delay > 0 && avctx->thread_max_delay < max_delay)
+        max_delay = avctx->thread_max_delay;
+
+    /*
+     * With a delay limit, return the frames that are already decoded
+     * before submitting anything, without consuming the packet, so that
+     * the delay goes down again when the decoding catches up.
+     */
+
+    if (avctx->thread_max_delay > 0 && avpkt->size) {
+        while (fctx->nb_pending) {
+            int ready;
+
+            p = &fctx->threads[finished];
+            pthread_mutex_lock(&p->progress_mutex);
+            ready = p->state == STATE_INPUT_READY;
+            pthread_mutex_unlock(&p->progress_mutex);
+            if (!ready)
+                break;
+
+            if (++finished >= avctx->thread_count) finished = 0;
+            fctx->next_finished = finished;
+            fctx->nb_pending--;
+
+            if (p->got_frame || p->result < 0) {
+                av_frame_move_ref(picture, p->frame);
+                *got_picture_ptr = p->got_frame;
+                picture->pkt_dts = p->avpkt.dts;
+                p->got_frame = 0;
+
+                update_context_from_thread(avctx, p->avctx, 1);
+
+                return (p->result >= 0) ? 0 : p->result;
+            }
+        }
+    }
+
     /*
      * Submit a packet to the next decoding thread.
      */
@@ -382,12 +421,22 @@ int ff_thread_decode_frame(AVCodecContext *avctx,
     if (err) return err;
     err = submit_packet(p, avpkt);
     if (err) return err;
+    fctx->nb_pending++;
 
     /*
-     * If we're still receiving the initial packets, don't return a frame.
+     * With a delay limit, return a frame only once the limit is reached.
+     * Otherwise, if we're still receiving the initial packets, don't
+     * return a frame.
      */
 
-    if (fctx->delaying) {
+    if (avctx->thread_max_delay > 0 && avpkt->size) {
+        if (fctx->nb_pending <= max_delay) {
+            if (fctx->next_decoding >= avctx->thread_count)
+                fctx->next_decoding = 0;
+            *got_picture_ptr = 0;
+            return avpkt->size;
+        }
+    } else if (fctx->delaying) {
         if (fctx->next_decoding >= (avctx->thread_count-1)) fctx->delaying = 0;
 
         *got_picture_ptr=0;
@@ -423,6 +472,7 @@ int ff_thread_decode_frame(AVCodecContext *avctx,
          * Make sure we don't mistakenly return the same frame again.
          */
         p->got_frame = 0;
+        fctx->nb_pending--;
 
         if (finished >= avctx->thread_count) finished = 0;
     } while (!avpkt->size && !*got_picture_ptr && finished != fctx->next_finished);
@@ -677,6 +727,7 @@ void ff_thread_flush(AVCodecContext *avctx)
     }
 
     fctx->next_decoding = fctx->next_finished = 0;
+    fctx->nb_pending = 0;
     fctx->delaying = 1;
     fctx->prev_thread = NULL;
     for (i = 0; i < avctx->thread_count; i++) {
@@ -0,0 +1,380 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Frame multithreading for encoders whose frames are coded independently
+ *
+ * Each frame is handed to one of several worker contexts, opened with the
+ * same parameters as the user's one, and the packets are returned in input
+ * order, 2 * thread_count - 1 frames later. The user's context itself is
+ * not initialized by the codec, it gets the global header and the other
+ * fields set at init from the first worker.
+ */
+
+#include "config.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+#elif HAVE_W32THREADS
+#include "compat/w32pthreads.h"
+#endif
+
+#include <string.h>
+
+#include "avcodec.h"
+#include "internal.h"
+#include "pthread_internal.h"
+#include "thread.h"
+
+#include "libavutil/common.h"
+#include "libavutil/cpu.h"
+#include "libavutil/dict.h"
+#include "libavutil/frame.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+
+typedef struct EncodeTask {
+    AVFrame *frame;
+    AVPacket pkt;
+    int got_packet;
+    int ret;
+    int done;           ///< the packet is ready, protected by the mutex
+
+    /* the coded_frame fields of the worker for this frame */
+    int key_frame;
+    enum AVPictureType pict_type;
+    int quality;
+} EncodeTask;
+
+typedef struct EncodeWorker {
+    struct FrameThreadEncoder *parent;
+    AVCodecContext *avctx;
+    pthread_t thread;
+    int thread_init;
+} EncodeWorker;
+
+typedef struct FrameThreadEncoder {
+    EncodeWorker *workers;
+    int nb_workers;
+
+    /* A ring of tasks, the counters only grow and index it modulo nb_tasks.
+     * Tasks are started in submission order, so that each one is either
+     * waiting, being encoded or done according to where it is. */
+    EncodeTask *tasks;
+    int nb_tasks;
+    unsigned submitted;
+    unsigned started;
+    unsigned returned;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t task_cond;       ///< a task was submitted, or exit was set
+    pthread_cond_t finished_cond;   ///< a task is done
+    int exit;
+
+    AVFrame *coded_frame;           ///< coded_frame of the user's context
+} FrameThreadEncoder;
+
+static void *encode_worker(void *arg)
+{
+    EncodeWorker *w = arg;
+    FrameThreadEncoder *c = w->parent;
+
+    pthread_mutex_lock(&c->mutex);
+    for (;;) {
+        EncodeTask *task;
+        int ret;
+
+        while (c->started == c->submitted && !c->exit)
+            pthread_cond_wait(&c->task_cond, &c->mutex);
+        if (c->exit)
+            break;
+        task = &c->tasks[c->started++ % c->nb_tasks];
+        pthread_mutex_unlock(&c->mutex);
+
+        av_init_packet(&task->pkt);
+        task->pkt.data = NULL;
+        task->pkt.size = 0;
+        ret = avcodec_encode_video2(w->avctx, &task->pkt, task->frame,
+                                    &task->got_packet);
+        av_frame_free(&task->frame);
+        if (w->avctx->coded_frame) {
+            task->key_frame = w->avctx->coded_frame->key_frame;
+            task->pict_type = w->avctx->coded_frame->pict_type;
+            task->quality   = w->avctx->coded_frame->quality;
+        }
+
+        pthread_mutex_lock(&c->mutex);
+        task->ret  = ret;
+        task->done = 1;
+        pthread_cond_broadcast(&c->finished_cond);
+    }
+    pthread_mutex_unlock(&c->mutex);
+    return NULL;
+}
+
+int ff_frame_thread_encoder_supported(AVCodecContext *avctx)
+{
+    /* the statistics describe all the frames coded by one context */
+    if (avctx->flags & CODEC_FLAG_PASS1)
+        return 0;
+    /* the adaptive context models are carried over from frame to frame */
+    if ((avctx->codec_id == AV_CODEC_ID_HUFFYUV ||
+         avctx->codec_id == AV_CODEC_ID_FFVHUFF) && avctx->context_model)
+        return 0;
+    return 1;
+}
+
+int ff_frame_thread_encoder_setup(AVCodecContext *avctx)
+{
+    if (!avctx->thread_count) {
+        int nb_cpus = av_cpu_count();
+        av_log(avctx, AV_LOG_DEBUG, "detected %d logical cores\n", nb_cpus);
+        if (nb_cpus > 1)
+            avctx->thread_count = FFMIN(nb_cpus + 1, MAX_AUTO_THREADS);
+        else
+            avctx->thread_count = 1;
+    }
+    if (avctx->thread_count <= 1)
+        avctx->active_thread_type = 0;
+    return 0;
+}
+
+/**
+ * Collect the private options of the opened context, so that the
+ * workers get the same settings as the user passed to it.
+ */
+static int get_private_options(AVCodecContext *avctx, AVDictionary **dict)
+{
+    const AVOption *o = NULL;
+    int ret;
+
+    while ((o = av_opt_next(avctx->priv_data, o))) {
+        uint8_t *val;
+
+        if (o->type == AV_OPT_TYPE_CONST)
+            continue;
+        /* unset strings would be read back as empty ones */
+        if (o->type == AV_OPT_TYPE_STRING &&
+            !*(char **)((uint8_t *)avctx->priv_data + o->offset))
+            continue;
+        if ((ret = av_opt_get(avctx->priv_data, o->name, 0, &val)) < 0)
+            return ret;
+        if ((ret = av_dict_set(dict, o->name, val, AV_DICT_DONT_STRDUP_VAL)) < 0)
+            return ret;
+    }
+    return 0;
+}
+
+static int open_worker(AVCodecContext *avctx, EncodeWorker *w)
+{
+    AVDictionary *opts = NULL;
+    AVCodecContext *ctx;
+    int ret;
+
+    if (!(ctx = avcodec_alloc_context3(NULL)))
+        return AVERROR(ENOMEM);
+    w->avctx = ctx;
+    if ((ret = avcodec_copy_context(ctx, avctx)) < 0)
+        return ret;
+
+    /* the rest is output of the encoder, owned by the user's context */
+    av_freep(&ctx->extradata);
+    ctx->extradata_size = 0;
+    ctx->coded_frame    = NULL;
+    ctx->stats_out      = NULL;
+    ctx->thread_count   = 1;
+    ctx->active_thread_type = 0;
+
+    if (avctx->codec->priv_class &&
+        (ret = get_private_options(avctx, &opts)) < 0)
+        goto end;
+    ret = avcodec_open2(ctx, avctx->codec, &opts);
+
+end:
+    av_dict_free(&opts);
+    return ret;
+}
+
+int ff_frame_thread_encoder_init(AVCodecContext *avctx)
+{
+    FrameThreadEncoder *c;
+    AVCodecContext *ctx;
+    int i, ret;
+
+#if HAVE_W32THREADS
+    w32thread_init();
+#endif
+
+    c = av_mallocz(sizeof(*c));
+    if (!c)
+        return AVERROR(ENOMEM);
+    avctx->internal->frame_thread_encoder = c;
+
+    /* twice as many tasks as workers, so that the workers do not run
+     * out of frames while the caller waits for the oldest packet */
+    c->nb_workers = avctx->thread_count;
+    c->nb_tasks   = 2 * c->nb_workers;
+    c->workers    = av_mallocz(c->nb_workers * sizeof(*c->workers));
+    c->tasks      = av_mallocz(c->nb_tasks   * sizeof(*c->tasks));
+    if (!c->workers || !c->tasks)
+        return AVERROR(ENOMEM);
+
+    pthread_mutex_init(&c->mutex, NULL);
+    pthread_cond_init(&c->task_cond, NULL);
+    pthread_cond_init(&c->finished_cond, NULL);
+
+    for (i = 0; i < c->nb_workers; i++) {
+        EncodeWorker *w = &c->workers[i];
+
+        w->parent = c;
+        if ((ret = open_worker(avctx, w)) < 0)
+            return ret;
+        if ((ret = pthread_create(&w->thread, NULL, encode_worker, w))) {
+            av_log(avctx, AV_LOG_ERROR, "pthread_create failed\n");
+            return AVERROR(ret);
+        }
+        w->thread_init = 1;
+    }
+
+    /* what the codec would have set when initializing the user's context */
+    ctx = c->workers[0].avctx;
+    if (ctx->extradata_size) {
+        avctx->extradata = av_mallocz(ctx->extradata_size +
+                                      FF_INPUT_BUFFER_PADDING_SIZE);
+        if (!avctx->extradata)
+            return AVERROR(ENOMEM);
+        memcpy(avctx->extradata, ctx->extradata, ctx->extradata_size);
+        avctx->extradata_size = ctx->extradata_size;
+    }
+    avctx->bits_per_coded_sample = ctx->bits_per_coded_sample;
+    avctx->bits_per_raw_sample   = ctx->bits_per_raw_sample;
+    avctx->codec_tag             = ctx->codec_tag;
+    if (!(c->coded_frame = av_frame_alloc()))
+        return AVERROR(ENOMEM);
+    avctx->coded_frame = c->coded_frame;
+    return 0;
+}
+
+void ff_frame_thread_encoder_free(AVCodecContext *avctx)
+{
+    FrameThreadEncoder *c = avctx->internal->frame_thread_encoder;
+    int i;
+
+    if (!c->workers || !c->tasks)
+        goto end;
+
+    pthread_mutex_lock(&c->mutex);
+    c->exit = 1;
+    pthread_cond_broadcast(&c->task_cond);
+    pthread_mutex_unlock(&c->mutex);
+
+    for (i = 0; i < c->nb_workers; i++) {
+        EncodeWorker *w = &c->workers[i];
+
+        if (w->thread_init)
+            pthread_join(w->thread, NULL);
+        if (w->avctx) {
+            avcodec_close(w->avctx);
+            av_freep(&w->avctx);
+        }
+    }
+    for (i = 0; i < c->nb_tasks; i++) {
+        av_frame_free(&c->tasks[i].frame);
+        if (c->tasks[i].done)
+            av_free_packet(&c->tasks[i].pkt);
+    }
+
+    pthread_cond_destroy(&c->finished_cond);
+    pthread_cond_destroy(&c->task_cond);
+    pthread_mutex_destroy(&c->mutex);
+end:
+    if (avctx->coded_frame == c->coded_frame)
+        avctx->coded_frame = NULL;
+    av_frame_free(&c->coded_frame);
+    av_freep(&c->workers);
+    av_freep(&c->tasks);
+    av_freep(&avctx->internal->frame_thread_encoder);
+}
+
+int ff_thread_video_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
+                                 const AVFrame *frame, int *got_packet_ptr)
+{
+    FrameThreadEncoder *c = avctx->internal->frame_thread_encoder;
+    EncodeTask *task;
+    int ret;
+
+    *got_packet_ptr = 0;
+
+    if (frame) {
+        AVFrame *clone = av_frame_clone(frame);
+        if (!clone)
+            return AVERROR(ENOMEM);
+
+        pthread_mutex_lock(&c->mutex);
+        c->tasks[c->submitted++ % c->nb_tasks].frame = clone;
+        pthread_cond_signal(&c->task_cond);
+        pthread_mutex_unlock(&c->mutex);
+
+        /* only output a packet once all the tasks are in use, so that the
+         * delay does not depend on the timing of the workers */
+        if (c->submitted - c->returned < c->nb_tasks)
+            return 0;
+    } else if (c->submitted == c->returned) {
+        return 0;
+    }
+
+    task = &c->tasks[c->returned % c->nb_tasks];
+    pthread_mutex_lock(&c->mutex);
+    while (!task->done)
+        pthread_cond_wait(&c->finished_cond, &c->mutex);
+    task->done = 0;
+    pthread_mutex_unlock(&c->mutex);
+    c->returned++;
+
+    if ((ret = task->ret) < 0 || !task->got_packet)
+        return ret;
+
+    c->coded_frame->key_frame = task->key_frame;
+    c->coded_frame->pict_type = task->pict_type;
+    c->coded_frame->quality   = task->quality;
+
+    if (avpkt->data) {
+        /* the user supplied the buffer */
+        if (avpkt->size < task->pkt.size) {
+            av_log(avctx, AV_LOG_ERROR,
+                   "User packet is too small (%d < %d)\n",
+                   avpkt->size, task->pkt.size);
+            av_free_packet(&task->pkt);
+            return AVERROR(EINVAL);
+        }
+        memcpy(avpkt->data, task->pkt.data, task->pkt.size);
+        avpkt->size = task->pkt.size;
+        ret = av_packet_copy_props(avpkt, &task->pkt);
+        av_free_packet(&task->pkt);
+        if (ret < 0)
+            return ret;
+    } else {
+        av_free_packet(avpkt);
+        *avpkt = task->pkt;
+    }
+    *got_packet_ptr = 1;
+    avctx->frame_number++;
+    return 0;
+}
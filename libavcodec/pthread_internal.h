@@ -31,4 +31,15 @@ void ff_slice_thread_free(AVCodecContext *avctx);
 int ff_frame_thread_init(AVCodecContext *avctx);
 void ff_frame_thread_free(AVCodecContext *avctx, int thread_count);
 
+/**
+ * Check whether the encoder settings allow coding the frames independently.
+ */
+int ff_frame_thread_encoder_supported(AVCodecContext *avctx);
+
+/**
+ * Set the number of encoder worker threads, the workers themselves are
+ * started by ff_frame_thread_encoder_init() once the codec is opened.
+ */
+int ff_frame_thread_encoder_setup(AVCodecContext *avctx);
+
 #endif // AVCODEC_PTHREAD_INTERNAL_H
@@ -38,11 +38,13 @@
 #include "libavutil/common.h"
 #include "libavutil/cpu.h"
 #include "libavutil/mem.h"
+#include "libavutil/threadpool.h"
 
 typedef int (action_func)(AVCodecContext *c, void *arg);
 typedef int (action_func2)(AVCodecContext *c, void *arg, int jobnr, int threadnr);
 
 typedef struct SliceThreadContext {
+    AVThreadPool *pool;     ///< shared pool running the jobs, instead of workers
     pthread_t *workers;
     action_func *func;
     action_func2 *func2;
@@ -101,6 +103,11 @@ void ff_slice_thread_free(AVCodecContext *avctx)
     SliceThreadContext *c = avctx->internal->thread_ctx;
     int i;
 
+    if (c->pool) {
+        av_freep(&avctx->internal->thread_ctx);
+        return;
+    }
+
     pthread_mutex_lock(&c->current_job_lock);
     c->done = 1;
     pthread_cond_broadcast(&c->current_job_cond);
@@ -123,6 +130,33 @@ static av_always_inline void thread_park_workers(SliceThreadContext *c, int thre
     pthread_mutex_unlock(&c->current_job_lock);
 }
 
+typedef struct PoolJobs {
+    AVCodecContext *avctx;
+    action_func *func;
+    action_func2 *func2;
+    void *args;
+    int job_size;
+} PoolJobs;
+
+static int pool_job(void *opaque, int jobnr, int threadnr)
+{
+    PoolJobs *j = opaque;
+
+    return j->func ? j->func(j->avctx, (char*)j->args + jobnr*j->job_size) :
+                     j->func2(j->avctx, j->args, jobnr, threadnr);
+}
+
+static int pool_execute(AVCodecContext *avctx, action_func *func,
+                        action_func2 *func2, void *arg, int *ret,
+                        int job_count, int job_size)
+{
+    SliceThreadContext *c = avctx->internal->thread_ctx;
+    PoolJobs j = { avctx, func, func2, arg, job_size };
+
+    return av_thread_pool_execute(c->pool, pool_job, &j, ret, job_count,
+                                  avctx->thread_count);
+}
+
 static int thread_execute(AVCodecContext *avctx, action_func* func, void *arg, int *ret, int job_count, int job_size)
 {
     SliceThreadContext *c = avctx->internal->thread_ctx;
@@ -134,6 +168,9 @@ static int thread_execute(AVCodecContext *avctx, action_func* func, void *arg, i
     if (job_count <= 0)
         return 0;
 
+    if (c->pool)
+        return pool_execute(avctx, func, c->func2, arg, ret, job_count, job_size);
+
     pthread_mutex_lock(&c->current_job_lock);
 
     c->current_job = avctx->thread_count;
@@ -163,6 +200,29 @@ static int thread_execute2(AVCodecContext *avctx, action_func2* func2, void *arg
     return thread_execute(avctx, NULL, arg, ret, job_count, 0);
 }
 
+static int shared_pool_init(AVCodecContext *avctx, AVThreadPool *pool)
+{
+    SliceThreadContext *c;
+
+    if (!avctx->thread_count)
+        avctx->thread_count = FFMIN(av_thread_pool_get_nb_threads(pool) + 1,
+                                    MAX_AUTO_THREADS);
+    if (avctx->thread_count <= 1) {
+        avctx->active_thread_type = 0;
+        return 0;
+    }
+
+    c = av_mallocz(sizeof(SliceThreadContext));
+    if (!c)
+        return AVERROR(ENOMEM);
+    c->pool = pool;
+    avctx->internal->thread_ctx = c;
+
+    avctx->execute  = thread_execute;
+    avctx->execute2 = thread_execute2;
+    return 0;
+}
+
 int ff_slice_thread_init(AVCodecContext *avctx)
 {
     int i;
@@ -173,6 +233,14 @@ int ff_slice_thread_init(AVCodecContext *avctx)
     w32thread_init();
 #endif
 
+    if (avctx->shared_thread_pool) {
+        AVThreadPool *pool = av_thread_pool_get_shared();
+        if (pool)
+            return shared_pool_init(avctx, pool);
+        av_log(avctx, AV_LOG_WARNING,
+               "Cannot use the shared thread pool, using private threads\n");
+    }
+
     if (!thread_count) {
         int nb_cpus = av_cpu_count();
         av_log(avctx, AV_LOG_DEBUG, "detected %d logical cores\n", nb_cpus);
@@ -61,6 +61,29 @@ void ff_thread_flush(AVCodecContext *avctx);
 int ff_thread_decode_frame(AVCodecContext *avctx, AVFrame *picture,
                            int *got_picture_ptr, AVPacket *avpkt);
 
+/**
+ * Open the worker contexts of a frame threaded encoder.
+ * Called at the end of avcodec_open2(), without holding the codec lock,
+ * since the workers are opened with avcodec_open2() as well.
+ */
+int ff_frame_thread_encoder_init(AVCodecContext *avctx);
+
+/**
+ * Stop the workers of a frame threaded encoder and close their contexts.
+ * Called by avcodec_close(), without holding the codec lock.
+ */
+void ff_frame_thread_encoder_free(AVCodecContext *avctx);
+
+/**
+ * Submit a frame to the workers of a frame threaded encoder.
+ * Returns the packet of the frame submitted thread_count * 2 - 1 frames
+ * earlier, or the oldest pending one when flushing with a NULL frame.
+ *
+ * Parameters are the same as avcodec_encode_video2().
+ */
+int ff_thread_video_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
+                                 const AVFrame *frame, int *got_packet_ptr);
+
 /**
  * If the codec defines update_thread_context(), call this
  * when they are ready for the next thread to start decoding
@@ -1105,6 +1105,13 @@ end:
         *options = tmp;
     }
 
+    if (HAVE_THREADS && ret >= 0 && av_codec_is_encoder(avctx->codec) &&
+        avctx->active_thread_type & FF_THREAD_FRAME) {
+        ret = ff_frame_thread_encoder_init(avctx);
+        if (ret < 0)
+            avcodec_close(avctx);
+    }
+
     return ret;
 free_and_end:
     av_dict_free(&tmp);
@@ -1295,6 +1302,11 @@ int attribute_align_arg avcodec_encode_video2(AVCodecContext *avctx,
 
     *got_packet_ptr = 0;
 
+    /* the frame threads delay the packets, also for codecs without
+     * CODEC_CAP_DELAY, so they are drained with NULL frames */
+    if (HAVE_THREADS && avctx->internal->frame_thread_encoder)
+        return ff_thread_video_encode_frame(avctx, avpkt, frame, got_packet_ptr);
+
     if (!(avctx->codec->capabilities & CODEC_CAP_DELAY) && !frame) {
         av_free_packet(avpkt);
         av_init_packet(avpkt);
@@ -1585,6 +1597,16 @@ void avsubtitle_free(AVSubtitle *sub)
 
 av_cold int avcodec_close(AVCodecContext *avctx)
 {
+    int frame_thread_encoder = 0;
+
+    /* The workers are closed with avcodec_close() too, so this has to be
+     * done before taking the lock. The codec was not initialized on this
+     * context then, so it must not be closed either. */
+    if (HAVE_THREADS && avctx->internal && avctx->internal->frame_thread_encoder) {
+        ff_frame_thread_encoder_free(avctx);
+        frame_thread_encoder = 1;
+    }
+
     /* If there is a user-supplied mutex locking routine, call it. */
     if (lockmgr_cb) {
         if ((*lockmgr_cb)(&codec_mutex, AV_LOCK_OBTAIN))
@@ -1603,7 +1625,7 @@ av_cold int avcodec_close(AVCodecContext *avctx)
         int i;
         if (HAVE_THREADS && avctx->internal->thread_ctx)
             ff_thread_free(avctx);
-        if (avctx->codec && avctx->codec->close)
+        if (avctx->codec && avctx->codec->close && !frame_thread_encoder)
             avctx->codec->close(avctx);
         avctx->coded_frame = NULL;
         av_frame_free(&avctx->internal->to_free);
@@ -1877,7 +1899,8 @@ const char *avcodec_license(void)
 
 void avcodec_flush_buffers(AVCodecContext *avctx)
 {
-    if (HAVE_THREADS && avctx->active_thread_type & FF_THREAD_FRAME)
+    if (HAVE_THREADS && avctx->active_thread_type & FF_THREAD_FRAME &&
+        av_codec_is_decoder(avctx->codec))
         ff_thread_flush(avctx);
     else if (avctx->codec->flush)
         avctx->codec->flush(avctx);
@@ -124,5 +124,6 @@ AVCodec ff_v210_encoder = {
     .init           = encode_init,
     .encode2        = encode_frame,
     .close          = encode_close,
+    .capabilities   = CODEC_CAP_FRAME_THREADS,
     .pix_fmts       = (const enum AVPixelFormat[]){ AV_PIX_FMT_YUV422P10, AV_PIX_FMT_NONE },
 };
@@ -1000,6 +1000,15 @@ typedef struct AVFilterGraph {
      * platform and build options.
      */
     avfilter_execute_func *execute;
+
+    /**
+     * Run the slice threading jobs on the thread pool shared by the whole
+     * process (see av_thread_pool_get_shared()) instead of threads owned by
+     * this graph. nb_threads still limits the number of jobs of a filter
+     * running at the same time, 0 means the size of the pool + 1.
+     * May be set by the caller before adding any filters to the filtergraph.
+     */
+    int shared_thread_pool;
 } AVFilterGraph;
 
 /**
@@ -45,6 +45,8 @@ static const AVOption filtergraph_options[] = {
         { "slice", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = AVFILTER_THREAD_SLICE }, .flags = FLAGS, .unit = "thread_type" },
     { "threads",     "Maximum number of threads", OFFSET(nb_threads),
         AV_OPT_TYPE_INT,   { .i64 = 0 }, 0, INT_MAX, FLAGS },
+    { "shared_thread_pool", "Run the threads on the thread pool shared by the process", OFFSET(shared_thread_pool),
+        AV_OPT_TYPE_INT,   { .i64 = 0 }, 0, 1, FLAGS },
     { NULL },
 };
 
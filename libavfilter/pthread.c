@@ -27,6 +27,7 @@
 #include "libavutil/common.h"
 #include "libavutil/cpu.h"
 #include "libavutil/mem.h"
+#include "libavutil/threadpool.h"
 
 #include "avfilter.h"
 #include "internal.h"
@@ -40,6 +41,7 @@
 
 typedef struct ThreadContext {
     AVFilterGraph *graph;
+    AVThreadPool *pool;     ///< shared pool running the jobs, instead of workers
 
     int nb_threads;
     pthread_t *workers;
@@ -151,6 +153,41 @@ static int thread_execute(AVFilterContext *ctx, avfilter_action_func *func,
     return 0;
 }
 
+typedef struct PoolJobs {
+    AVFilterContext *ctx;
+    avfilter_action_func *func;
+    void *arg;
+    int nb_jobs;
+} PoolJobs;
+
+static int pool_job(void *opaque, int jobnr, int threadnr)
+{
+    PoolJobs *j = opaque;
+    return j->func(j->ctx, j->arg, jobnr, j->nb_jobs);
+}
+
+static int pool_execute(AVFilterContext *ctx, avfilter_action_func *func,
+                        void *arg, int *ret, int nb_jobs)
+{
+    ThreadContext *c = ctx->graph->internal->thread;
+    PoolJobs j = { ctx, func, arg, nb_jobs };
+
+    return av_thread_pool_execute(c->pool, pool_job, &j, ret, nb_jobs,
+                                  c->nb_threads);
+}
+
+static int pool_init(ThreadContext *c, AVThreadPool *pool, int nb_threads)
+{
+    if (!nb_threads)
+        nb_threads = av_thread_pool_get_nb_threads(pool) + 1;
+    if (nb_threads <= 1)
+        return 1;
+
+    c->pool       = pool;
+    c->nb_threads = nb_threads;
+    return nb_threads;
+}
+
 static int thread_init_internal(ThreadContext *c, int nb_threads)
 {
     int i, ret;
@@ -199,6 +236,7 @@ static int thread_init_internal(ThreadContext *c, int nb_threads)
 
 int ff_graph_thread_init(AVFilterGraph *graph)
 {
+    ThreadContext *c;
     int ret;
 
 #if HAVE_W32THREADS
@@ -210,11 +248,20 @@ int ff_graph_thread_init(AVFilterGraph *graph)
         return 0;
     }
 
-    graph->internal->thread = av_mallocz(sizeof(ThreadContext));
-    if (!graph->internal->thread)
+    graph->internal->thread = c = av_mallocz(sizeof(ThreadContext));
+    if (!c)
         return AVERROR(ENOMEM);
 
-    ret = thread_init_internal(graph->internal->thread, graph->nb_threads);
+    if (graph->shared_thread_pool) {
+        AVThreadPool *pool = av_thread_pool_get_shared();
+        if (pool)
+            ret = pool_init(c, pool, graph->nb_threads);
+        else
+            av_log(graph, AV_LOG_WARNING,
+                   "Cannot use the shared thread pool, using private threads\n");
+    }
+    if (!c->pool)
+        ret = thread_init_internal(c, graph->nb_threads);
     if (ret <= 1) {
         av_freep(&graph->internal->thread);
         graph->thread_type = 0;
@@ -223,14 +270,19 @@ int ff_graph_thread_init(AVFilterGraph *graph)
     }
     graph->nb_threads = ret;
 
-    graph->internal->thread_execute = thread_execute;
+    if (c->pool)
+        graph->internal->thread_execute = pool_execute;
+    else
+        graph->internal->thread_execute = thread_execute;
 
     return 0;
 }
 
 void ff_graph_thread_free(AVFilterGraph *graph)
 {
-    if (graph->internal->thread)
-        slice_thread_uninit(graph->internal->thread);
+    ThreadContext *c = graph->internal->thread;
+
+    if (c && !c->pool)
+        slice_thread_uninit(c);
     av_freep(&graph->internal->thread);
 }
@@ -258,6 +258,7 @@ void av_register_all(void)
     REGISTER_MUXDEMUX(YUV4MPEGPIPE,     yuv4mpegpipe);
 
     /* protocols */
+    REGISTER_PROTOCOL(ASYNC,            async);
     REGISTER_PROTOCOL(CONCAT,           concat);
     REGISTER_PROTOCOL(CRYPTO,           crypto);
     REGISTER_PROTOCOL(FFRTMPCRYPT,      ffrtmpcrypt);
@@ -271,6 +272,7 @@ void av_register_all(void)
     REGISTER_PROTOCOL(MMSH,             mmsh);
     REGISTER_PROTOCOL(MMST,             mmst);
     REGISTER_PROTOCOL(MD5,              md5);
+    REGISTER_PROTOCOL(MEM,              mem);
     REGISTER_PROTOCOL(PIPE,             pipe);
     REGISTER_PROTOCOL(RTMP,             rtmp);
     REGISTER_PROTOCOL(RTMPE,            rtmpe);
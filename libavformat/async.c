@@ -0,0 +1,317 @@
+/*
+ * Asynchronous write-behind protocol
+ *
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Asynchronous write-behind protocol
+ *
+ * Writes are queued into a bounded buffer and passed on to the nested
+ * protocol by a separate thread, so that a slow output does not stall
+ * the caller until the buffer is full.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/fifo.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/time.h"
+#include "avformat.h"
+#include "url.h"
+
+typedef struct AsyncContext {
+    const AVClass *class;
+    URLContext *hd;
+    int buffer_size;
+
+    /* Each write is queued as its size followed by its data, so that the
+     * nested protocol gets the same write boundaries as without buffering. */
+    AVFifoBuffer *fifo;
+    uint8_t *buf;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int busy;   ///< the thread is writing a buffer to the nested protocol
+    int closing;
+    int abort;  ///< the queued data is dropped, the nested write is interrupted
+    int error;
+} AsyncContext;
+
+/**
+ * Interrupt callback of the nested protocol, so that the thread stops
+ * writing when the caller is interrupted while closing.
+ */
+static int async_interrupt(void *arg)
+{
+    URLContext *h = arg;
+    AsyncContext *c = h->priv_data;
+    int abort = 0;
+
+    if (c->fifo) {
+        pthread_mutex_lock(&c->mutex);
+        abort = c->abort;
+        pthread_mutex_unlock(&c->mutex);
+    }
+    return abort || ff_check_interrupt(&h->interrupt_callback);
+}
+
+static void *async_thread(void *arg)
+{
+    URLContext *h = arg;
+    AsyncContext *c = h->priv_data;
+    int size, ret;
+
+    pthread_mutex_lock(&c->mutex);
+    for (;;) {
+        while (!av_fifo_size(c->fifo) && !c->closing)
+            pthread_cond_wait(&c->cond, &c->mutex);
+        if (!av_fifo_size(c->fifo) || c->abort)
+            break;
+
+        av_fifo_generic_read(c->fifo, &size, sizeof(size), NULL);
+        av_fifo_generic_read(c->fifo, c->buf, size, NULL);
+        c->busy = 1;
+        pthread_cond_broadcast(&c->cond);
+        pthread_mutex_unlock(&c->mutex);
+
+        ret = ffurl_write(c->hd, c->buf, size);
+
+        pthread_mutex_lock(&c->mutex);
+        c->busy = 0;
+        pthread_cond_broadcast(&c->cond);
+        if (ret < 0) {
+            c->error = ret;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&c->mutex);
+    return NULL;
+}
+
+static int async_open(URLContext *h, const char *uri, int flags)
+{
+    AsyncContext *c = h->priv_data;
+    AVIOInterruptCB int_cb = { async_interrupt, h };
+    const char *nested_url;
+    int ret;
+
+    if ((flags & AVIO_FLAG_READ_WRITE) == AVIO_FLAG_READ_WRITE) {
+        av_log(h, AV_LOG_ERROR, "Simultaneous reading and writing "
+               "is not supported\n");
+        return AVERROR(ENOSYS);
+    }
+    if (!av_strstart(uri, "async+", &nested_url) &&
+        !av_strstart(uri, "async:", &nested_url)) {
+        av_log(h, AV_LOG_ERROR, "Unsupported url %s\n", uri);
+        return AVERROR(EINVAL);
+    }
+
+    if ((ret = ffurl_open(&c->hd, nested_url, flags, &int_cb, NULL)) < 0)
+        return ret;
+    h->is_streamed     = c->hd->is_streamed;
+    h->max_packet_size = c->hd->max_packet_size;
+
+    /* Reading (e.g. for the second pass of a muxer) is passed through */
+    if (!(flags & AVIO_FLAG_WRITE))
+        return 0;
+
+    /* Writes larger than the buffer are split, which is not allowed
+     * for packet based protocols. */
+    c->buffer_size = FFMAX(c->buffer_size, c->hd->max_packet_size);
+    c->fifo = av_fifo_alloc(c->buffer_size + sizeof(int));
+    c->buf  = av_malloc(c->buffer_size);
+    if (!c->fifo || !c->buf) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    pthread_mutex_init(&c->mutex, NULL);
+    pthread_cond_init(&c->cond, NULL);
+    if ((ret = pthread_create(&c->thread, NULL, async_thread, h))) {
+        av_log(h, AV_LOG_ERROR, "pthread_create failed\n");
+        pthread_cond_destroy(&c->cond);
+        pthread_mutex_destroy(&c->mutex);
+        ret = AVERROR(ret);
+        goto fail;
+    }
+    return 0;
+
+fail:
+    av_fifo_free(c->fifo);
+    c->fifo = NULL;
+    av_freep(&c->buf);
+    ffurl_close(c->hd);
+    return ret;
+}
+
+/**
+ * Wait for the thread with the mutex locked, waking up regularly so that
+ * a stalled nested protocol can be interrupted.
+ */
+static int async_wait(URLContext *h)
+{
+    AsyncContext *c = h->priv_data;
+    int64_t t = av_gettime() + 100000;
+    struct timespec tv = { .tv_sec  =  t / 1000000,
+                           .tv_nsec = (t % 1000000) * 1000 };
+
+    if (ff_check_interrupt(&h->interrupt_callback))
+        return AVERROR_EXIT;
+    pthread_cond_timedwait(&c->cond, &c->mutex, &tv);
+    return 0;
+}
+
+/* av_fifo_generic_write() callback copying from a const buffer */
+static int copy_from_buf(void *opaque, void *dst, int size)
+{
+    const uint8_t **src = opaque;
+
+    memcpy(dst, *src, size);
+    *src += size;
+    return size;
+}
+
+static int async_write(URLContext *h, const unsigned char *buf, int size)
+{
+    AsyncContext *c = h->priv_data;
+    int written = 0, ret = 0;
+
+    pthread_mutex_lock(&c->mutex);
+    while (written < size) {
+        int len = FFMIN(size - written, c->buffer_size);
+        const uint8_t *src = buf + written;
+
+        while (!c->error && av_fifo_space(c->fifo) < len + sizeof(len))
+            if ((ret = async_wait(h)) < 0)
+                goto end;
+        if (c->error) {
+            ret = c->error;
+            break;
+        }
+        av_fifo_generic_write(c->fifo, &len, sizeof(len), NULL);
+        av_fifo_generic_write(c->fifo, &src, len, copy_from_buf);
+        written += len;
+        pthread_cond_broadcast(&c->cond);
+    }
+end:
+    pthread_mutex_unlock(&c->mutex);
+    return ret < 0 ? ret : size;
+}
+
+static int async_read(URLContext *h, uint8_t *buf, int size)
+{
+    AsyncContext *c = h->priv_data;
+    return ffurl_read(c->hd, buf, size);
+}
+
+/* Wait until all queued data has been written. */
+static int async_drain(URLContext *h)
+{
+    AsyncContext *c = h->priv_data;
+    int ret = 0;
+
+    pthread_mutex_lock(&c->mutex);
+    while (!c->error && (av_fifo_size(c->fifo) || c->busy))
+        if ((ret = async_wait(h)) < 0)
+            break;
+    if (!ret)
+        ret = c->error;
+    pthread_mutex_unlock(&c->mutex);
+    return ret;
+}
+
+static int64_t async_seek(URLContext *h, int64_t pos, int whence)
+{
+    AsyncContext *c = h->priv_data;
+    int ret;
+
+    if (!c->fifo)
+        return ffurl_seek(c->hd, pos, whence);
+    /* The thread is idle while the buffer is empty, so the nested
+     * context can be used from here. */
+    if ((ret = async_drain(h)) < 0)
+        return ret;
+    return ffurl_seek(c->hd, pos, whence);
+}
+
+static int async_close(URLContext *h)
+{
+    AsyncContext *c = h->priv_data;
+    int ret, ret2;
+
+    if (!c->fifo)
+        return ffurl_close(c->hd);
+
+    /* Let the thread write the queued data, unless the caller gives up,
+     * e.g. because the nested protocol is stalled. */
+    pthread_mutex_lock(&c->mutex);
+    c->closing = 1;
+    pthread_cond_broadcast(&c->cond);
+    while (!c->error && (av_fifo_size(c->fifo) || c->busy))
+        if (async_wait(h) < 0) {
+            c->abort = 1;
+            break;
+        }
+    pthread_mutex_unlock(&c->mutex);
+    pthread_join(c->thread, NULL);
+
+    /* Report write errors that happened after the last write call */
+    ret = c->error;
+    if (av_fifo_size(c->fifo))
+        av_log(h, AV_LOG_ERROR, "%d bytes could not be written\n",
+               av_fifo_size(c->fifo));
+
+    pthread_cond_destroy(&c->cond);
+    pthread_mutex_destroy(&c->mutex);
+    av_fifo_free(c->fifo);
+    c->fifo = NULL;
+    av_freep(&c->buf);
+    ret2 = ffurl_close(c->hd);
+    return ret < 0 ? ret : ret2;
+}
+
+#define OFFSET(x) offsetof(AsyncContext, x)
+#define E AV_OPT_FLAG_ENCODING_PARAM
+static const AVOption options[] = {
+    { "buffer_size", "Maximum amount of data queued for writing, in bytes", OFFSET(buffer_size), AV_OPT_TYPE_INT, { .i64 = 4 << 20 }, 4096, INT_MAX / 2, E },
+    { NULL }
+};
+
+static const AVClass async_class = {
+    .class_name     = "async",
+    .item_name      = av_default_item_name,
+    .option         = options,
+    .version        = LIBAVUTIL_VERSION_INT,
+};
+
+URLProtocol ff_async_protocol = {
+    .name            = "async",
+    .url_open        = async_open,
+    .url_read        = async_read,
+    .url_write       = async_write,
+    .url_seek        = async_seek,
+    .url_close       = async_close,
+    .priv_data_size  = sizeof(AsyncContext),
+    .priv_data_class = &async_class,
+    .flags           = URL_PROTOCOL_FLAG_NESTED_SCHEME,
+};
@@ -892,6 +892,7 @@ typedef struct AVFormatContext {
 #define AVFMT_FLAG_CUSTOM_IO    0x0080 ///< The caller has supplied a custom AVIOContext, don't avio_close() it.
 #define AVFMT_FLAG_DISCARD_CORRUPT  0x0100 ///< Discard frames marked corrupted
 #define AVFMT_FLAG_FLUSH_PACKETS    0x0200 ///< Flush the AVIOContext every packet.
+#define AVFMT_FLAG_PARALLEL_PROBE   0x0400 ///< Decode the streams in parallel in avformat_find_stream_info()
 
     /**
      * decoding: size of data to probe; encoding: unused.
@@ -1263,6 +1264,33 @@ int avformat_open_input(AVFormatContext **ps, const char *filename, AVInputForma
  */
 int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options);
 
+/**
+ * Serialize the stream parameters found by avformat_find_stream_info(),
+ * so that they can be passed to avformat_import_stream_info() the next
+ * time the same source is opened.
+ *
+ * @param ic   media file handle
+ * @param buf  set to a buffer allocated with av_malloc(), which must be
+ *             freed by the caller with av_free()
+ * @param size set to the size of buf
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int avformat_export_stream_info(AVFormatContext *ic, uint8_t **buf, int *size);
+
+/**
+ * Set the stream parameters from data exported with
+ * avformat_export_stream_info(), instead of calling
+ * avformat_find_stream_info(). The streams of ic must match the exported
+ * ones, otherwise nothing is changed and an error is returned; the caller
+ * should then fall back to avformat_find_stream_info().
+ *
+ * @param ic   media file handle, opened with avformat_open_input()
+ * @param buf  data returned by avformat_export_stream_info()
+ * @param size size of buf
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int avformat_import_stream_info(AVFormatContext *ic, const uint8_t *buf, int size);
+
 /**
  * Find the "best" stream in the file.
  * The best stream is determined according to various heuristics as the most
@@ -25,7 +25,16 @@
  * http://tools.ietf.org/html/draft-pantos-http-live-streaming
  */
 
+#include "config.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+#elif HAVE_W32THREADS
+#include "compat/w32pthreads.h"
+#endif
+
 #include "libavutil/avstring.h"
+#include "libavutil/fifo.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/mathematics.h"
 #include "libavutil/opt.h"
@@ -34,9 +43,11 @@
 #include "avformat.h"
 #include "internal.h"
 #include "avio_internal.h"
+#include "http.h"
 #include "url.h"
 
 #define INITIAL_BUFFER_SIZE 32768
+#define MAX_PREFETCH_SEGMENTS 16
 
 /*
  * An apple http stream consists of a playlist with media segment files,
@@ -63,10 +74,22 @@ struct segment {
     uint8_t iv[16];
 };
 
+/*
+ * Position in the prefetched byte stream where a segment ends.
+ */
+struct segment_mark {
+    int64_t end;
+    int seq_no;
+};
+
 /*
  * Each variant has its own demuxer. If it currently is active,
  * it has an open AVIOContext too, and potentially an AVPacket
  * containing the next packet from this stream.
+ *
+ * When prefetching is enabled, a background thread downloads the
+ * upcoming segments (and reloads the playlist of live streams) into
+ * a bounded fifo, and read_data() only consumes from that fifo.
  */
 struct variant {
     int bandwidth;
@@ -91,9 +114,27 @@ struct variant {
 
     char key_url[MAX_URL_SIZE];
     uint8_t key[16];
+
+#if HAVE_THREADS
+    pthread_t prefetch_thread;
+    pthread_mutex_t prefetch_lock;
+    pthread_cond_t prefetch_cond;
+    int prefetch_started;
+    int prefetch_abort;
+    int prefetch_err;
+    int prefetch_finished;
+    AVFifoBuffer *prefetch_fifo;
+    int64_t prefetch_written, prefetch_read;
+    struct segment_mark marks[MAX_PREFETCH_SEGMENTS + 1];
+    int first_mark, nb_marks;
+    URLContext *prefetch_input;
+    int prefetch_seq_no;
+    AVIOInterruptCB prefetch_int_cb;
+#endif
 };
 
 typedef struct HLSContext {
+    const AVClass *class;
     int n_variants;
     struct variant **variants;
     int cur_seq_no;
@@ -103,6 +144,9 @@ typedef struct HLSContext {
     int64_t seek_timestamp;
     int seek_flags;
     AVIOInterruptCB *interrupt_callback;
+    int prefetch_segments;
+    int prefetch_size;
+    int prefetch_ready;
 } HLSContext;
 
 static int read_chomp_line(AVIOContext *s, char *buf, int maxlen)
@@ -122,11 +166,41 @@ static void free_segment_list(struct variant *var)
     var->n_segments = 0;
 }
 
+/*
+ * Stop the prefetch thread of a variant, discarding any data it has
+ * buffered. var->cur_seq_no is left at the segment being consumed.
+ */
+static void stop_prefetch(struct variant *var)
+{
+#if HAVE_THREADS
+    if (!var->prefetch_started)
+        return;
+    pthread_mutex_lock(&var->prefetch_lock);
+    var->prefetch_abort = 1;
+    pthread_cond_signal(&var->prefetch_cond);
+    pthread_mutex_unlock(&var->prefetch_lock);
+    pthread_join(var->prefetch_thread, NULL);
+
+    pthread_mutex_destroy(&var->prefetch_lock);
+    pthread_cond_destroy(&var->prefetch_cond);
+    if (var->prefetch_input)
+        ffurl_close(var->prefetch_input);
+    var->prefetch_input = NULL;
+    av_fifo_free(var->prefetch_fifo);
+    var->prefetch_fifo    = NULL;
+    var->prefetch_written = var->prefetch_read = 0;
+    var->first_mark       = var->nb_marks      = 0;
+    var->prefetch_abort   = var->prefetch_err  = 0;
+    var->prefetch_started = 0;
+#endif
+}
+
 static void free_variant_list(HLSContext *c)
 {
     int i;
     for (i = 0; i < c->n_variants; i++) {
         struct variant *var = c->variants[i];
+        stop_prefetch(var);
         free_segment_list(var);
         av_free_packet(&var->pkt);
         av_free(var->pb.buffer);
@@ -200,7 +274,8 @@ static void handle_key_args(struct key_info *info, const char *key,
 }
 
 static int parse_playlist(HLSContext *c, const char *url,
-                          struct variant *var, AVIOContext *in)
+                          struct variant *var, AVIOContext *in,
+                          AVIOInterruptCB *int_cb)
 {
     int ret = 0, is_segment = 0, is_variant = 0, bandwidth = 0;
     int64_t duration = 0;
@@ -216,7 +291,7 @@ static int parse_playlist(HLSContext *c, const char *url,
     if (!in) {
         close_in = 1;
         if ((ret = avio_open2(&in, url, AVIO_FLAG_READ,
-                              c->interrupt_callback, NULL)) < 0)
+                              int_cb, NULL)) < 0)
             return ret;
     }
 
@@ -329,25 +404,25 @@ fail:
     return ret;
 }
 
-static int open_input(struct variant *var)
+static int open_input(struct variant *var, int seq_no, URLContext **uc,
+                      AVIOInterruptCB *int_cb, AVDictionary **opts)
 {
-    struct segment *seg = var->segments[var->cur_seq_no - var->start_seq_no];
+    struct segment *seg = var->segments[seq_no - var->start_seq_no];
     if (seg->key_type == KEY_NONE) {
-        return ffurl_open(&var->input, seg->url, AVIO_FLAG_READ,
-                          &var->parent->interrupt_callback, NULL);
+        return ffurl_open(uc, seg->url, AVIO_FLAG_READ, int_cb, opts);
     } else if (seg->key_type == KEY_AES_128) {
         char iv[33], key[33], url[MAX_URL_SIZE];
         int ret;
         if (strcmp(seg->key, var->key_url)) {
-            URLContext *uc;
-            if (ffurl_open(&uc, seg->key, AVIO_FLAG_READ,
-                           &var->parent->interrupt_callback, NULL) == 0) {
-                if (ffurl_read_complete(uc, var->key, sizeof(var->key))
+            URLContext *keyuc;
+            if (ffurl_open(&keyuc, seg->key, AVIO_FLAG_READ,
+                           int_cb, NULL) == 0) {
+                if (ffurl_read_complete(keyuc, var->key, sizeof(var->key))
                     != sizeof(var->key)) {
                     av_log(NULL, AV_LOG_ERROR, "Unable to read key file %s\n",
                            seg->key);
                 }
-                ffurl_close(uc);
+                ffurl_close(keyuc);
             } else {
                 av_log(NULL, AV_LOG_ERROR, "Unable to open key file %s\n",
                        seg->key);
@@ -361,14 +436,13 @@ static int open_input(struct variant *var)
             snprintf(url, sizeof(url), "crypto+%s", seg->url);
         else
             snprintf(url, sizeof(url), "crypto:%s", seg->url);
-        if ((ret = ffurl_alloc(&var->input, url, AVIO_FLAG_READ,
-                               &var->parent->interrupt_callback)) < 0)
+        if ((ret = ffurl_alloc(uc, url, AVIO_FLAG_READ, int_cb)) < 0)
             return ret;
-        av_opt_set(var->input->priv_data, "key", key, 0);
-        av_opt_set(var->input->priv_data, "iv", iv, 0);
-        if ((ret = ffurl_connect(var->input, NULL)) < 0) {
-            ffurl_close(var->input);
-            var->input = NULL;
+        av_opt_set((*uc)->priv_data, "key", key, 0);
+        av_opt_set((*uc)->priv_data, "iv", iv, 0);
+        if ((ret = ffurl_connect(*uc, NULL)) < 0) {
+            ffurl_close(*uc);
+            *uc = NULL;
             return ret;
         }
         return 0;
@@ -376,58 +450,58 @@ static int open_input(struct variant *var)
     return AVERROR(ENOSYS);
 }
 
-static int read_data(void *opaque, uint8_t *buf, int buf_size)
+/*
+ * Make sure segment *seq_no is available, reloading the playlist of
+ * a live variant and waiting for new segments to show up if needed.
+ */
+static int select_segment(HLSContext *c, struct variant *v, int *seq_no,
+                          AVIOInterruptCB *int_cb)
 {
-    struct variant *v = opaque;
-    HLSContext *c = v->parent->priv_data;
-    int ret, i;
-
-restart:
-    if (!v->input) {
-        /* If this is a live stream and the reload interval has elapsed since
-         * the last playlist reload, reload the variant playlists now. */
-        int64_t reload_interval = v->n_segments > 0 ?
-                                  v->segments[v->n_segments - 1]->duration :
-                                  v->target_duration;
+    /* If this is a live stream and the reload interval has elapsed since
+     * the last playlist reload, reload the variant playlists now. */
+    int64_t reload_interval = v->n_segments > 0 ?
+                              v->segments[v->n_segments - 1]->duration :
+                              v->target_duration;
+    int ret;
 
 reload:
-        if (!v->finished &&
-            av_gettime() - v->last_load_time >= reload_interval) {
-            if ((ret = parse_playlist(c, v->url, v, NULL)) < 0)
-                return ret;
-            /* If we need to reload the playlist again below (if
-             * there's still no more segments), switch to a reload
-             * interval of half the target duration. */
-            reload_interval = v->target_duration / 2;
-        }
-        if (v->cur_seq_no < v->start_seq_no) {
-            av_log(NULL, AV_LOG_WARNING,
-                   "skipping %d segments ahead, expired from playlists\n",
-                   v->start_seq_no - v->cur_seq_no);
-            v->cur_seq_no = v->start_seq_no;
-        }
-        if (v->cur_seq_no >= v->start_seq_no + v->n_segments) {
-            if (v->finished)
-                return AVERROR_EOF;
-            while (av_gettime() - v->last_load_time < reload_interval) {
-                if (ff_check_interrupt(c->interrupt_callback))
-                    return AVERROR_EXIT;
-                av_usleep(100*1000);
-            }
-            /* Enough time has elapsed since the last reload */
-            goto reload;
-        }
-
-        ret = open_input(v);
-        if (ret < 0)
+    if (!v->finished &&
+        av_gettime() - v->last_load_time >= reload_interval) {
+        if ((ret = parse_playlist(c, v->url, v, NULL, int_cb)) < 0)
             return ret;
+        /* If we need to reload the playlist again below (if
+         * there's still no more segments), switch to a reload
+         * interval of half the target duration. */
+        reload_interval = v->target_duration / 2;
     }
-    ret = ffurl_read(v->input, buf, buf_size);
-    if (ret > 0)
-        return ret;
-    ffurl_close(v->input);
-    v->input = NULL;
-    v->cur_seq_no++;
+    if (*seq_no < v->start_seq_no) {
+        av_log(NULL, AV_LOG_WARNING,
+               "skipping %d segments ahead, expired from playlists\n",
+               v->start_seq_no - *seq_no);
+        *seq_no = v->start_seq_no;
+    }
+    if (*seq_no >= v->start_seq_no + v->n_segments) {
+        if (v->finished)
+            return AVERROR_EOF;
+        while (av_gettime() - v->last_load_time < reload_interval) {
+            if (ff_check_interrupt(int_cb))
+                return AVERROR_EXIT;
+            av_usleep(100*1000);
+        }
+        /* Enough time has elapsed since the last reload */
+        goto reload;
+    }
+    return 0;
+}
+
+/*
+ * Called once v->cur_seq_no has moved past the end of a segment.
+ * Returns AVERROR_EOF if the variant isn't needed any longer.
+ */
+static int segment_done(struct variant *v)
+{
+    HLSContext *c = v->parent->priv_data;
+    int i;
 
     c->end_of_segment = 1;
     c->cur_seq_no = v->cur_seq_no;
@@ -446,6 +520,270 @@ reload:
                v->index);
         return AVERROR_EOF;
     }
+    return 0;
+}
+
+#if HAVE_THREADS
+static int prefetch_interrupt_cb(void *opaque)
+{
+    struct variant *v = opaque;
+    int abort;
+
+    pthread_mutex_lock(&v->prefetch_lock);
+    abort = v->prefetch_abort;
+    pthread_mutex_unlock(&v->prefetch_lock);
+    return abort || ff_check_interrupt(&v->parent->interrupt_callback);
+}
+
+#if CONFIG_HTTP_PROTOCOL
+/*
+ * Request url over the idle persistent connection uc, provided that it
+ * is connected to the same server.
+ */
+static int reuse_connection(URLContext *uc, const char *url)
+{
+    char proto1[10], host1[1024], proto2[10], host2[1024];
+    int port1, port2;
+    uint8_t *location = NULL;
+
+    if (strcmp(uc->prot->name, "http") && strcmp(uc->prot->name, "https"))
+        return AVERROR(ENOSYS);
+    if (av_opt_get(uc->priv_data, "location", 0, &location) < 0)
+        return AVERROR(ENOSYS);
+    av_url_split(proto1, sizeof(proto1), NULL, 0, host1, sizeof(host1),
+                 &port1, NULL, 0, location);
+    av_url_split(proto2, sizeof(proto2), NULL, 0, host2, sizeof(host2),
+                 &port2, NULL, 0, url);
+    av_free(location);
+    if (strcmp(proto1, proto2) || strcmp(host1, host2) || port1 != port2)
+        return AVERROR(ENOSYS);
+    return ff_http_do_new_request(uc, url);
+}
+#endif
+
+static int prefetch_open_segment(struct variant *v, URLContext **conn)
+{
+    struct segment *seg = v->segments[v->prefetch_seq_no - v->start_seq_no];
+    AVDictionary *opts = NULL;
+    int ret;
+
+#if CONFIG_HTTP_PROTOCOL
+    if (*conn && seg->key_type == KEY_NONE &&
+        reuse_connection(*conn, seg->url) >= 0) {
+        v->prefetch_input = *conn;
+        *conn = NULL;
+        return 0;
+    }
+#endif
+    if (*conn)
+        ffurl_close(*conn);
+    *conn = NULL;
+
+    av_dict_set(&opts, "multiple_requests", "1", 0);
+    ret = open_input(v, v->prefetch_seq_no, &v->prefetch_input,
+                     &v->prefetch_int_cb, &opts);
+    av_dict_free(&opts);
+    return ret;
+}
+
+/*
+ * Download the segments of a variant into its fifo, pushing a mark at
+ * the end of each segment. Stops once prefetch_segments complete
+ * segments are waiting to be read, or when the fifo is full.
+ */
+static void *prefetch_thread(void *arg)
+{
+    struct variant *v = arg;
+    HLSContext *c = v->parent->priv_data;
+    URLContext *conn = NULL;
+    uint8_t buf[INITIAL_BUFFER_SIZE];
+    int ret, abort;
+
+    while (1) {
+        if (!v->prefetch_input) {
+            pthread_mutex_lock(&v->prefetch_lock);
+            while (!v->prefetch_abort && v->nb_marks > c->prefetch_segments)
+                pthread_cond_wait(&v->prefetch_cond, &v->prefetch_lock);
+            pthread_mutex_unlock(&v->prefetch_lock);
+
+            ret = select_segment(c, v, &v->prefetch_seq_no, &v->prefetch_int_cb);
+            if (ret < 0)
+                break;
+            pthread_mutex_lock(&v->prefetch_lock);
+            v->prefetch_finished = v->finished;
+            pthread_mutex_unlock(&v->prefetch_lock);
+            if ((ret = prefetch_open_segment(v, &conn)) < 0)
+                break;
+        }
+
+        ret = ffurl_read(v->prefetch_input, buf, sizeof(buf));
+
+        pthread_mutex_lock(&v->prefetch_lock);
+        if (ret > 0) {
+            while (!v->prefetch_abort &&
+                   av_fifo_space(v->prefetch_fifo) < ret)
+                pthread_cond_wait(&v->prefetch_cond, &v->prefetch_lock);
+            if (!v->prefetch_abort) {
+                av_fifo_generic_write(v->prefetch_fifo, buf, ret, NULL);
+                v->prefetch_written += ret;
+            }
+        } else {
+            struct segment_mark *mark = &v->marks[(v->first_mark + v->nb_marks++) %
+                                                  FF_ARRAY_ELEMS(v->marks)];
+            mark->end    = v->prefetch_written;
+            mark->seq_no = v->prefetch_seq_no++;
+        }
+        pthread_cond_signal(&v->prefetch_cond);
+        abort = v->prefetch_abort;
+        pthread_mutex_unlock(&v->prefetch_lock);
+
+        if (ret <= 0) {
+            /* Keep a cleanly finished connection around for the next
+             * segment. */
+            if (!conn && (ret == 0 || ret == AVERROR_EOF))
+                conn = v->prefetch_input;
+            else
+                ffurl_close(v->prefetch_input);
+            v->prefetch_input = NULL;
+        }
+        if (abort) {
+            ret = AVERROR_EXIT;
+            break;
+        }
+    }
+
+    if (conn)
+        ffurl_close(conn);
+    pthread_mutex_lock(&v->prefetch_lock);
+    v->prefetch_err = ret;
+    pthread_cond_signal(&v->prefetch_cond);
+    pthread_mutex_unlock(&v->prefetch_lock);
+    return NULL;
+}
+
+static int start_prefetch(struct variant *v)
+{
+    HLSContext *c = v->parent->priv_data;
+    int ret;
+
+    v->prefetch_fifo = av_fifo_alloc(c->prefetch_size);
+    if (!v->prefetch_fifo)
+        return AVERROR(ENOMEM);
+    pthread_mutex_init(&v->prefetch_lock, NULL);
+    pthread_cond_init(&v->prefetch_cond, NULL);
+    v->prefetch_int_cb.callback = prefetch_interrupt_cb;
+    v->prefetch_int_cb.opaque   = v;
+
+    /* Hand the segment currently being read over to the thread */
+    v->prefetch_input    = v->input;
+    v->prefetch_seq_no   = v->cur_seq_no;
+    v->prefetch_finished = v->finished;
+    v->input             = NULL;
+
+    if ((ret = pthread_create(&v->prefetch_thread, NULL, prefetch_thread, v))) {
+        v->input          = v->prefetch_input;
+        v->prefetch_input = NULL;
+        pthread_mutex_destroy(&v->prefetch_lock);
+        pthread_cond_destroy(&v->prefetch_cond);
+        av_fifo_free(v->prefetch_fifo);
+        v->prefetch_fifo = NULL;
+        return AVERROR(ret);
+    }
+    v->prefetch_started = 1;
+    return 0;
+}
+
+static int read_prefetched(struct variant *v, uint8_t *buf, int buf_size)
+{
+    int ret, size;
+
+    if (!v->prefetch_started && (ret = start_prefetch(v)) < 0)
+        return ret;
+
+    pthread_mutex_lock(&v->prefetch_lock);
+    while (1) {
+        size = av_fifo_size(v->prefetch_fifo);
+        if (v->nb_marks) {
+            struct segment_mark *mark = &v->marks[v->first_mark];
+            if (mark->end == v->prefetch_read) {
+                v->first_mark = (v->first_mark + 1) % FF_ARRAY_ELEMS(v->marks);
+                v->nb_marks--;
+                v->cur_seq_no = mark->seq_no + 1;
+                pthread_cond_signal(&v->prefetch_cond);
+                pthread_mutex_unlock(&v->prefetch_lock);
+
+                if ((ret = segment_done(v)) < 0) {
+                    stop_prefetch(v);
+                    return ret;
+                }
+                pthread_mutex_lock(&v->prefetch_lock);
+                continue;
+            }
+            size = FFMIN(size, mark->end - v->prefetch_read);
+        }
+        if (size > 0) {
+            size = FFMIN(size, buf_size);
+            av_fifo_generic_read(v->prefetch_fifo, buf, size, NULL);
+            v->prefetch_read += size;
+            pthread_cond_signal(&v->prefetch_cond);
+            pthread_mutex_unlock(&v->prefetch_lock);
+            return size;
+        }
+        if (v->prefetch_err) {
+            ret = v->prefetch_err;
+            pthread_mutex_unlock(&v->prefetch_lock);
+            stop_prefetch(v);
+            return ret;
+        }
+        pthread_cond_wait(&v->prefetch_cond, &v->prefetch_lock);
+    }
+}
+#endif
+
+static int variant_finished(struct variant *v)
+{
+#if HAVE_THREADS
+    if (v->prefetch_started) {
+        int finished;
+        pthread_mutex_lock(&v->prefetch_lock);
+        finished = v->prefetch_finished;
+        pthread_mutex_unlock(&v->prefetch_lock);
+        return finished;
+    }
+#endif
+    return v->finished;
+}
+
+static int read_data(void *opaque, uint8_t *buf, int buf_size)
+{
+    struct variant *v = opaque;
+    HLSContext *c = v->parent->priv_data;
+    int ret;
+
+#if HAVE_THREADS
+    if (c->prefetch_segments && c->prefetch_ready)
+        return read_prefetched(v, buf, buf_size);
+#endif
+
+restart:
+    if (!v->input) {
+        ret = select_segment(c, v, &v->cur_seq_no, c->interrupt_callback);
+        if (ret < 0)
+            return ret;
+        ret = open_input(v, v->cur_seq_no, &v->input,
+                         c->interrupt_callback, NULL);
+        if (ret < 0)
+            return ret;
+    }
+    ret = ffurl_read(v->input, buf, buf_size);
+    if (ret > 0)
+        return ret;
+    ffurl_close(v->input);
+    v->input = NULL;
+    v->cur_seq_no++;
+
+    if ((ret = segment_done(v)) < 0)
+        return ret;
     goto restart;
 }
 
@@ -456,7 +794,8 @@ static int hls_read_header(AVFormatContext *s)
 
     c->interrupt_callback = &s->interrupt_callback;
 
-    if ((ret = parse_playlist(c, s->filename, NULL, s->pb)) < 0)
+    if ((ret = parse_playlist(c, s->filename, NULL, s->pb,
+                              c->interrupt_callback)) < 0)
         goto fail;
 
     if (c->n_variants == 0) {
@@ -469,7 +808,8 @@ static int hls_read_header(AVFormatContext *s)
     if (c->n_variants > 1 || c->variants[0]->n_segments == 0) {
         for (i = 0; i < c->n_variants; i++) {
             struct variant *v = c->variants[i];
-            if ((ret = parse_playlist(c, v->url, v, NULL)) < 0)
+            if ((ret = parse_playlist(c, v->url, v, NULL,
+                                      c->interrupt_callback)) < 0)
                 goto fail;
         }
     }
@@ -569,6 +909,16 @@ static int hls_read_header(AVFormatContext *s)
     c->first_timestamp = AV_NOPTS_VALUE;
     c->seek_timestamp  = AV_NOPTS_VALUE;
 
+#if HAVE_THREADS
+    /* Only start prefetching once the variants have been probed, and
+     * the caller had a chance to discard the ones it doesn't need. */
+    c->prefetch_ready = 1;
+#else
+    if (c->prefetch_segments)
+        av_log(s, AV_LOG_WARNING,
+               "Prefetching requires threads, reading segments directly\n");
+#endif
+
     return 0;
 fail:
     free_variant_list(c);
@@ -595,10 +945,12 @@ static int recheck_discard_flags(AVFormatContext *s, int first)
         if (v->cur_needed && !v->needed) {
             v->needed = 1;
             changed = 1;
+            stop_prefetch(v);
             v->cur_seq_no = c->cur_seq_no;
             v->pb.eof_reached = 0;
             av_log(s, AV_LOG_INFO, "Now receiving variant %d\n", i);
         } else if (first && !v->cur_needed && v->needed) {
+            stop_prefetch(v);
             if (v->input)
                 ffurl_close(v->input);
             v->input = NULL;
@@ -721,7 +1073,7 @@ static int hls_read_seek(AVFormatContext *s, int stream_index,
     HLSContext *c = s->priv_data;
     int i, j, ret;
 
-    if ((flags & AVSEEK_FLAG_BYTE) || !c->variants[0]->finished)
+    if ((flags & AVSEEK_FLAG_BYTE) || !variant_finished(c->variants[0]))
         return AVERROR(ENOSYS);
 
     c->seek_flags     = flags;
@@ -745,6 +1097,7 @@ static int hls_read_seek(AVFormatContext *s, int stream_index,
         struct variant *var = c->variants[i];
         int64_t pos = c->first_timestamp == AV_NOPTS_VALUE ?
                       0 : c->first_timestamp;
+        stop_prefetch(var);
         if (var->input) {
             ffurl_close(var->input);
             var->input = NULL;
@@ -786,6 +1139,23 @@ static int hls_probe(AVProbeData *p)
     return 0;
 }
 
+#define OFFSET(x) offsetof(HLSContext, x)
+#define D AV_OPT_FLAG_DECODING_PARAM
+static const AVOption hls_options[] = {
+    { "prefetch_segments", "Number of upcoming segments to download in the background (0 disables prefetching)",
+      OFFSET(prefetch_segments), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, MAX_PREFETCH_SEGMENTS, D },
+    { "prefetch_size", "Maximum number of prefetched bytes buffered per variant",
+      OFFSET(prefetch_size), AV_OPT_TYPE_INT, { .i64 = 8 << 20 }, INITIAL_BUFFER_SIZE, INT_MAX, D },
+    { NULL },
+};
+
+static const AVClass hls_class = {
+    .class_name = "hls demuxer",
+    .item_name  = av_default_item_name,
+    .option     = hls_options,
+    .version    = LIBAVUTIL_VERSION_INT,
+};
+
 AVInputFormat ff_hls_demuxer = {
     .name           = "hls,applehttp",
     .long_name      = NULL_IF_CONFIG_SMALL("Apple HTTP Live Streaming"),
@@ -795,4 +1165,5 @@ AVInputFormat ff_hls_demuxer = {
     .read_packet    = hls_read_packet,
     .read_close     = hls_close,
     .read_seek      = hls_read_seek,
+    .priv_class     = &hls_class,
 };
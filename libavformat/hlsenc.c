@@ -19,8 +19,18 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <errno.h>
 #include <float.h>
 #include <stdint.h>
+#include <stdio.h>
+
+#include "config.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+#elif HAVE_W32THREADS
+#include "compat/w32pthreads.h"
+#endif
 
 #include "libavutil/mathematics.h"
 #include "libavutil/parseutils.h"
@@ -30,9 +40,12 @@
 
 #include "avformat.h"
 #include "internal.h"
+#include "os_support.h"
+#include "url.h"
 
 typedef struct ListEntry {
     char  name[1024];
+    char  url[1024];       // full name of the segment, to remove it
     int   duration;
     struct ListEntry *next;
 } ListEntry;
@@ -46,6 +59,8 @@ typedef struct HLSContext {
     float time;            // Set by a private option.
     int  size;             // Set by a private option.
     int  wrap;             // Set by a private option.
+    int  async_close;      // Set by a private option.
+    int  memory;           // Set by a private option.
     int64_t recording_time;
     int has_video;
     int64_t start_pts;
@@ -55,7 +70,18 @@ typedef struct HLSContext {
     ListEntry *list;
     ListEntry *end_list;
     char *basename;
+    char *playlist;
     AVIOContext *pb;
+
+    // Segment being closed in the background
+    AVIOContext *finish_pb;
+    char finish_name[1024];
+    int64_t finish_duration;
+    int finish_ret;
+#if HAVE_THREADS
+    pthread_t finish_thread;
+    int finishing;
+#endif
 } HLSContext;
 
 static int hls_mux_init(AVFormatContext *s)
@@ -82,14 +108,18 @@ static int hls_mux_init(AVFormatContext *s)
     return 0;
 }
 
-static int append_entry(HLSContext *hls, uint64_t duration)
+static int append_entry(HLSContext *hls, const char *filename,
+                        uint64_t duration)
 {
     ListEntry *en = av_malloc(sizeof(*en));
+    const char *name = filename;
 
     if (!en)
         return AVERROR(ENOMEM);
 
-    av_strlcpy(en->name, av_basename(hls->avf->filename), sizeof(en->name));
+    av_strstart(filename, "mem:", &name);
+    av_strlcpy(en->name, av_basename(name), sizeof(en->name));
+    av_strlcpy(en->url, filename, sizeof(en->url));
 
     en->duration = duration;
     en->next     = NULL;
@@ -104,6 +134,16 @@ static int append_entry(HLSContext *hls, uint64_t duration)
     if (hls->nb_entries >= hls->size) {
         en = hls->list;
         hls->list = en->next;
+#if CONFIG_MEM_PROTOCOL
+        /* only the segments of the playlist are kept in memory, unless
+         * the name was reused by a newer one with hls_wrap */
+        if (hls->memory) {
+            ListEntry *p;
+            for (p = hls->list; p && strcmp(p->url, en->url); p = p->next) ;
+            if (!p)
+                ff_mem_protocol_unlink(en->url);
+        }
+#endif
         av_free(en);
     } else
         hls->nb_entries++;
@@ -124,15 +164,43 @@ static void free_entries(HLSContext *hls)
     }
 }
 
+/**
+ * Return the path of the playlist if it is a local file, NULL otherwise.
+ */
+static const char *local_path(const char *url)
+{
+    const char *path;
+    size_t scheme_len = strspn(url, "abcdefghijklmnopqrstuvwxyz"
+                                    "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                    "0123456789+-.");
+
+    if (av_strstart(url, "file:", &path))
+        return path;
+    if (url[scheme_len] == ':' && !is_dos_path(url))
+        return NULL;
+    return url;
+}
+
 static int hls_window(AVFormatContext *s, int last)
 {
     HLSContext *hls = s->priv_data;
     ListEntry *en;
     int target_duration = 0;
     int ret = 0;
+    const char *path = local_path(hls->playlist);
+    char temp_filename[1024];
+
+    /* Local playlists are replaced atomically, so that readers never
+     * see a partially written one. Playlists in memory are only
+     * replaced once they are closed. */
+    if (path && snprintf(temp_filename, sizeof(temp_filename), "%s.tmp",
+                         path) >= sizeof(temp_filename)) {
+        av_log(s, AV_LOG_ERROR, "Playlist name %s is too long\n", path);
+        return AVERROR(EINVAL);
+    }
 
-    if ((ret = avio_open2(&hls->pb, s->filename, AVIO_FLAG_WRITE,
-                          &s->interrupt_callback, NULL)) < 0)
+    if ((ret = avio_open2(&hls->pb, path ? temp_filename : hls->playlist,
+                          AVIO_FLAG_WRITE, &s->interrupt_callback, NULL)) < 0)
         goto fail;
 
     for (en = hls->list; en; en = en->next) {
@@ -154,6 +222,13 @@ static int hls_window(AVFormatContext *s, int last)
     if (last)
         avio_printf(hls->pb, "#EXT-X-ENDLIST\n");
 
+    avio_closep(&hls->pb);
+    if (path && rename(temp_filename, path) < 0) {
+        ret = AVERROR(errno);
+        av_log(s, AV_LOG_ERROR, "Unable to rename %s to %s\n",
+               temp_filename, path);
+    }
+
 fail:
     avio_closep(&hls->pb);
     return ret;
@@ -180,19 +255,107 @@ static int hls_start(AVFormatContext *s)
     return 0;
 }
 
+/**
+ * Close the segment set up by hls_end_async(), and only then add it
+ * to the playlist.
+ */
+static void *hls_finish(void *arg)
+{
+    AVFormatContext *s = arg;
+    HLSContext *hls = s->priv_data;
+    int ret;
+
+    ret = avio_close(hls->finish_pb);
+    hls->finish_pb = NULL;
+    if (ret >= 0)
+        ret = append_entry(hls, hls->finish_name, hls->finish_duration);
+    if (ret >= 0)
+        ret = hls_window(s, 0);
+
+    hls->finish_ret = ret;
+    return NULL;
+}
+
+/**
+ * Wait for the segment being closed in the background, if any.
+ */
+static int hls_finish_wait(HLSContext *hls)
+{
+#if HAVE_THREADS
+    if (hls->finishing) {
+        pthread_join(hls->finish_thread, NULL);
+        hls->finishing = 0;
+        return hls->finish_ret;
+    }
+#endif
+    return 0;
+}
+
+#if HAVE_THREADS
+/**
+ * Start the next segment while the current one is closed by a
+ * separate thread.
+ */
+static int hls_end_async(AVFormatContext *s)
+{
+    HLSContext *hls = s->priv_data;
+    AVFormatContext *oc = hls->avf;
+    int ret;
+
+    /* Segments are added to the playlist in order */
+    if ((ret = hls_finish_wait(hls)) < 0)
+        return ret;
+
+    av_strlcpy(hls->finish_name, oc->filename, sizeof(hls->finish_name));
+    hls->finish_duration = hls->duration;
+    hls->finish_pb       = oc->pb;
+    oc->pb               = NULL;
+
+    if (pthread_create(&hls->finish_thread, NULL, hls_finish, s)) {
+        hls_finish(s);
+        if (hls->finish_ret < 0)
+            return hls->finish_ret;
+    } else {
+        hls->finishing = 1;
+    }
+
+    return hls_start(s);
+}
+#endif
+
 static int hls_write_header(AVFormatContext *s)
 {
     HLSContext *hls = s->priv_data;
     int ret, i;
     char *p;
     const char *pattern = "%d.ts";
-    int basename_size = strlen(s->filename) + strlen(pattern) + 1;
+    const char *prefix  = "";
+    int basename_size;
 
     hls->number      = 0;
 
     hls->recording_time = hls->time * AV_TIME_BASE;
     hls->start_pts      = AV_NOPTS_VALUE;
 
+#if !HAVE_THREADS
+    if (hls->async_close) {
+        av_log(s, AV_LOG_WARNING, "hls_async_close requires threads, "
+               "segments will be closed synchronously.\n");
+        hls->async_close = 0;
+    }
+#endif
+
+    if (hls->memory) {
+#if CONFIG_MEM_PROTOCOL
+        if (!av_strstart(s->filename, "mem:", NULL))
+            prefix = "mem:";
+#else
+        av_log(s, AV_LOG_ERROR, "hls_memory requires the mem protocol.\n");
+        return AVERROR(ENOSYS);
+#endif
+    }
+    basename_size = strlen(prefix) + strlen(s->filename) + strlen(pattern) + 1;
+
     for (i = 0; i < s->nb_streams; i++)
         hls->has_video +=
             s->streams[i]->codec->codec_type == AVMEDIA_TYPE_VIDEO;
@@ -210,13 +373,15 @@ static int hls_write_header(AVFormatContext *s)
     }
 
     hls->basename = av_malloc(basename_size);
+    hls->playlist = av_malloc(basename_size);
 
-    if (!hls->basename) {
+    if (!hls->basename || !hls->playlist) {
         ret = AVERROR(ENOMEM);
         goto fail;
     }
 
-    strcpy(hls->basename, s->filename);
+    snprintf(hls->playlist, basename_size, "%s%s", prefix, s->filename);
+    strcpy(hls->basename, hls->playlist);
 
     p = strrchr(hls->basename, '.');
 
@@ -238,6 +403,7 @@ static int hls_write_header(AVFormatContext *s)
 fail:
     if (ret) {
         av_free(hls->basename);
+        av_freep(&hls->playlist);
         if (hls->avf)
             avformat_free_context(hls->avf);
     }
@@ -269,25 +435,32 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
 
     if (can_split && av_compare_ts(pkt->pts - hls->start_pts, st->time_base,
                                    end_pts, AV_TIME_BASE_Q) >= 0) {
-        ret = append_entry(hls, hls->duration);
-        if (ret)
-            return ret;
+        av_write_frame(oc, NULL); /* Flush any buffered data */
 
-        hls->end_pts = pkt->pts;
-        hls->duration = 0;
+#if HAVE_THREADS
+        if (hls->async_close) {
+            if ((ret = hls_end_async(s)) < 0)
+                return ret;
+        } else
+#endif
+        {
+            ret = append_entry(hls, oc->filename, hls->duration);
+            if (ret)
+                return ret;
 
-        av_write_frame(oc, NULL); /* Flush any buffered data */
-        avio_close(oc->pb);
+            avio_close(oc->pb);
 
-        ret = hls_start(s);
+            ret = hls_start(s);
 
-        if (ret)
-            return ret;
+            if (ret)
+                return ret;
 
-        oc = hls->avf;
+            if ((ret = hls_window(s, 0)) < 0)
+                return ret;
+        }
 
-        if ((ret = hls_window(s, 0)) < 0)
-            return ret;
+        hls->end_pts = pkt->pts;
+        hls->duration = 0;
     }
 
     ret = ff_write_chained(oc, pkt->stream_index, pkt, s);
@@ -299,17 +472,20 @@ static int hls_write_trailer(struct AVFormatContext *s)
 {
     HLSContext *hls = s->priv_data;
     AVFormatContext *oc = hls->avf;
+    /* the last segment closed in the background may have failed */
+    int ret = hls_finish_wait(hls);
 
     av_write_trailer(oc);
     avio_closep(&oc->pb);
+    append_entry(hls, oc->filename, hls->duration);
     avformat_free_context(oc);
     av_free(hls->basename);
-    append_entry(hls, hls->duration);
     hls_window(s, 1);
+    av_freep(&hls->playlist);
 
     free_entries(hls);
     avio_close(hls->pb);
-    return 0;
+    return ret;
 }
 
 #define OFFSET(x) offsetof(HLSContext, x)
@@ -319,6 +495,8 @@ static const AVOption options[] = {
     {"hls_time",      "segment length in seconds",               OFFSET(time),    AV_OPT_TYPE_FLOAT,  {.dbl = 2},     0, FLT_MAX, E},
     {"hls_list_size", "maximum number of playlist entries",      OFFSET(size),    AV_OPT_TYPE_INT,    {.i64 = 5},     0, INT_MAX, E},
     {"hls_wrap",      "number after which the index wraps",      OFFSET(wrap),    AV_OPT_TYPE_INT,    {.i64 = 0},     0, INT_MAX, E},
+    {"hls_async_close", "close segments in a separate thread",   OFFSET(async_close), AV_OPT_TYPE_INT, {.i64 = 0},   0, 1,       E},
+    {"hls_memory",    "keep the playlist and its segments in memory", OFFSET(memory), AV_OPT_TYPE_INT, {.i64 = 0},     0, 1,       E},
     { NULL },
 };
 
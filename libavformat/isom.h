@@ -92,6 +92,27 @@ typedef struct MOVSbgp {
     unsigned int index;
 } MOVSbgp;
 
+/**
+ * Position in the compact sample tables of a track, used instead of
+ * AVStream.index_entries when the index is built lazily.
+ */
+typedef struct MOVSampleCursor {
+    unsigned int sample;        ///< sample the cursor points at
+    unsigned int chunk;         ///< chunk containing the sample
+    unsigned int chunk_sample;  ///< index of the sample inside its chunk
+    unsigned int stsc_index;
+    unsigned int stts_index;
+    unsigned int stts_sample;
+    unsigned int stss_index;
+    unsigned int stps_index;
+    unsigned int rap_group_index;
+    unsigned int rap_group_sample;
+    unsigned int distance;      ///< samples since the last keyframe
+    int64_t pos;
+    int64_t dts;
+    AVIndexEntry entry;         ///< the sample the cursor points at
+} MOVSampleCursor;
+
 typedef struct MOVStreamContext {
     AVIOContext *pb;
     int ffindex;          ///< AVStream index
@@ -135,9 +156,20 @@ typedef struct MOVStreamContext {
     int64_t track_end;    ///< used for dts generation in fragmented movie files
     unsigned int rap_group_count;
     MOVSbgp *rap_group;
+    int lazy_index;       ///< samples are resolved from the sample tables on demand
+    unsigned int lazy_sample_count; ///< number of samples addressable through the sample tables
+    int64_t lazy_start_dts; ///< dts of the first sample
+    int lazy_key_off;     ///< 1 if the stss/stps tables are 1-based
+    MOVSampleCursor cursor;
+    AVIOContext *stsz_pb; ///< context the sample sizes are read from on demand, or NULL
+    int64_t stsz_offset;  ///< position of the sample size table in stsz_pb
+    int stsz_field_size;  ///< size in bits of a sample size table entry
+    unsigned int sample_sizes_start; ///< first sample whose size is in sample_sizes
+    unsigned int sample_sizes_count; ///< number of sample sizes in sample_sizes
 } MOVStreamContext;
 
 typedef struct MOVContext {
+    const AVClass *class;
     AVFormatContext *fc;
     int time_scale;
     int64_t duration;     ///< duration of the longest track
@@ -152,6 +184,7 @@ typedef struct MOVContext {
     int itunes_metadata;  ///< metadata are itunes style
     int chapter_track;
     int64_t next_root_atom; ///< offset of the next root atom
+    int lazy_index;       ///< keep the sample tables instead of building a full index
 } MOVContext;
 
 int ff_mp4_read_descr_len(AVIOContext *pb);
@@ -106,6 +106,7 @@ typedef struct MatroskaMuxContext {
     int64_t cues_pos;
     int64_t cluster_time_limit;
     int wrote_chapters;
+    int is_live;
 } MatroskaMuxContext;
 
 
@@ -999,6 +1000,9 @@ static int mkv_write_header(AVFormatContext *s)
     if (pb->seekable && mkv->reserve_cues_space) {
         mkv->cues_pos = avio_tell(pb);
         put_ebml_void(pb, mkv->reserve_cues_space);
+    } else if (mkv->is_live && mkv->reserve_cues_space) {
+        av_log(s, AV_LOG_WARNING, "The output is not seekable, "
+               "the cues cannot be written in the reserved space\n");
     }
 
     av_init_packet(&mkv->cur_audio_pkt);
@@ -1008,7 +1012,7 @@ static int mkv_write_header(AVFormatContext *s)
 
     // start a new cluster every 5 MB or 5 sec, or 32k / 1 sec for streaming or
     // after 4k and on a keyframe
-    if (pb->seekable) {
+    if (pb->seekable && !mkv->is_live) {
         if (mkv->cluster_time_limit < 0)
             mkv->cluster_time_limit = 5000;
         if (mkv->cluster_size_limit < 0)
@@ -1251,9 +1255,13 @@ static int mkv_write_packet_internal(AVFormatContext *s, AVPacket *pkt)
         return AVERROR(EINVAL);
     }
 
-    if (!s->pb->seekable) {
-        if (!mkv->dyn_bc)
-            avio_open_dyn_buf(&mkv->dyn_bc);
+    // clusters are buffered so that their size is known before writing them
+    if (!s->pb->seekable || mkv->is_live) {
+        if (!mkv->dyn_bc) {
+            ret = avio_open_dyn_buf(&mkv->dyn_bc);
+            if (ret < 0)
+                return ret;
+        }
         pb = mkv->dyn_bc;
     }
 
@@ -1304,7 +1312,7 @@ static int mkv_write_packet(AVFormatContext *s, AVPacket *pkt)
 
     // start a new cluster every 5 MB or 5 sec, or 32k / 1 sec for streaming or
     // after 4k and on a keyframe
-    if (s->pb->seekable) {
+    if (s->pb->seekable && !mkv->is_live) {
         pb = s->pb;
         cluster_size = avio_tell(pb) - mkv->cluster_pos;
     } else {
@@ -1355,7 +1363,7 @@ static int mkv_write_flush_packet(AVFormatContext *s, AVPacket *pkt)
 {
     MatroskaMuxContext *mkv = s->priv_data;
     AVIOContext *pb;
-    if (s->pb->seekable)
+    if (s->pb->seekable && !mkv->is_live)
         pb = s->pb;
     else
         pb = mkv->dyn_bc;
@@ -1473,6 +1481,7 @@ static const AVOption options[] = {
     { "reserve_index_space", "Reserve a given amount of space (in bytes) at the beginning of the file for the index (cues).", OFFSET(reserve_cues_space), AV_OPT_TYPE_INT,   { .i64 = 0 },   0, INT_MAX,   FLAGS },
     { "cluster_size_limit",  "Store at most the provided amount of bytes in a cluster. ",                                     OFFSET(cluster_size_limit), AV_OPT_TYPE_INT  , { .i64 = -1 }, -1, INT_MAX,   FLAGS },
     { "cluster_time_limit",  "Store at most the provided number of milliseconds in a cluster.",                               OFFSET(cluster_time_limit), AV_OPT_TYPE_INT64, { .i64 = -1 }, -1, INT64_MAX, FLAGS },
+    { "live",                "Write buffered clusters of known size without seeking back, as for a live stream.",             OFFSET(is_live),            AV_OPT_TYPE_INT,   { .i64 = 0 },   0, 1,         FLAGS },
     { NULL },
 };
 
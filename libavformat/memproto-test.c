@@ -0,0 +1,188 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/mathematics.h"
+#include "avformat.h"
+#include "url.h"
+
+#define MEM_FILE "mem:memproto-test.nut"
+
+/* remux all the packets of the input file to an in-memory nut file */
+static int remux(const char *filename)
+{
+    AVFormatContext *ic = NULL, *oc = NULL;
+    AVPacket pkt;
+    int i, ret;
+
+    if ((ret = avformat_open_input(&ic, filename, NULL, NULL)) < 0 ||
+        (ret = avformat_find_stream_info(ic, NULL)) < 0)
+        goto end;
+    if (!(oc = avformat_alloc_context())) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    oc->oformat = av_guess_format("nut", NULL, NULL);
+
+    for (i = 0; i < ic->nb_streams; i++) {
+        AVStream *st = avformat_new_stream(oc, NULL);
+        if (!st) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        if ((ret = avcodec_copy_context(st->codec, ic->streams[i]->codec)) < 0)
+            goto end;
+        st->codec->codec_tag = 0;
+        st->codec->time_base = ic->streams[i]->time_base;
+        st->time_base        = ic->streams[i]->time_base;
+    }
+
+    if ((ret = avio_open(&oc->pb, MEM_FILE, AVIO_FLAG_WRITE)) < 0 ||
+        (ret = avformat_write_header(oc, NULL)) < 0)
+        goto end;
+    while ((ret = av_read_frame(ic, &pkt)) >= 0) {
+        AVRational tb = oc->streams[pkt.stream_index]->time_base;
+        AVRational in = ic->streams[pkt.stream_index]->time_base;
+
+        pkt.pts = av_rescale_q(pkt.pts, in, tb);
+        pkt.dts = av_rescale_q(pkt.dts, in, tb);
+        ret = av_interleaved_write_frame(oc, &pkt);
+        av_free_packet(&pkt);
+        if (ret < 0)
+            goto end;
+    }
+    ret = av_write_trailer(oc);
+
+end:
+    if (oc) {
+        avio_close(oc->pb);
+        avformat_free_context(oc);
+    }
+    avformat_close_input(&ic);
+    return ret == AVERROR_EOF ? 0 : ret;
+}
+
+/* check that the in-memory file has the same packets as the input file */
+static int compare(const char *filename, int *nb_packets)
+{
+    AVFormatContext *ic[2] = { NULL };
+    AVPacket pkt[2];
+    int ret, diff = 0;
+
+    *nb_packets = 0;
+    if ((ret = avformat_open_input(&ic[0], filename, NULL, NULL)) < 0 ||
+        (ret = avformat_open_input(&ic[1], MEM_FILE, NULL, NULL)) < 0)
+        goto end;
+
+    for (;;) {
+        int ret0 = av_read_frame(ic[0], &pkt[0]);
+        int ret1 = av_read_frame(ic[1], &pkt[1]);
+
+        if (ret0 < 0 || ret1 < 0) {
+            diff |= (ret0 < 0) != (ret1 < 0);
+            if (ret0 >= 0)
+                av_free_packet(&pkt[0]);
+            if (ret1 >= 0)
+                av_free_packet(&pkt[1]);
+            break;
+        }
+        diff |= pkt[0].stream_index != pkt[1].stream_index ||
+                pkt[0].size         != pkt[1].size         ||
+                memcmp(pkt[0].data, pkt[1].data, pkt[0].size);
+        if (!diff)
+            diff |= av_rescale_q(pkt[0].dts,
+                                 ic[0]->streams[pkt[0].stream_index]->time_base,
+                                 ic[1]->streams[pkt[1].stream_index]->time_base) !=
+                    pkt[1].dts;
+        (*nb_packets)++;
+        av_free_packet(&pkt[0]);
+        av_free_packet(&pkt[1]);
+    }
+    ret = diff;
+
+end:
+    avformat_close_input(&ic[0]);
+    avformat_close_input(&ic[1]);
+    return ret;
+}
+
+static int write_file(AVIOContext **pb, const char *data)
+{
+    int ret = avio_open(pb, MEM_FILE, AVIO_FLAG_WRITE);
+    if (ret >= 0)
+        avio_write(*pb, data, strlen(data));
+    return ret;
+}
+
+static const char *read_file(char *buf, int size)
+{
+    AVIOContext *pb;
+    int len;
+
+    if (avio_open(&pb, MEM_FILE, AVIO_FLAG_READ) < 0)
+        return "(none)";
+    len = avio_read(pb, buf, size - 1);
+    buf[FFMAX(len, 0)] = 0;
+    avio_close(pb);
+    return buf;
+}
+
+int main(int argc, char **argv)
+{
+    AVIOContext *reader, *writer;
+    char buf[16];
+    int ret, nb_packets;
+
+    if (argc < 2) {
+        printf("usage: %s input_file\n", argv[0]);
+        return 1;
+    }
+
+    av_register_all();
+
+    if ((ret = remux(argv[1])) < 0) {
+        printf("remux failed\n");
+        return 1;
+    }
+    ret = compare(argv[1], &nb_packets);
+    printf("read back %d packets: %s\n", nb_packets,
+           ret < 0 ? "failed" : ret ? "different" : "same");
+
+    /* a file being read is not affected when it is replaced */
+    if (avio_open(&reader, MEM_FILE, AVIO_FLAG_READ) < 0)
+        return 1;
+    if (write_file(&writer, "first") < 0)
+        return 1;
+    printf("while written: %.3s\n", read_file(buf, sizeof(buf)));
+    avio_close(writer);
+    printf("once closed: %s\n", read_file(buf, sizeof(buf)));
+    avio_read(reader, buf, 3);
+    printf("opened before: %.3s\n", buf);
+    avio_close(reader);
+
+    if (write_file(&writer, "second") < 0)
+        return 1;
+    avio_close(writer);
+    printf("replaced: %s\n", read_file(buf, sizeof(buf)));
+
+    ret = ff_mem_protocol_unlink(MEM_FILE);
+    printf("unlink: %d, after unlink: %s\n", ret, read_file(buf, sizeof(buf)));
+    return 0;
+}
@@ -0,0 +1,225 @@
+/*
+ * In-memory files protocol
+ *
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * In-memory files protocol
+ *
+ * Files are shared by the whole process, e.g. a muxer can write them and
+ * a server in the same process read them. A file being written is private
+ * until it is closed, it then replaces the previous file of the same name
+ * at once. Readers keep a reference to the data they opened, so that a
+ * file can be replaced or removed while it is read.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/buffer.h"
+#include "libavutil/common.h"
+#include "libavutil/mem.h"
+#include "avformat.h"
+#include "url.h"
+
+typedef struct MemFile {
+    char *name;
+    AVBufferRef *data;
+    struct MemFile *next;
+} MemFile;
+
+static MemFile *mem_files;
+static pthread_mutex_t mem_files_lock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct MemContext {
+    AVBufferRef *data;      ///< the file being read
+    uint8_t *buf;           ///< the file being written
+    int size;
+    int allocated;
+    int pos;
+} MemContext;
+
+static const char *mem_name(const char *url)
+{
+    av_strstart(url, "mem:", &url);
+    return url;
+}
+
+/* must be called with the lock held */
+static MemFile **find_file(const char *name)
+{
+    MemFile **f;
+
+    for (f = &mem_files; *f; f = &(*f)->next)
+        if (!strcmp((*f)->name, name))
+            break;
+    return f;
+}
+
+int ff_mem_protocol_unlink(const char *url)
+{
+    const char *name = mem_name(url);
+    MemFile **f, *file;
+
+    pthread_mutex_lock(&mem_files_lock);
+    f = find_file(name);
+    if ((file = *f))
+        *f = file->next;
+    pthread_mutex_unlock(&mem_files_lock);
+
+    if (!file)
+        return AVERROR(ENOENT);
+    av_buffer_unref(&file->data);
+    av_free(file->name);
+    av_free(file);
+    return 0;
+}
+
+static int mem_open(URLContext *h, const char *url, int flags)
+{
+    MemContext *c = h->priv_data;
+    const char *name = mem_name(url);
+    MemFile *file;
+
+    if (!*name)
+        return AVERROR(EINVAL);
+    if ((flags & AVIO_FLAG_READ_WRITE) == AVIO_FLAG_READ_WRITE) {
+        av_log(h, AV_LOG_ERROR, "Simultaneous reading and writing "
+               "is not supported\n");
+        return AVERROR(ENOSYS);
+    }
+    if (flags & AVIO_FLAG_WRITE)
+        return 0;
+
+    pthread_mutex_lock(&mem_files_lock);
+    file = *find_file(name);
+    if (file)
+        c->data = av_buffer_ref(file->data);
+    pthread_mutex_unlock(&mem_files_lock);
+
+    if (!file)
+        return AVERROR(ENOENT);
+    return c->data ? 0 : AVERROR(ENOMEM);
+}
+
+static int mem_read(URLContext *h, unsigned char *buf, int size)
+{
+    MemContext *c = h->priv_data;
+
+    size = FFMIN(size, c->data->size - c->pos);
+    if (size <= 0)
+        return AVERROR_EOF;
+    memcpy(buf, c->data->data + c->pos, size);
+    c->pos += size;
+    return size;
+}
+
+static int mem_write(URLContext *h, const unsigned char *buf, int size)
+{
+    MemContext *c = h->priv_data;
+    int ret;
+
+    if (size > INT_MAX / 2 - c->pos)
+        return AVERROR(ENOMEM);
+    if (c->pos + size > c->allocated) {
+        int allocated = FFMAX(c->pos + size, 2 * c->allocated);
+        if ((ret = av_reallocp(&c->buf, allocated)) < 0) {
+            c->size = c->allocated = 0;
+            return ret;
+        }
+        c->allocated = allocated;
+    }
+    memcpy(c->buf + c->pos, buf, size);
+    c->pos += size;
+    c->size = FFMAX(c->size, c->pos);
+    return size;
+}
+
+static int64_t mem_seek(URLContext *h, int64_t pos, int whence)
+{
+    MemContext *c = h->priv_data;
+    int size = c->data ? c->data->size : c->size;
+
+    if (whence == AVSEEK_SIZE)
+        return size;
+    if (whence == SEEK_CUR)
+        pos += c->pos;
+    else if (whence == SEEK_END)
+        pos += size;
+    else if (whence != SEEK_SET)
+        return AVERROR(EINVAL);
+    if (pos < 0 || pos > size)
+        return AVERROR(EINVAL);
+    return c->pos = pos;
+}
+
+static int mem_close(URLContext *h)
+{
+    MemContext *c = h->priv_data;
+    MemFile **f, *file;
+    AVBufferRef *data;
+
+    if (!(h->flags & AVIO_FLAG_WRITE)) {
+        av_buffer_unref(&c->data);
+        return 0;
+    }
+
+    /* publish the file, replacing the previous one */
+    if (!c->buf && !(c->buf = av_malloc(1)))
+        return AVERROR(ENOMEM);
+    data = av_buffer_create(c->buf, c->size, av_buffer_default_free, NULL, 0);
+    if (!data) {
+        av_freep(&c->buf);
+        return AVERROR(ENOMEM);
+    }
+    c->buf = NULL;
+
+    pthread_mutex_lock(&mem_files_lock);
+    f = find_file(mem_name(h->filename));
+    if ((file = *f)) {
+        FFSWAP(AVBufferRef *, file->data, data);
+    } else if ((file = av_mallocz(sizeof(*file))) &&
+               (file->name = av_strdup(mem_name(h->filename)))) {
+        file->data = data;
+        data       = NULL;
+        *f         = file;
+    } else {
+        av_freep(&file);
+    }
+    pthread_mutex_unlock(&mem_files_lock);
+
+    if (!file) {
+        av_buffer_unref(&data);
+        return AVERROR(ENOMEM);
+    }
+    /* the previous data of the file */
+    av_buffer_unref(&data);
+    return 0;
+}
+
+URLProtocol ff_mem_protocol = {
+    .name           = "mem",
+    .url_open       = mem_open,
+    .url_read       = mem_read,
+    .url_write      = mem_write,
+    .url_seek       = mem_seek,
+    .url_close      = mem_close,
+    .priv_data_size = sizeof(MemContext),
+};
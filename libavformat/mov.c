@@ -35,6 +35,7 @@
 #include "libavutil/mathematics.h"
 #include "libavutil/avstring.h"
 #include "libavutil/dict.h"
+#include "libavutil/opt.h"
 #include "libavcodec/ac3tab.h"
 #include "avformat.h"
 #include "internal.h"
@@ -1658,6 +1659,16 @@ static int mov_read_stsz(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         return 0;
     if (entries >= UINT_MAX / sizeof(int) || entries >= (UINT_MAX - 4) / field_size)
         return AVERROR_INVALIDDATA;
+
+    /* keep the table in the file, it is read in windows while demuxing */
+    if (c->lazy_index && pb->seekable && field_size >= 8) {
+        sc->stsz_pb         = pb;
+        sc->stsz_offset     = avio_tell(pb);
+        sc->stsz_field_size = field_size;
+        sc->sample_count    = FFMIN(entries, FFMAX(atom.size - 12, 0) / (field_size >> 3));
+        return 0;
+    }
+
     sc->sample_sizes = av_malloc(entries * sizeof(int));
     if (!sc->sample_sizes)
         return AVERROR(ENOMEM);
@@ -1839,6 +1850,427 @@ static int mov_read_sbgp(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     return pb->eof_reached ? AVERROR_EOF : 0;
 }
 
+/**
+ * Move the cursor to the first sample of the given chunk, skipping
+ * chunks which contain no samples.
+ */
+static void mov_cursor_enter_chunk(MOVStreamContext *sc, MOVSampleCursor *cur,
+                                   unsigned int chunk)
+{
+    for (; chunk < sc->chunk_count; chunk++) {
+        while (cur->stsc_index + 1 < sc->stsc_count &&
+               chunk + 1 == sc->stsc_data[cur->stsc_index + 1].first)
+            cur->stsc_index++;
+        if (sc->stsc_data[cur->stsc_index].count > 0)
+            break;
+    }
+    cur->chunk        = chunk;
+    cur->chunk_sample = 0;
+    if (chunk < sc->chunk_count)
+        cur->pos = sc->chunk_offsets[chunk];
+}
+
+/**
+ * Walk the stsc runs to the chunk containing the given sample.
+ * @return number of the first sample in the chunk the cursor points at,
+ *         or the total number of samples described by the chunk tables
+ *         if the sample lies beyond them
+ */
+static unsigned int mov_cursor_find_chunk(MOVStreamContext *sc, MOVSampleCursor *cur,
+                                          unsigned int sample)
+{
+    unsigned int first = 0;
+
+    cur->stsc_index = 0;
+    mov_cursor_enter_chunk(sc, cur, 0);
+    while (cur->chunk < sc->chunk_count) {
+        const MOVStsc *stsc = &sc->stsc_data[cur->stsc_index];
+        int64_t end = sc->chunk_count;
+        uint64_t run;
+
+        if (cur->stsc_index + 1 < sc->stsc_count &&
+            (int64_t)stsc[1].first - 1 > cur->chunk)
+            end = FFMIN(end, stsc[1].first - 1);
+        run = (uint64_t)(end - cur->chunk) * stsc->count;
+        if (first + run > sample) {
+            unsigned int skip = (sample - first) / stsc->count;
+            first += skip * stsc->count;
+            mov_cursor_enter_chunk(sc, cur, cur->chunk + skip);
+            break;
+        }
+        first = FFMIN(first + run, UINT_MAX);
+        mov_cursor_enter_chunk(sc, cur, end);
+    }
+    return first;
+}
+
+/**
+ * Index of the first entry of a sorted sample number table which is not
+ * smaller than value.
+ */
+static unsigned int mov_lower_bound(const unsigned int *tab, unsigned int count,
+                                    unsigned int value)
+{
+    unsigned int a = 0, b = count;
+
+    while (a < b) {
+        unsigned int m = (a + b) >> 1;
+        if (tab[m] < value)
+            a = m + 1;
+        else
+            b = m;
+    }
+    return a;
+}
+
+#define MOV_SAMPLE_SIZES_WINDOW 4096
+
+/**
+ * Read the sizes of count samples starting at start from a sample size
+ * table which is kept in the file.
+ */
+static int mov_load_sample_sizes(MOVStreamContext *sc, unsigned int start,
+                                 unsigned int count)
+{
+    AVIOContext *pb = sc->stsz_pb;
+    int64_t pos = avio_tell(pb);
+    int bytes = sc->stsz_field_size >> 3;
+    unsigned int i;
+    uint8_t *buf;
+    int ret = 0;
+
+    count = FFMIN(count, sc->sample_count - start);
+    if (count > INT_MAX / bytes)
+        return AVERROR_INVALIDDATA;
+    if ((ret = av_reallocp_array(&sc->sample_sizes, count,
+                                 sizeof(*sc->sample_sizes))) < 0)
+        goto fail;
+    if (!(buf = av_malloc(count * bytes))) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    if (avio_seek(pb, sc->stsz_offset + (int64_t)start * bytes, SEEK_SET) < 0 ||
+        avio_read(pb, buf, count * bytes) != count * bytes)
+        ret = AVERROR_INVALIDDATA;
+    else
+        for (i = 0; i < count; i++)
+            sc->sample_sizes[i] = bytes == 1 ? buf[i] :
+                                  bytes == 2 ? AV_RB16(buf + 2 * i) :
+                                               AV_RB32(buf + 4 * i);
+    av_free(buf);
+    avio_seek(pb, pos, SEEK_SET);
+
+fail:
+    sc->sample_sizes_start = start;
+    sc->sample_sizes_count = ret < 0 ? 0 : count;
+    return ret;
+}
+
+/**
+ * Size of a sample from the sample size table.
+ */
+static unsigned int mov_get_sample_size(MOVStreamContext *sc, unsigned int sample)
+{
+    if (!sc->stsz_pb)
+        return sc->sample_sizes[sample];
+    if (sample - sc->sample_sizes_start >= sc->sample_sizes_count &&
+        mov_load_sample_sizes(sc, sample, MOV_SAMPLE_SIZES_WINDOW) < 0)
+        return 0;
+    return sc->sample_sizes[sample - sc->sample_sizes_start];
+}
+
+/**
+ * Fill the index entry of the sample the cursor points at.
+ */
+static void mov_cursor_load(MOVStreamContext *sc, MOVSampleCursor *cur)
+{
+    unsigned int sample = cur->sample + sc->lazy_key_off;
+    int keyframe = 0;
+
+    if (!sc->keyframe_absent && (!sc->keyframe_count ||
+                                 sample == sc->keyframes[cur->stss_index]))
+        keyframe = 1;
+    else if (sc->stps_count && sample == sc->stps_data[cur->stps_index])
+        keyframe = 1;
+    if (sc->rap_group_count && sc->rap_group &&
+        cur->rap_group_index < sc->rap_group_count &&
+        sc->rap_group[cur->rap_group_index].index > 0)
+        keyframe = 1;
+
+    cur->entry.pos          = cur->pos;
+    cur->entry.timestamp    = cur->dts;
+    cur->entry.size         = sc->sample_size > 0 ? sc->sample_size :
+                                                    mov_get_sample_size(sc, cur->sample);
+    cur->entry.min_distance = keyframe ? 0 : cur->distance;
+    cur->entry.flags        = keyframe ? AVINDEX_KEYFRAME : 0;
+}
+
+/**
+ * Position the cursor on an arbitrary sample, resolving its offset and
+ * timestamp from the sample tables.
+ */
+static void mov_cursor_seek(MOVStreamContext *sc, MOVSampleCursor *cur,
+                            unsigned int sample)
+{
+    unsigned int i, first, n;
+
+    memset(cur, 0, sizeof(*cur));
+    cur->dts    = sc->lazy_start_dts;
+    cur->sample = sample;
+    if (sample >= sc->lazy_sample_count)
+        return;
+
+    first = mov_cursor_find_chunk(sc, cur, sample);
+    cur->chunk_sample = sample - first;
+    if (sc->sample_size > 0)
+        cur->pos += (int64_t)cur->chunk_sample * sc->sample_size;
+    else
+        for (i = first; i < sample; i++)
+            cur->pos += mov_get_sample_size(sc, i);
+
+    for (i = 0, n = sample; i < sc->stts_count; i++) {
+        if (i + 1 == sc->stts_count || n < sc->stts_data[i].count) {
+            cur->stts_index  = i;
+            cur->stts_sample = n;
+            cur->dts += (int64_t)n * sc->stts_data[i].duration;
+            break;
+        }
+        cur->dts += (int64_t)sc->stts_data[i].count * sc->stts_data[i].duration;
+        n        -= sc->stts_data[i].count;
+    }
+
+    if (sc->keyframe_count)
+        cur->stss_index = FFMIN(mov_lower_bound((const unsigned int *)sc->keyframes,
+                                                sc->keyframe_count,
+                                                sample + sc->lazy_key_off),
+                                sc->keyframe_count - 1);
+    if (sc->stps_count)
+        cur->stps_index = FFMIN(mov_lower_bound(sc->stps_data, sc->stps_count,
+                                                sample + sc->lazy_key_off),
+                                sc->stps_count - 1);
+    if (sc->rap_group_count && sc->rap_group) {
+        for (i = 0, n = sample; i < sc->rap_group_count; i++) {
+            if (n < sc->rap_group[i].count)
+                break;
+            n -= sc->rap_group[i].count;
+        }
+        cur->rap_group_index  = i;
+        cur->rap_group_sample = i < sc->rap_group_count ? n : 0;
+    }
+
+    /* the distance to the previous keyframe is not tracked across seeks */
+    mov_cursor_load(sc, cur);
+}
+
+/**
+ * Advance the cursor to the next sample in decoding order.
+ */
+static void mov_cursor_next(MOVStreamContext *sc, MOVSampleCursor *cur)
+{
+    unsigned int sample = cur->sample + sc->lazy_key_off;
+
+    if (cur->sample >= sc->lazy_sample_count)
+        return;
+
+    if (!sc->keyframe_absent && (!sc->keyframe_count ||
+                                 sample == sc->keyframes[cur->stss_index])) {
+        if (cur->stss_index + 1 < sc->keyframe_count)
+            cur->stss_index++;
+    } else if (sc->stps_count && sample == sc->stps_data[cur->stps_index]) {
+        if (cur->stps_index + 1 < sc->stps_count)
+            cur->stps_index++;
+    }
+    if (sc->rap_group_count && sc->rap_group &&
+        cur->rap_group_index < sc->rap_group_count &&
+        ++cur->rap_group_sample == sc->rap_group[cur->rap_group_index].count) {
+        cur->rap_group_sample = 0;
+        cur->rap_group_index++;
+    }
+
+    cur->distance = cur->entry.min_distance + 1;
+    cur->pos     += cur->entry.size;
+    cur->dts     += sc->stts_data[cur->stts_index].duration;
+    cur->stts_sample++;
+    if (cur->stts_index + 1 < sc->stts_count &&
+        cur->stts_sample == sc->stts_data[cur->stts_index].count) {
+        cur->stts_sample = 0;
+        cur->stts_index++;
+    }
+
+    cur->sample++;
+    if (++cur->chunk_sample >= sc->stsc_data[cur->stsc_index].count)
+        mov_cursor_enter_chunk(sc, cur, cur->chunk + 1);
+    if (cur->chunk >= sc->chunk_count)
+        sc->lazy_sample_count = FFMIN(sc->lazy_sample_count, cur->sample);
+    if (cur->sample < sc->lazy_sample_count)
+        mov_cursor_load(sc, cur);
+}
+
+/**
+ * Equivalent of av_index_search_timestamp() working on the sample tables.
+ */
+static int mov_lazy_search_timestamp(MOVStreamContext *sc, int64_t timestamp,
+                                     int flags)
+{
+    int backward = flags & AVSEEK_FLAG_BACKWARD;
+    int64_t dts = sc->lazy_start_dts, sample = -1, sample_dts = 0;
+    unsigned int i, first = 0;
+
+    if (!sc->lazy_sample_count)
+        return -1;
+
+    if (timestamp >= dts) {
+        for (i = 0; i < sc->stts_count && first < sc->lazy_sample_count; i++) {
+            unsigned int count = sc->lazy_sample_count - first;
+            int duration = sc->stts_data[i].duration;
+
+            if (i + 1 < sc->stts_count)
+                count = FFMIN(count, FFMAX(sc->stts_data[i].count, 0));
+            if (!count)
+                continue;
+            if (timestamp < dts + (int64_t)count * duration) {
+                sample     = first + (timestamp - dts) / duration;
+                sample_dts = dts + (sample - first) * duration;
+                break;
+            }
+            dts   += (int64_t)count * duration;
+            first += count;
+            sample     = first - 1;
+            sample_dts = dts - duration;
+        }
+    }
+    if (!backward && (sample < 0 || sample_dts != timestamp))
+        sample++;
+    if (sample < 0 || sample >= sc->lazy_sample_count)
+        return -1;
+
+    if (!(flags & AVSEEK_FLAG_ANY)) {
+        int64_t key = backward ? -1 : INT64_MAX;
+        unsigned int k;
+
+        if (!sc->keyframe_absent && !sc->keyframe_count)
+            return sample;
+        if (sc->keyframe_count) {
+            const unsigned int *tab = (const unsigned int *)sc->keyframes;
+            k = mov_lower_bound(tab, sc->keyframe_count,
+                                sample + sc->lazy_key_off + !!backward);
+            if (backward && k > 0)
+                key = FFMAX(key, (int64_t)tab[k - 1] - sc->lazy_key_off);
+            else if (!backward && k < sc->keyframe_count)
+                key = FFMIN(key, (int64_t)tab[k] - sc->lazy_key_off);
+        }
+        if (sc->stps_count) {
+            k = mov_lower_bound(sc->stps_data, sc->stps_count,
+                                sample + sc->lazy_key_off + !!backward);
+            if (backward && k > 0)
+                key = FFMAX(key, (int64_t)sc->stps_data[k - 1] - sc->lazy_key_off);
+            else if (!backward && k < sc->stps_count)
+                key = FFMIN(key, (int64_t)sc->stps_data[k] - sc->lazy_key_off);
+        }
+        if (sc->rap_group_count && sc->rap_group) {
+            int64_t start = 0;
+            for (i = 0; i < sc->rap_group_count; i++) {
+                int64_t end = start + sc->rap_group[i].count;
+                if (sc->rap_group[i].index > 0 && sc->rap_group[i].count) {
+                    if (backward && start <= sample)
+                        key = FFMAX(key, FFMIN(sample, end - 1));
+                    else if (!backward && end > sample)
+                        key = FFMIN(key, FFMAX(sample, start));
+                }
+                start = end;
+            }
+        }
+        if (key < 0 || key >= sc->lazy_sample_count)
+            return -1;
+        sample = key;
+    }
+    return sample;
+}
+
+/**
+ * Keep the compact sample tables of a track and resolve samples on demand
+ * instead of expanding them into AVStream.index_entries.
+ */
+static void mov_lazy_index_init(MOVContext *mov, AVStream *st,
+                                 int64_t start_dts, int key_off)
+{
+    MOVStreamContext *sc = st->priv_data;
+    MOVSampleCursor cur = { 0 };
+    uint64_t stream_size = 0;
+    unsigned int i, chunk_samples;
+
+    sc->lazy_index        = 1;
+    sc->lazy_start_dts    = start_dts;
+    sc->lazy_key_off      = key_off;
+    chunk_samples         = mov_cursor_find_chunk(sc, &cur, UINT_MAX);
+    sc->lazy_sample_count = FFMIN(sc->sample_count, chunk_samples);
+    /* as mov_build_index() does, when the chunks describe more samples */
+    if (chunk_samples > sc->sample_count)
+        av_log(mov->fc, AV_LOG_ERROR, "wrong sample count\n");
+
+    /* the sizes read on demand are not summed, that would read them all */
+    if (sc->sample_size > 0)
+        stream_size = (uint64_t)sc->lazy_sample_count * sc->sample_size;
+    else if (sc->lazy_sample_count == sc->sample_count)
+        stream_size = sc->data_size;
+    else if (!sc->stsz_pb)
+        for (i = 0; i < sc->lazy_sample_count; i++)
+            stream_size += sc->sample_sizes[i];
+    if (st->duration > 0 && stream_size)
+        st->codec->bit_rate = stream_size*8*sc->time_scale/st->duration;
+
+    mov_cursor_seek(sc, &sc->cursor, 0);
+}
+
+static void mov_free_sample_tables(MOVStreamContext *sc)
+{
+    av_freep(&sc->chunk_offsets);
+    av_freep(&sc->stsc_data);
+    av_freep(&sc->sample_sizes);
+    av_freep(&sc->keyframes);
+    av_freep(&sc->stts_data);
+    av_freep(&sc->stps_data);
+    av_freep(&sc->rap_group);
+}
+
+/**
+ * Expand the sample tables of a lazily indexed track into
+ * AVStream.index_entries, needed e.g. when movie fragments follow.
+ */
+static int mov_expand_lazy_index(MOVContext *mov, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    MOVSampleCursor cur;
+    int ret;
+
+    if (!sc->lazy_index)
+        return 0;
+
+    if (sc->lazy_sample_count >= UINT_MAX / sizeof(*st->index_entries) - st->nb_index_entries)
+        return AVERROR_INVALIDDATA;
+    if ((ret = av_reallocp_array(&st->index_entries,
+                                 st->nb_index_entries + sc->lazy_sample_count,
+                                 sizeof(*st->index_entries))) < 0) {
+        st->nb_index_entries = 0;
+        return ret;
+    }
+    st->index_entries_allocated_size = (st->nb_index_entries + sc->lazy_sample_count) *
+                                       sizeof(*st->index_entries);
+
+    for (mov_cursor_seek(sc, &cur, 0); cur.sample < sc->lazy_sample_count;
+         mov_cursor_next(sc, &cur)) {
+        st->index_entries[st->nb_index_entries++] = cur.entry;
+        if (sc->stsz_pb)
+            sc->data_size += cur.entry.size;
+    }
+
+    sc->lazy_index = 0;
+    sc->stsz_pb    = NULL;
+    mov_free_sample_tables(sc);
+    return 0;
+}
+
 static void mov_build_index(MOVContext *mov, AVStream *st)
 {
     MOVStreamContext *sc = st->priv_data;
@@ -1881,8 +2313,19 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
 
         if (!sc->sample_count)
             return;
+        if (mov->lazy_index && sc->pseudo_stream_id == -1) {
+            mov_lazy_index_init(mov, st, current_dts, key_off);
+            return;
+        }
         if (sc->sample_count >= UINT_MAX / sizeof(*st->index_entries) - st->nb_index_entries)
             return;
+        if (sc->stsz_pb) {
+            if (mov_load_sample_sizes(sc, 0, sc->sample_count) < 0)
+                return;
+            for (i = 0; i < sc->sample_count; i++)
+                sc->data_size += sc->sample_sizes[i];
+            sc->stsz_pb = NULL;
+        }
         if (av_reallocp_array(&st->index_entries,
                               st->nb_index_entries + sc->sample_count,
                               sizeof(*st->index_entries)) < 0) {
@@ -2163,14 +2606,9 @@ static int mov_read_trak(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         break;
     }
 
-    /* Do not need those anymore. */
-    av_freep(&sc->chunk_offsets);
-    av_freep(&sc->stsc_data);
-    av_freep(&sc->sample_sizes);
-    av_freep(&sc->keyframes);
-    av_freep(&sc->stts_data);
-    av_freep(&sc->stps_data);
-    av_freep(&sc->rap_group);
+    /* Do not need those anymore, unless samples are resolved from them. */
+    if (!sc->lazy_index)
+        mov_free_sample_tables(sc);
 
     return 0;
 }
@@ -2368,6 +2806,8 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     sc = st->priv_data;
     if (sc->pseudo_stream_id+1 != frag->stsd_id)
         return 0;
+    if ((err = mov_expand_lazy_index(c, st)) < 0)
+        return err;
     avio_r8(pb); /* version */
     flags = avio_rb24(pb);
     entries = avio_rb32(pb);
@@ -2760,6 +3200,8 @@ static void mov_read_chapters(AVFormatContext *s)
 
     st->discard = AVDISCARD_ALL;
     sc = st->priv_data;
+    if (mov_expand_lazy_index(mov, st) < 0)
+        return;
     cur_pos = avio_tell(sc->pb);
 
     for (i = 0; i < st->nb_index_entries; i++) {
@@ -2827,13 +3269,7 @@ static int mov_read_close(AVFormatContext *s)
         if (sc->pb && sc->pb != s->pb)
             avio_close(sc->pb);
 
-        av_freep(&sc->chunk_offsets);
-        av_freep(&sc->stsc_data);
-        av_freep(&sc->sample_sizes);
-        av_freep(&sc->keyframes);
-        av_freep(&sc->stts_data);
-        av_freep(&sc->stps_data);
-        av_freep(&sc->rap_group);
+        mov_free_sample_tables(sc);
     }
 
     if (mov->dv_demux) {
@@ -2901,8 +3337,10 @@ static AVIndexEntry *mov_find_next_sample(AVFormatContext *s, AVStream **st)
     for (i = 0; i < s->nb_streams; i++) {
         AVStream *avst = s->streams[i];
         MOVStreamContext *msc = avst->priv_data;
-        if (msc->pb && msc->current_sample < avst->nb_index_entries) {
-            AVIndexEntry *current_sample = &avst->index_entries[msc->current_sample];
+        if (msc->pb && msc->current_sample < (msc->lazy_index ? msc->lazy_sample_count :
+                                                                avst->nb_index_entries)) {
+            AVIndexEntry *current_sample = msc->lazy_index ? &msc->cursor.entry :
+                                           &avst->index_entries[msc->current_sample];
             int64_t dts = av_rescale(current_sample->timestamp, AV_TIME_BASE, msc->time_scale);
             av_dlog(s, "stream %d, sample %d, dts %"PRId64"\n", i, msc->current_sample, dts);
             if (!sample || (!s->pb->seekable && current_sample->pos < sample->pos) ||
@@ -2923,7 +3361,7 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
 {
     MOVContext *mov = s->priv_data;
     MOVStreamContext *sc;
-    AVIndexEntry *sample;
+    AVIndexEntry *sample, lazy_sample;
     AVStream *st = NULL;
     int ret;
  retry:
@@ -2941,6 +3379,12 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
         goto retry;
     }
     sc = st->priv_data;
+    if (sc->lazy_index) {
+        /* the cursor entry is overwritten when advancing */
+        lazy_sample = *sample;
+        sample      = &lazy_sample;
+        mov_cursor_next(sc, &sc->cursor);
+    }
     /* must be done just before reading, to avoid infinite loop on sample */
     sc->current_sample++;
 
@@ -2990,8 +3434,13 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
         if (sc->wrong_dts)
             pkt->dts = AV_NOPTS_VALUE;
     } else {
-        int64_t next_dts = (sc->current_sample < st->nb_index_entries) ?
-            st->index_entries[sc->current_sample].timestamp : st->duration;
+        int64_t next_dts;
+        if (sc->lazy_index)
+            next_dts = (sc->current_sample < sc->lazy_sample_count) ?
+                sc->cursor.entry.timestamp : st->duration;
+        else
+            next_dts = (sc->current_sample < st->nb_index_entries) ?
+                st->index_entries[sc->current_sample].timestamp : st->duration;
         pkt->duration = next_dts - pkt->dts;
         pkt->pts = pkt->dts;
     }
@@ -3010,12 +3459,22 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
     int sample, time_sample;
     int i;
 
-    sample = av_index_search_timestamp(st, timestamp, flags);
-    av_dlog(s, "stream %d, timestamp %"PRId64", sample %d\n", st->index, timestamp, sample);
-    if (sample < 0 && st->nb_index_entries && timestamp < st->index_entries[0].timestamp)
-        sample = 0;
-    if (sample < 0) /* not sure what to do */
-        return AVERROR_INVALIDDATA;
+    if (sc->lazy_index) {
+        sample = mov_lazy_search_timestamp(sc, timestamp, flags);
+        av_dlog(s, "stream %d, timestamp %"PRId64", sample %d\n", st->index, timestamp, sample);
+        if (sample < 0 && sc->lazy_sample_count && timestamp < sc->lazy_start_dts)
+            sample = 0;
+        if (sample < 0) /* not sure what to do */
+            return AVERROR_INVALIDDATA;
+        mov_cursor_seek(sc, &sc->cursor, sample);
+    } else {
+        sample = av_index_search_timestamp(st, timestamp, flags);
+        av_dlog(s, "stream %d, timestamp %"PRId64", sample %d\n", st->index, timestamp, sample);
+        if (sample < 0 && st->nb_index_entries && timestamp < st->index_entries[0].timestamp)
+            sample = 0;
+        if (sample < 0) /* not sure what to do */
+            return AVERROR_INVALIDDATA;
+    }
     sc->current_sample = sample;
     av_dlog(s, "stream %d, found sample %d\n", st->index, sc->current_sample);
     /* adjust ctts index */
@@ -3036,6 +3495,7 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
 
 static int mov_read_seek(AVFormatContext *s, int stream_index, int64_t sample_time, int flags)
 {
+    MOVStreamContext *sc;
     AVStream *st;
     int64_t seek_timestamp, timestamp;
     int sample;
@@ -3052,7 +3512,11 @@ static int mov_read_seek(AVFormatContext *s, int stream_index, int64_t sample_ti
         return sample;
 
     /* adjust seek timestamp to found sample timestamp */
-    seek_timestamp = st->index_entries[sample].timestamp;
+    sc = st->priv_data;
+    if (sc->lazy_index)
+        seek_timestamp = sc->cursor.entry.timestamp;
+    else
+        seek_timestamp = st->index_entries[sample].timestamp;
 
     for (i = 0; i < s->nb_streams; i++) {
         st = s->streams[i];
@@ -3065,6 +3529,19 @@ static int mov_read_seek(AVFormatContext *s, int stream_index, int64_t sample_ti
     return 0;
 }
 
+static const AVOption options[] = {
+    { "lazy_index", "Resolve samples from the sample tables on demand instead of building a full index.",
+      offsetof(MOVContext, lazy_index), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
+    { NULL },
+};
+
+static const AVClass mov_class = {
+    .class_name = "mov demuxer",
+    .item_name  = av_default_item_name,
+    .option     = options,
+    .version    = LIBAVUTIL_VERSION_INT,
+};
+
 AVInputFormat ff_mov_demuxer = {
     .name           = "mov,mp4,m4a,3gp,3g2,mj2",
     .long_name      = NULL_IF_CONFIG_SMALL("QuickTime / MOV"),
@@ -3074,4 +3551,5 @@ AVInputFormat ff_mov_demuxer = {
     .read_packet    = mov_read_packet,
     .read_close     = mov_read_close,
     .read_seek      = mov_read_seek,
+    .priv_class     = &mov_class,
 };
@@ -55,6 +55,7 @@ static const AVOption options[] = {
     { "isml", "Create a live smooth streaming feed (for pushing to a publishing point)", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_ISML}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "faststart", "Run a second pass to put the index (moov atom) at the beginning of the file", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_FASTSTART}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "omit_tfhd_offset", "Omit the base data offset in tfhd atoms", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_OMIT_TFHD_OFFSET}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
+    { "spill_index", "Keep only recent sample table entries in memory, storing older ones in a temporary file", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_SPILL_INDEX}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     FF_RTP_FLAG_OPTS(MOVMuxContext, rtp_flags),
     { "skip_iods", "Skip writing iods atom.", offsetof(MOVMuxContext, iods_skip), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 1, AV_OPT_FLAG_ENCODING_PARAM},
     { "iods_audio_profile", "iods audio profile atom.", offsetof(MOVMuxContext, iods_audio_profile), AV_OPT_TYPE_INT, {.i64 = -1}, -1, 255, AV_OPT_FLAG_ENCODING_PARAM},
@@ -62,7 +63,9 @@ static const AVOption options[] = {
     { "frag_duration", "Maximum fragment duration", offsetof(MOVMuxContext, max_fragment_duration), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM},
     { "min_frag_duration", "Minimum fragment duration", offsetof(MOVMuxContext, min_fragment_duration), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM},
     { "frag_size", "Maximum fragment size", offsetof(MOVMuxContext, max_fragment_size), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM},
+    { "chunk_duration", "Write fragments as moof/mdat chunks of at most this duration", offsetof(MOVMuxContext, chunk_duration), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM},
     { "ism_lookahead", "Number of lookahead entries for ISM files", offsetof(MOVMuxContext, ism_lookahead), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM},
+    { "reserve_moov_size", "Reserve space (in bytes) at the beginning of the file for the moov atom", offsetof(MOVMuxContext, reserved_moov_size), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM},
     { NULL },
 };
 
@@ -85,9 +88,90 @@ static int64_t update_size(AVIOContext *pb, int64_t pos)
     return curpos - pos;
 }
 
-static int co64_required(const MOVTrack *track)
+/*
+ * With the spill_index flag, the sample table entries of a track are
+ * written to a temporary file in blocks of MOV_INDEX_CLUSTER_SIZE, and
+ * only the block currently being filled is kept in track->cluster.
+ */
+static int mov_spill_write(MOVTrack *track, const MOVIentry *entries, int start)
 {
-    if (track->entry > 0 && track->cluster[track->entry - 1].pos + track->data_offset > UINT32_MAX)
+    if (fseek(track->spill_file, (long)start * sizeof(*entries), SEEK_SET) ||
+        fwrite(entries, sizeof(*entries), MOV_INDEX_CLUSTER_SIZE,
+               track->spill_file) != MOV_INDEX_CLUSTER_SIZE)
+        return track->spill_error = AVERROR(EIO);
+    return 0;
+}
+
+static int mov_spill_cluster(MOVTrack *track)
+{
+    int ret;
+
+    if (!track->spill_file) {
+        if (!(track->spill_file = tmpfile()))
+            return track->spill_error = AVERROR(errno);
+        track->spill_cache_start = -1;
+    }
+    if ((ret = mov_spill_write(track, track->cluster, track->spilled)) < 0)
+        return ret;
+    track->spilled += MOV_INDEX_CLUSTER_SIZE;
+    return 0;
+}
+
+/*
+ * Return entry i of the sample table. For spilled entries, the pointer
+ * is only valid until the next call.
+ */
+static MOVIentry *mov_get_entry(MOVTrack *track, int i)
+{
+    int start = i - i % MOV_INDEX_CLUSTER_SIZE;
+
+    if (i >= track->spilled)
+        return &track->cluster[i - track->spilled];
+
+    if (start != track->spill_cache_start) {
+        if (!track->spill_cache &&
+            !(track->spill_cache = av_malloc(MOV_INDEX_CLUSTER_SIZE *
+                                             sizeof(*track->spill_cache))))
+            goto fail;
+        if (track->spill_cache_dirty &&
+            mov_spill_write(track, track->spill_cache,
+                            track->spill_cache_start) < 0)
+            goto fail;
+        track->spill_cache_dirty = 0;
+        track->spill_cache_start = start;
+        if (fseek(track->spill_file, (long)start * sizeof(MOVIentry), SEEK_SET) ||
+            fread(track->spill_cache, sizeof(MOVIentry), MOV_INDEX_CLUSTER_SIZE,
+                  track->spill_file) != MOV_INDEX_CLUSTER_SIZE)
+            goto fail;
+    }
+    return &track->spill_cache[i - start];
+fail:
+    /* Keep going with dummy entries, the error is returned by
+     * mov_write_trailer(). */
+    if (!track->spill_error)
+        av_log(NULL, AV_LOG_ERROR, "Unable to read back the sample table\n");
+    track->spill_error = AVERROR(EIO);
+    track->spill_cache_start = -1;
+    if (track->spill_cache) {
+        memset(track->spill_cache, 0,
+               MOV_INDEX_CLUSTER_SIZE * sizeof(*track->spill_cache));
+        return &track->spill_cache[i - start];
+    }
+    return &track->cluster[0];
+}
+
+/* Like mov_get_entry(), for entries that are going to be modified. */
+static MOVIentry *mov_get_entry_rw(MOVTrack *track, int i)
+{
+    MOVIentry *e = mov_get_entry(track, i);
+    if (i < track->spilled)
+        track->spill_cache_dirty = 1;
+    return e;
+}
+
+static int co64_required(MOVTrack *track)
+{
+    if (track->entry > 0 && mov_get_entry(track, track->entry - 1)->pos + track->data_offset > UINT32_MAX)
         return 1;
     return 0;
 }
@@ -107,9 +191,9 @@ static int mov_write_stco_tag(AVIOContext *pb, MOVTrack *track)
     avio_wb32(pb, track->entry); /* entry count */
     for (i = 0; i < track->entry; i++) {
         if (mode64 == 1)
-            avio_wb64(pb, track->cluster[i].pos + track->data_offset);
+            avio_wb64(pb, mov_get_entry(track, i)->pos + track->data_offset);
         else
-            avio_wb32(pb, track->cluster[i].pos + track->data_offset);
+            avio_wb32(pb, mov_get_entry(track, i)->pos + track->data_offset);
     }
     return update_size(pb, pos);
 }
@@ -126,14 +210,16 @@ static int mov_write_stsz_tag(AVIOContext *pb, MOVTrack *track)
     avio_wb32(pb, 0); /* version & flags */
 
     for (i = 0; i < track->entry; i++) {
-        tst = track->cluster[i].size / track->cluster[i].entries;
+        MOVIentry *e = mov_get_entry(track, i);
+        tst = e->size / e->entries;
         if (oldtst != -1 && tst != oldtst)
             equalChunks = 0;
         oldtst = tst;
-        entries += track->cluster[i].entries;
+        entries += e->entries;
     }
     if (equalChunks && track->entry) {
-        int sSize = track->entry ? track->cluster[0].size / track->cluster[0].entries : 0;
+        MOVIentry *e = mov_get_entry(track, 0);
+        int sSize = e->size / e->entries;
         sSize = FFMAX(1, sSize); // adpcm mono case could make sSize == 0
         avio_wb32(pb, sSize); // sample size
         avio_wb32(pb, entries); // sample count
@@ -141,10 +227,9 @@ static int mov_write_stsz_tag(AVIOContext *pb, MOVTrack *track)
         avio_wb32(pb, 0); // sample size
         avio_wb32(pb, entries); // sample count
         for (i = 0; i < track->entry; i++) {
-            for (j = 0; j < track->cluster[i].entries; j++) {
-                avio_wb32(pb, track->cluster[i].size /
-                          track->cluster[i].entries);
-            }
+            MOVIentry *e = mov_get_entry(track, i);
+            for (j = 0; j < e->entries; j++)
+                avio_wb32(pb, e->size / e->entries);
         }
     }
     return update_size(pb, pos);
@@ -163,11 +248,12 @@ static int mov_write_stsc_tag(AVIOContext *pb, MOVTrack *track)
     entryPos = avio_tell(pb);
     avio_wb32(pb, track->entry); // entry count
     for (i = 0; i < track->entry; i++) {
-        if (oldval != track->cluster[i].samples_in_chunk) {
+        MOVIentry *e = mov_get_entry(track, i);
+        if (oldval != e->samples_in_chunk) {
             avio_wb32(pb, i + 1); // first chunk
-            avio_wb32(pb, track->cluster[i].samples_in_chunk); // samples per chunk
+            avio_wb32(pb, e->samples_in_chunk); // samples per chunk
             avio_wb32(pb, 0x1); // sample description index
-            oldval = track->cluster[i].samples_in_chunk;
+            oldval = e->samples_in_chunk;
             index++;
         }
     }
@@ -191,7 +277,7 @@ static int mov_write_stss_tag(AVIOContext *pb, MOVTrack *track, uint32_t flag)
     entryPos = avio_tell(pb);
     avio_wb32(pb, track->entry); // entry count
     for (i = 0; i < track->entry; i++) {
-        if (track->cluster[i].flags & flag) {
+        if (mov_get_entry(track, i)->flags & flag) {
             avio_wb32(pb, i + 1);
             index++;
         }
@@ -550,9 +636,9 @@ static int get_cluster_duration(MOVTrack *track, int cluster_idx)
     if (cluster_idx + 1 == track->entry)
         next_dts = track->track_duration + track->start_dts;
     else
-        next_dts = track->cluster[cluster_idx + 1].dts;
+        next_dts = mov_get_entry(track, cluster_idx + 1)->dts;
 
-    return next_dts - track->cluster[cluster_idx].dts;
+    return next_dts - mov_get_entry(track, cluster_idx)->dts;
 }
 
 static int get_samples_per_packet(MOVTrack *track)
@@ -1111,79 +1197,71 @@ static int mov_write_stsd_tag(AVIOContext *pb, MOVTrack *track)
     return update_size(pb, pos);
 }
 
-static int mov_write_ctts_tag(AVIOContext *pb, MOVTrack *track)
+/*
+ * Write a run length coded table of count/value pairs, with the entry
+ * count patched in once all runs are known.
+ */
+static int mov_write_runs(AVIOContext *pb, MOVTrack *track, const char *tag,
+                          int (*get_value)(MOVTrack *track, int i))
 {
-    MOVStts *ctts_entries;
-    uint32_t entries = 0;
-    uint32_t atom_size;
-    int i;
+    uint32_t entries = 0, count = 0;
+    int64_t pos = avio_tell(pb), entry_pos, curpos;
+    int i, value = 0;
 
-    ctts_entries = av_malloc((track->entry + 1) * sizeof(*ctts_entries)); /* worst case */
-    ctts_entries[0].count = 1;
-    ctts_entries[0].duration = track->cluster[0].cts;
-    for (i = 1; i < track->entry; i++) {
-        if (track->cluster[i].cts == ctts_entries[entries].duration) {
-            ctts_entries[entries].count++; /* compress */
-        } else {
+    avio_wb32(pb, 0); /* size */
+    ffio_wfourcc(pb, tag);
+    avio_wb32(pb, 0); /* version & flags */
+    entry_pos = avio_tell(pb);
+    avio_wb32(pb, 0); /* entry count */
+    for (i = 0; i < track->entry; i++) {
+        int v = get_value(track, i);
+        if (count && v == value) {
+            count++; /* compress */
+            continue;
+        }
+        if (count) {
+            avio_wb32(pb, count);
+            avio_wb32(pb, value);
             entries++;
-            ctts_entries[entries].duration = track->cluster[i].cts;
-            ctts_entries[entries].count = 1;
         }
+        value = v;
+        count = 1;
     }
-    entries++; /* last one */
-    atom_size = 16 + (entries * 8);
-    avio_wb32(pb, atom_size); /* size */
-    ffio_wfourcc(pb, "ctts");
-    avio_wb32(pb, 0); /* version & flags */
-    avio_wb32(pb, entries); /* entry count */
-    for (i = 0; i < entries; i++) {
-        avio_wb32(pb, ctts_entries[i].count);
-        avio_wb32(pb, ctts_entries[i].duration);
+    if (count) { /* last one */
+        avio_wb32(pb, count);
+        avio_wb32(pb, value);
+        entries++;
     }
-    av_free(ctts_entries);
-    return atom_size;
+    curpos = avio_tell(pb);
+    avio_seek(pb, entry_pos, SEEK_SET);
+    avio_wb32(pb, entries);
+    avio_seek(pb, curpos, SEEK_SET);
+    return update_size(pb, pos);
+}
+
+static int get_cluster_cts(MOVTrack *track, int i)
+{
+    return mov_get_entry(track, i)->cts;
+}
+
+static int mov_write_ctts_tag(AVIOContext *pb, MOVTrack *track)
+{
+    return mov_write_runs(pb, track, "ctts", get_cluster_cts);
 }
 
 /* Time to sample atom */
 static int mov_write_stts_tag(AVIOContext *pb, MOVTrack *track)
 {
-    MOVStts *stts_entries;
-    uint32_t entries = -1;
-    uint32_t atom_size;
-    int i;
-
     if (track->enc->codec_type == AVMEDIA_TYPE_AUDIO && !track->audio_vbr) {
-        stts_entries = av_malloc(sizeof(*stts_entries)); /* one entry */
-        stts_entries[0].count = track->sample_count;
-        stts_entries[0].duration = 1;
-        entries = 1;
-    } else {
-        stts_entries = track->entry ?
-                       av_malloc(track->entry * sizeof(*stts_entries)) : /* worst case */
-                       NULL;
-        for (i = 0; i < track->entry; i++) {
-            int duration = get_cluster_duration(track, i);
-            if (i && duration == stts_entries[entries].duration) {
-                stts_entries[entries].count++; /* compress */
-            } else {
-                entries++;
-                stts_entries[entries].duration = duration;
-                stts_entries[entries].count = 1;
-            }
-        }
-        entries++; /* last one */
-    }
-    atom_size = 16 + (entries * 8);
-    avio_wb32(pb, atom_size); /* size */
-    ffio_wfourcc(pb, "stts");
-    avio_wb32(pb, 0); /* version & flags */
-    avio_wb32(pb, entries); /* entry count */
-    for (i = 0; i < entries; i++) {
-        avio_wb32(pb, stts_entries[i].count);
-        avio_wb32(pb, stts_entries[i].duration);
+        avio_wb32(pb, 24); /* size */
+        ffio_wfourcc(pb, "stts");
+        avio_wb32(pb, 0); /* version & flags */
+        avio_wb32(pb, 1); /* entry count */
+        avio_wb32(pb, track->sample_count);
+        avio_wb32(pb, 1);
+        return 24;
     }
-    av_free(stts_entries);
-    return atom_size;
+    return mov_write_runs(pb, track, "stts", get_cluster_duration);
 }
 
 static int mov_write_dref_tag(AVIOContext *pb)
@@ -1517,8 +1595,8 @@ static int mov_write_edts_tag(AVIOContext *pb, MOVTrack *track)
                                       track->timescale, AV_ROUND_UP);
     int version = duration < INT32_MAX ? 0 : 1;
     int entry_size, entry_count, size;
-    int64_t delay, start_ct = track->cluster[0].cts;
-    delay = av_rescale_rnd(track->cluster[0].dts + start_ct, MOV_TIMESCALE,
+    int64_t delay, start_ct = mov_get_entry(track, 0)->cts;
+    delay = av_rescale_rnd(mov_get_entry(track, 0)->dts + start_ct, MOV_TIMESCALE,
                            track->timescale, AV_ROUND_DOWN);
     version |= delay < INT32_MAX ? 0 : 1;
 
@@ -1616,7 +1694,7 @@ static int mov_write_trak_tag(AVIOContext *pb, MOVMuxContext *mov,
     ffio_wfourcc(pb, "trak");
     mov_write_tkhd_tag(pb, track, st);
     if (track->mode == MODE_PSP || track->flags & MOV_TRACK_CTTS ||
-        (track->entry && track->cluster[0].dts)) {
+        (track->entry && mov_get_entry(track, 0)->dts)) {
         if (!(mov->flags & FF_MOV_FLAG_FRAGMENT))
             mov_write_edts_tag(pb, track);  // PSP Movies require edts box
     }
@@ -2281,6 +2359,16 @@ static int mov_write_tfhd_tag(AVIOContext *pb, MOVMuxContext *mov,
     return update_size(pb, pos);
 }
 
+static int mov_write_tfdt_tag(AVIOContext *pb, MOVTrack *track)
+{
+    avio_wb32(pb, 20);
+    ffio_wfourcc(pb, "tfdt");
+    avio_w8(pb, 1); /* version */
+    avio_wb24(pb, 0);
+    avio_wb64(pb, track->frag_start); /* base media decode time */
+    return 0;
+}
+
 static uint32_t get_sample_flags(MOVTrack *track, MOVIentry *entry)
 {
     return entry->flags & MOV_SYNC_SAMPLE ? MOV_FRAG_SAMPLE_FLAG_DEPENDS_NO :
@@ -2416,6 +2504,8 @@ static int mov_write_traf_tag(AVIOContext *pb, MOVMuxContext *mov,
     ffio_wfourcc(pb, "traf");
 
     mov_write_tfhd_tag(pb, mov, track, moof_offset);
+    if (mov->chunk_duration)
+        mov_write_tfdt_tag(pb, track);
     mov_write_trun_tag(pb, mov, track, moof_size);
     if (mov->mode == MODE_ISM) {
         mov_write_tfxd_tag(pb, track);
@@ -2703,7 +2793,7 @@ static void mov_parse_vc1_frame(AVPacket *pkt, MOVTrack *trk, int fragment)
                (entry && !trk->vc1_info.packet_entry)) {
         int i;
         for (i = 0; i < trk->entry; i++)
-            trk->cluster[i].flags &= ~MOV_SYNC_SAMPLE;
+            mov_get_entry_rw(trk, i)->flags &= ~MOV_SYNC_SAMPLE;
         trk->has_keyframes = 0;
         if (seq)
             trk->vc1_info.packet_seq = 1;
@@ -2715,7 +2805,7 @@ static void mov_parse_vc1_frame(AVPacket *pkt, MOVTrack *trk, int fragment)
                 (!entry || trk->vc1_info.first_packet_entry)) {
                 /* First packet had the same headers as this one, readd the
                  * sync sample flag. */
-                trk->cluster[0].flags |= MOV_SYNC_SAMPLE;
+                mov_get_entry_rw(trk, 0)->flags |= MOV_SYNC_SAMPLE;
                 trk->has_keyframes = 1;
             }
         }
@@ -2727,7 +2817,7 @@ static void mov_parse_vc1_frame(AVPacket *pkt, MOVTrack *trk, int fragment)
     else if (trk->vc1_info.packet_entry)
         key = entry;
     if (key) {
-        trk->cluster[trk->entry].flags |= MOV_SYNC_SAMPLE;
+        mov_get_entry(trk, trk->entry)->flags |= MOV_SYNC_SAMPLE;
         trk->has_keyframes++;
     }
 }
@@ -2819,33 +2909,42 @@ static int mov_flush_fragment(AVFormatContext *s)
         }
 
         if (write_moof) {
-            MOVFragmentInfo *info;
+            MOVFragmentInfo *info = NULL;
             avio_flush(s->pb);
-            track->nb_frag_info++;
-            if (track->nb_frag_info >= track->frag_info_capacity) {
-                unsigned new_capacity = track->nb_frag_info + MOV_FRAG_INFO_ALLOC_INCREMENT;
-                if (av_reallocp_array(&track->frag_info,
-                                      new_capacity,
-                                      sizeof(*track->frag_info)))
-                    return AVERROR(ENOMEM);
-                track->frag_info_capacity = new_capacity;
+            /* Only the first chunk of a fragment is a random access point */
+            if (!track->chunk_continued) {
+                track->nb_frag_info++;
+                if (track->nb_frag_info >= track->frag_info_capacity) {
+                    unsigned new_capacity = track->nb_frag_info + MOV_FRAG_INFO_ALLOC_INCREMENT;
+                    if (av_reallocp_array(&track->frag_info,
+                                          new_capacity,
+                                          sizeof(*track->frag_info)))
+                        return AVERROR(ENOMEM);
+                    track->frag_info_capacity = new_capacity;
+                }
+                info = &track->frag_info[track->nb_frag_info - 1];
+                info->offset   = avio_tell(s->pb);
+                info->time     = mov->tracks[i].frag_start;
+                info->duration = duration;
+                mov_write_tfrf_tags(s->pb, mov, track);
             }
-            info = &track->frag_info[track->nb_frag_info - 1];
-            info->offset   = avio_tell(s->pb);
-            info->time     = mov->tracks[i].frag_start;
-            info->duration = duration;
-            mov_write_tfrf_tags(s->pb, mov, track);
 
             mov_write_moof_tag(s->pb, mov, moof_tracks);
-            info->tfrf_offset = track->tfrf_offset;
+            if (info)
+                info->tfrf_offset = track->tfrf_offset;
             mov->fragments++;
 
             avio_wb32(s->pb, mdat_size + 8);
             ffio_wfourcc(s->pb, "mdat");
         }
 
-        if (track->entry)
+        if (track->entry) {
             track->frag_start += duration;
+            /* Only the tracks with samples in this chunk have started the
+             * fragment, the others get their random access point later. */
+            if (mov->chunk_duration)
+                track->chunk_continued = 1;
+        }
         track->entry = 0;
         if (!track->mdat_buf)
             continue;
@@ -2856,12 +2955,29 @@ static int mov_flush_fragment(AVFormatContext *s)
         av_free(buf);
     }
 
-    mov->mdat_size = 0;
+    /* With chunks, mdat_size covers the whole fragment, it is reset by
+     * mov_end_fragment(). */
+    if (!mov->chunk_duration)
+        mov->mdat_size = 0;
 
     avio_flush(s->pb);
     return 0;
 }
 
+/* Write out the pending samples, and start a new fragment. */
+static int mov_end_fragment(AVFormatContext *s)
+{
+    MOVMuxContext *mov = s->priv_data;
+    int i, ret = mov_flush_fragment(s);
+
+    for (i = 0; i < mov->nb_streams; i++) {
+        mov->tracks[i].seg_start_dts   = AV_NOPTS_VALUE;
+        mov->tracks[i].chunk_continued = 0;
+    }
+    mov->mdat_size = 0;
+    return ret;
+}
+
 int ff_mov_write_packet(AVFormatContext *s, AVPacket *pkt)
 {
     MOVMuxContext *mov = s->priv_data;
@@ -2869,11 +2985,10 @@ int ff_mov_write_packet(AVFormatContext *s, AVPacket *pkt)
     MOVTrack *trk = &mov->tracks[pkt->stream_index];
     AVCodecContext *enc = trk->enc;
     unsigned int samples_in_chunk = 0;
-    int size = pkt->size;
+    int size = pkt->size, ret;
     uint8_t *reformatted_data = NULL;
 
     if (mov->flags & FF_MOV_FLAG_FRAGMENT) {
-        int ret;
         if (mov->fragments > 0) {
             if (!trk->mdat_buf) {
                 if ((ret = avio_open_dyn_buf(&trk->mdat_buf)) < 0)
@@ -2939,25 +3054,33 @@ int ff_mov_write_packet(AVFormatContext *s, AVPacket *pkt)
         memcpy(trk->vos_data, pkt->data, size);
     }
 
-    if (trk->entry >= trk->cluster_capacity) {
-        unsigned new_capacity = 2 * (trk->entry + MOV_INDEX_CLUSTER_SIZE);
+    if (mov->flags & FF_MOV_FLAG_SPILL_INDEX &&
+        trk->entry - trk->spilled == MOV_INDEX_CLUSTER_SIZE) {
+        if ((ret = mov_spill_cluster(trk)) < 0) {
+            av_log(s, AV_LOG_ERROR, "Unable to spill the sample table to a temporary file\n");
+            av_free(reformatted_data);
+            return ret;
+        }
+    }
+    if (trk->entry - trk->spilled >= trk->cluster_capacity) {
+        unsigned new_capacity = 2 * (trk->entry - trk->spilled + MOV_INDEX_CLUSTER_SIZE);
         if (av_reallocp_array(&trk->cluster, new_capacity,
                               sizeof(*trk->cluster)))
             return AVERROR(ENOMEM);
         trk->cluster_capacity = new_capacity;
     }
 
-    trk->cluster[trk->entry].pos              = avio_tell(pb) - size;
-    trk->cluster[trk->entry].samples_in_chunk = samples_in_chunk;
-    trk->cluster[trk->entry].size             = size;
-    trk->cluster[trk->entry].entries          = samples_in_chunk;
-    trk->cluster[trk->entry].dts              = pkt->dts;
+    trk->cluster[trk->entry - trk->spilled].pos              = avio_tell(pb) - size;
+    trk->cluster[trk->entry - trk->spilled].samples_in_chunk = samples_in_chunk;
+    trk->cluster[trk->entry - trk->spilled].size             = size;
+    trk->cluster[trk->entry - trk->spilled].entries          = samples_in_chunk;
+    trk->cluster[trk->entry - trk->spilled].dts              = pkt->dts;
     if (!trk->entry && trk->start_dts != AV_NOPTS_VALUE) {
         /* First packet of a new fragment. We already wrote the duration
          * of the last packet of the previous fragment based on track_duration,
          * which might not exactly match our dts. Therefore adjust the dts
          * of this packet to be what the previous packets duration implies. */
-        trk->cluster[trk->entry].dts = trk->start_dts + trk->track_duration;
+        trk->cluster[trk->entry - trk->spilled].dts = trk->start_dts + trk->track_duration;
     }
     if (trk->start_dts == AV_NOPTS_VALUE)
         trk->start_dts = pkt->dts;
@@ -2969,20 +3092,20 @@ int ff_mov_write_packet(AVFormatContext *s, AVPacket *pkt)
     }
     if (pkt->dts != pkt->pts)
         trk->flags |= MOV_TRACK_CTTS;
-    trk->cluster[trk->entry].cts   = pkt->pts - pkt->dts;
-    trk->cluster[trk->entry].flags = 0;
+    trk->cluster[trk->entry - trk->spilled].cts   = pkt->pts - pkt->dts;
+    trk->cluster[trk->entry - trk->spilled].flags = 0;
     if (enc->codec_id == AV_CODEC_ID_VC1) {
         mov_parse_vc1_frame(pkt, trk, mov->fragments);
     } else if (pkt->flags & AV_PKT_FLAG_KEY) {
         if (mov->mode == MODE_MOV && enc->codec_id == AV_CODEC_ID_MPEG2VIDEO &&
             trk->entry > 0) { // force sync sample for the first key frame
-            mov_parse_mpeg2_frame(pkt, &trk->cluster[trk->entry].flags);
-            if (trk->cluster[trk->entry].flags & MOV_PARTIAL_SYNC_SAMPLE)
+            mov_parse_mpeg2_frame(pkt, &trk->cluster[trk->entry - trk->spilled].flags);
+            if (trk->cluster[trk->entry - trk->spilled].flags & MOV_PARTIAL_SYNC_SAMPLE)
                 trk->flags |= MOV_TRACK_STPS;
         } else {
-            trk->cluster[trk->entry].flags = MOV_SYNC_SAMPLE;
+            trk->cluster[trk->entry - trk->spilled].flags = MOV_SYNC_SAMPLE;
         }
-        if (trk->cluster[trk->entry].flags & MOV_SYNC_SAMPLE)
+        if (trk->cluster[trk->entry - trk->spilled].flags & MOV_SYNC_SAMPLE)
             trk->has_keyframes++;
     }
     trk->entry++;
@@ -2999,33 +3122,61 @@ int ff_mov_write_packet(AVFormatContext *s, AVPacket *pkt)
 static int mov_write_packet(AVFormatContext *s, AVPacket *pkt)
 {
     if (!pkt) {
-        mov_flush_fragment(s);
+        mov_end_fragment(s);
         return 1;
     } else {
         MOVMuxContext *mov = s->priv_data;
         MOVTrack *trk = &mov->tracks[pkt->stream_index];
         AVCodecContext *enc = trk->enc;
+        AVRational time_base = s->streams[pkt->stream_index]->time_base;
         int64_t frag_duration = 0;
-        int size = pkt->size;
+        int size = pkt->size, has_data = trk->entry, ret;
 
         if (!pkt->size)
             return 0;             /* Discard 0 sized packets */
 
-        if (trk->entry)
-            frag_duration = av_rescale_q(pkt->dts - trk->cluster[0].dts,
-                                         s->streams[pkt->stream_index]->time_base,
-                                         AV_TIME_BASE_Q);
+        if (mov->chunk_duration) {
+            /* A fragment spans several chunks */
+            has_data = trk->seg_start_dts != AV_NOPTS_VALUE;
+            if (has_data)
+                frag_duration = av_rescale_q(pkt->dts - trk->seg_start_dts,
+                                             time_base, AV_TIME_BASE_Q);
+            /* If the duration of the last sample was unknown, it lasts
+             * until this packet. */
+            if (trk->entry)
+                trk->track_duration = FFMAX(trk->track_duration,
+                                            pkt->dts - trk->start_dts);
+        } else if (trk->entry) {
+            frag_duration = av_rescale_q(pkt->dts - mov_get_entry(trk, 0)->dts,
+                                         time_base, AV_TIME_BASE_Q);
+        }
         if ((mov->max_fragment_duration &&
              frag_duration >= mov->max_fragment_duration) ||
              (mov->max_fragment_size && mov->mdat_size + size >= mov->max_fragment_size) ||
              (mov->flags & FF_MOV_FLAG_FRAG_KEYFRAME &&
               enc->codec_type == AVMEDIA_TYPE_VIDEO &&
-              trk->entry && pkt->flags & AV_PKT_FLAG_KEY)) {
+              has_data && pkt->flags & AV_PKT_FLAG_KEY)) {
             if (frag_duration >= mov->min_fragment_duration)
-                mov_flush_fragment(s);
+                mov_end_fragment(s);
+        } else if (mov->chunk_duration && trk->entry &&
+                   av_rescale_q(pkt->dts - mov_get_entry(trk, 0)->dts, time_base,
+                                AV_TIME_BASE_Q) >= mov->chunk_duration) {
+            /* Chunk completed by a packet without duration */
+            mov_flush_fragment(s);
         }
+        if (trk->seg_start_dts == AV_NOPTS_VALUE)
+            trk->seg_start_dts = pkt->dts;
 
-        return ff_mov_write_packet(s, pkt);
+        if ((ret = ff_mov_write_packet(s, pkt)) < 0)
+            return ret;
+
+        /* Write the chunk as soon as it is complete */
+        if (mov->chunk_duration && pkt->duration > 0 &&
+            av_rescale_q(trk->start_dts + trk->track_duration -
+                         mov_get_entry(trk, 0)->dts, time_base,
+                         AV_TIME_BASE_Q) >= mov->chunk_duration)
+            return mov_flush_fragment(s);
+        return 0;
     }
 }
 
@@ -3143,6 +3294,9 @@ static void mov_free(AVFormatContext *s)
             ff_mov_close_hinting(&mov->tracks[i]);
         av_freep(&mov->tracks[i].cluster);
         av_freep(&mov->tracks[i].frag_info);
+        av_freep(&mov->tracks[i].spill_cache);
+        if (mov->tracks[i].spill_file)
+            fclose(mov->tracks[i].spill_file);
 
         if (mov->tracks[i].vos_len)
             av_free(mov->tracks[i].vos_data);
@@ -3174,6 +3328,7 @@ static int mov_write_header(AVFormatContext *s)
     /* Set the FRAGMENT flag if any of the fragmentation methods are
      * enabled. */
     if (mov->max_fragment_duration || mov->max_fragment_size ||
+        mov->chunk_duration ||
         mov->flags & (FF_MOV_FLAG_EMPTY_MOOV |
                       FF_MOV_FLAG_FRAG_KEYFRAME |
                       FF_MOV_FLAG_FRAG_CUSTOM))
@@ -3184,6 +3339,12 @@ static int mov_write_header(AVFormatContext *s)
         mov->flags |= FF_MOV_FLAG_EMPTY_MOOV | FF_MOV_FLAG_SEPARATE_MOOF |
                       FF_MOV_FLAG_FRAGMENT;
 
+    if (mov->chunk_duration && mov->mode == MODE_ISM) {
+        av_log(s, AV_LOG_WARNING, "chunk_duration is not supported for "
+               "Smooth Streaming, disabling it\n");
+        mov->chunk_duration = 0;
+    }
+
     /* faststart: moov at the beginning of the file, if supported */
     if (mov->flags & FF_MOV_FLAG_FASTSTART) {
         if ((mov->flags & FF_MOV_FLAG_FRAGMENT) ||
@@ -3193,6 +3354,22 @@ static int mov_write_header(AVFormatContext *s)
             mov->flags &= ~FF_MOV_FLAG_FASTSTART;
         }
     }
+    if (mov->flags & FF_MOV_FLAG_SPILL_INDEX &&
+        mov->flags & FF_MOV_FLAG_FRAGMENT) {
+        av_log(s, AV_LOG_WARNING, "The spill_index flag has no effect "
+               "with fragmentation, disabling it\n");
+        mov->flags &= ~FF_MOV_FLAG_SPILL_INDEX;
+    }
+    if (mov->reserved_moov_size) {
+        if (mov->flags & FF_MOV_FLAG_FRAGMENT) {
+            av_log(s, AV_LOG_WARNING, "Reserving space for the moov atom is "
+                   "not supported with fragmentation, ignoring it\n");
+            mov->reserved_moov_size = 0;
+        } else if (mov->reserved_moov_size < 8) {
+            av_log(s, AV_LOG_ERROR, "reserve_moov_size must be at least 8 bytes\n");
+            return AVERROR(EINVAL);
+        }
+    }
 
     /* Non-seekable output is ok if using fragmentation. If ism_lookahead
      * is enabled, we don't support non-seekable output at all. */
@@ -3252,8 +3429,9 @@ static int mov_write_header(AVFormatContext *s)
         }
         /* If hinting of this track is enabled by a later hint track,
          * this is updated. */
-        track->hint_track = -1;
-        track->start_dts  = AV_NOPTS_VALUE;
+        track->hint_track    = -1;
+        track->start_dts     = AV_NOPTS_VALUE;
+        track->seg_start_dts = AV_NOPTS_VALUE;
         if (st->codec->codec_type == AVMEDIA_TYPE_VIDEO) {
             if (track->tag == MKTAG('m','x','3','p') || track->tag == MKTAG('m','x','3','n') ||
                 track->tag == MKTAG('m','x','4','p') || track->tag == MKTAG('m','x','4','n') ||
@@ -3324,8 +3502,14 @@ static int mov_write_header(AVFormatContext *s)
     }
 
     if (!(mov->flags & FF_MOV_FLAG_FRAGMENT)) {
-        if (mov->flags & FF_MOV_FLAG_FASTSTART)
+        if (mov->flags & FF_MOV_FLAG_FASTSTART || mov->reserved_moov_size)
             mov->reserved_moov_pos = avio_tell(pb);
+        /* Placeholder for the moov atom, filled in by mov_write_trailer() */
+        if (mov->reserved_moov_size) {
+            avio_wb32(pb, mov->reserved_moov_size);
+            ffio_wfourcc(pb, "free");
+            ffio_fill(pb, 0, mov->reserved_moov_size - 8);
+        }
         mov_write_mdat_tag(pb, mov);
     }
 
@@ -3409,6 +3593,39 @@ static int compute_moov_size(AVFormatContext *s)
     return moov_size2;
 }
 
+/*
+ * Write the moov atom into the space reserved at the start of the file,
+ * padding the rest of it with a free atom. Returns 1 if the moov atom
+ * was written, 0 if it does not fit.
+ */
+static int write_reserved_moov(AVFormatContext *s)
+{
+    MOVMuxContext *mov = s->priv_data;
+    AVIOContext *pb = s->pb;
+    int64_t pos = avio_tell(pb);
+    int moov_size = get_moov_size(s);
+
+    if (moov_size < 0)
+        return moov_size;
+    /* The remaining space must either be empty or fit a free atom */
+    if (moov_size != mov->reserved_moov_size &&
+        moov_size + 8 > mov->reserved_moov_size) {
+        av_log(s, AV_LOG_WARNING, "Insufficient space reserved for the moov "
+               "atom: %d (needed: %d)\n", mov->reserved_moov_size,
+               moov_size);
+        return 0;
+    }
+
+    avio_seek(pb, mov->reserved_moov_pos, SEEK_SET);
+    mov_write_moov_tag(pb, mov, s);
+    if (moov_size < mov->reserved_moov_size) {
+        avio_wb32(pb, mov->reserved_moov_size - moov_size);
+        ffio_wfourcc(pb, "free");
+    }
+    avio_seek(pb, pos, SEEK_SET);
+    return 1;
+}
+
 static int shift_data(AVFormatContext *s)
 {
     int ret = 0, moov_size;
@@ -3509,7 +3726,11 @@ static int mov_write_trailer(AVFormatContext *s)
         }
         avio_seek(pb, moov_pos, SEEK_SET);
 
-        if (mov->flags & FF_MOV_FLAG_FASTSTART) {
+        if (mov->reserved_moov_size &&
+            (res = write_reserved_moov(s)) != 0) {
+            if (res > 0)
+                res = 0;
+        } else if (mov->flags & FF_MOV_FLAG_FASTSTART) {
             av_log(s, AV_LOG_INFO, "Starting second pass: moving the moov atom to the beginning of the file\n");
             res = shift_data(s);
             if (res == 0) {
@@ -3524,6 +3745,10 @@ static int mov_write_trailer(AVFormatContext *s)
         mov_write_mfra_tag(pb, mov);
     }
 
+    for (i = 0; i < mov->nb_streams; i++)
+        if (mov->tracks[i].spill_error && !res)
+            res = mov->tracks[i].spill_error;
+
     for (i = 0; i < mov->nb_streams; i++) {
         if (mov->flags & FF_MOV_FLAG_FRAGMENT &&
             mov->tracks[i].vc1_info.struct_offset && s->pb->seekable) {
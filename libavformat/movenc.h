@@ -24,6 +24,8 @@
 #ifndef AVFORMAT_MOVENC_H
 #define AVFORMAT_MOVENC_H
 
+#include <stdio.h>
+
 #include "avformat.h"
 
 #define MOV_FRAG_INFO_ALLOC_INCREMENT 64
@@ -95,8 +97,14 @@ typedef struct MOVTrack {
 
     int         vos_len;
     uint8_t     *vos_data;
-    MOVIentry   *cluster;
+    MOVIentry   *cluster;       ///< entries from spilled onwards
     unsigned    cluster_capacity;
+    FILE        *spill_file;    ///< entries before spilled, see mov_get_entry()
+    int         spilled;
+    MOVIentry   *spill_cache;   ///< one block of spilled entries read back
+    int         spill_cache_start;
+    int         spill_cache_dirty;
+    int         spill_error;
     int         audio_vbr;
     int         height; ///< active picture (w/o VBI) height for D-10/IMX
     uint32_t    tref_tag;
@@ -120,6 +128,8 @@ typedef struct MOVTrack {
     int64_t     data_offset;
     int64_t     frag_start;
     int64_t     tfrf_offset;
+    int64_t     seg_start_dts;   ///< dts of the first sample of the fragment, with chunks
+    int         chunk_continued; ///< set once a chunk of the current fragment is written
 
     int         nb_frag_info;
     MOVFragmentInfo *frag_info;
@@ -156,9 +166,11 @@ typedef struct MOVMuxContext {
     int min_fragment_duration;
     int max_fragment_size;
     int ism_lookahead;
+    int chunk_duration;
     AVIOContext *mdat_buf;
 
     int64_t reserved_moov_pos;
+    int reserved_moov_size;
 } MOVMuxContext;
 
 #define FF_MOV_FLAG_RTP_HINT 1
@@ -170,6 +182,7 @@ typedef struct MOVMuxContext {
 #define FF_MOV_FLAG_ISML 64
 #define FF_MOV_FLAG_FASTSTART 128
 #define FF_MOV_FLAG_OMIT_TFHD_OFFSET 256
+#define FF_MOV_FLAG_SPILL_INDEX 512
 
 int ff_mov_write_packet(AVFormatContext *s, AVPacket *pkt);
 
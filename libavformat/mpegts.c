@@ -129,6 +129,11 @@ struct MpegTSContext {
 
     /** filters for various streams specified by PMT + for the PAT and PMT */
     MpegTSFilter *pids[NB_PID_MAX];
+
+    /** list of program numbers to demux, all programs if empty */
+    char *programs_str;
+    int *programs;
+    int nb_programs;
 };
 
 static const AVOption options[] = {
@@ -144,6 +149,19 @@ static const AVClass mpegtsraw_class = {
     .version    = LIBAVUTIL_VERSION_INT,
 };
 
+static const AVOption mpegts_options[] = {
+    {"programs", "Only demux the listed programs (program numbers separated by ',').", offsetof(MpegTSContext, programs_str), AV_OPT_TYPE_STRING,
+     {.str = NULL}, 0, 0, AV_OPT_FLAG_DECODING_PARAM },
+    { NULL },
+};
+
+static const AVClass mpegts_class = {
+    .class_name = "mpegts demuxer",
+    .item_name  = av_default_item_name,
+    .option     = mpegts_options,
+    .version    = LIBAVUTIL_VERSION_INT,
+};
+
 /* TS stream handling */
 
 enum MpegTSState {
@@ -229,6 +247,45 @@ static void add_pid_to_pmt(MpegTSContext *ts, unsigned int programid, unsigned i
     p->pids[p->nb_pids++] = pid;
 }
 
+/* check whether a program is part of the programs selected for demuxing */
+static int program_selected(MpegTSContext *ts, unsigned int programid)
+{
+    int i;
+
+    if (!ts->nb_programs)
+        return 1;
+    for (i = 0; i < ts->nb_programs; i++)
+        if (ts->programs[i] == programid)
+            return 1;
+    return 0;
+}
+
+static int parse_programs(MpegTSContext *ts)
+{
+    const char *p = ts->programs_str;
+    char *end;
+    int ret;
+
+    while (p && *p) {
+        long id = strtol(p, &end, 10);
+        if (end == p || id < 0 || id > 0xffff || (*end && *end != ',')) {
+            av_log(ts->stream, AV_LOG_ERROR, "Invalid program list '%s'\n",
+                   ts->programs_str);
+            av_freep(&ts->programs);
+            ts->nb_programs = 0;
+            return AVERROR(EINVAL);
+        }
+        if ((ret = av_reallocp_array(&ts->programs, ts->nb_programs + 1,
+                                     sizeof(*ts->programs))) < 0) {
+            ts->nb_programs = 0;
+            return ret;
+        }
+        ts->programs[ts->nb_programs++] = id;
+        p = *end ? end + 1 : end;
+    }
+    return 0;
+}
+
 /**
  * @brief discard_pid() decides if the pid is to be discarded according
  *                      to caller's programs selection
@@ -1547,6 +1604,11 @@ static void pat_cb(MpegTSFilter *filter, const uint8_t *section, int section_len
 
         if (sid == 0x0000) {
             /* NIT info */
+        } else if (!program_selected(ts, sid)) {
+            /* the PMT and elementary stream PIDs of programs which are not
+             * selected get no filter, so their packets are dropped as soon
+             * as the PID is known */
+            av_dlog(ts->stream, "skipping program 0x%x\n", sid);
         } else {
             av_new_program(ts->stream, sid);
             if (ts->pids[pmt_pid])
@@ -1617,7 +1679,7 @@ static void sdt_cb(MpegTSFilter *filter, const uint8_t *section, int section_len
                 if (!provider_name)
                     break;
                 name = getstr8(&p, p_end);
-                if (name) {
+                if (name && program_selected(ts, sid)) {
                     AVProgram *program = av_new_program(ts->stream, sid);
                     if(program) {
                         av_dict_set(&program->metadata, "service_name", name, 0);
@@ -1742,9 +1804,22 @@ static int handle_packet(MpegTSContext *ts, const uint8_t *packet)
 static int mpegts_resync(AVFormatContext *s)
 {
     AVIOContext *pb = s->pb;
-    int c, i;
-
-    for(i = 0;i < MAX_RESYNC_SIZE; i++) {
+    int c, i, len;
+    const uint8_t *sync;
+
+    for (i = 0; i < MAX_RESYNC_SIZE; ) {
+        /* scan the buffered data at once, memchr() is usually vectorized */
+        len = FFMIN(pb->buf_end - pb->buf_ptr, MAX_RESYNC_SIZE - i);
+        if (len > 0 && !pb->write_flag) {
+            sync = memchr(pb->buf_ptr, 0x47, len);
+            if (sync) {
+                pb->buf_ptr += sync - pb->buf_ptr;
+                return 0;
+            }
+            pb->buf_ptr += len;
+            i           += len;
+            continue;
+        }
         c = avio_r8(pb);
         if (pb->eof_reached)
             return -1;
@@ -1752,6 +1827,7 @@ static int mpegts_resync(AVFormatContext *s)
             avio_seek(pb, -1, SEEK_CUR);
             return 0;
         }
+        i++;
     }
     av_log(s, AV_LOG_ERROR, "max resync size reached, could not find sync byte\n");
     /* no sync found */
@@ -1791,6 +1867,64 @@ static void finished_reading_packet(AVFormatContext *s, int raw_packet_size)
         avio_skip(pb, skip);
 }
 
+/**
+ * Count the packets at the start of buf which begin with a sync byte.
+ */
+static int count_synced_packets(const uint8_t *buf, int nb_packets, int packet_size)
+{
+    int i = 0;
+
+    /* check several sync bytes per branch */
+    for (; i + 4 <= nb_packets; i += 4, buf += 4 * packet_size)
+        if ((buf[0]               ^ 0x47) | (buf[packet_size]     ^ 0x47) |
+            (buf[2 * packet_size] ^ 0x47) | (buf[3 * packet_size] ^ 0x47))
+            break;
+    for (; i < nb_packets && buf[0] == 0x47; i++)
+        buf += packet_size;
+    return i;
+}
+
+/**
+ * Handle the complete packets available in the AVIOContext buffer in
+ * place, skipping packets of PIDs without a filter before any further
+ * parsing.
+ *
+ * @return the number of packets consumed, 0 if the buffer does not start
+ *         with a complete synced packet, or a negative error code
+ */
+static int handle_buffered_packets(MpegTSContext *ts, int max_packets)
+{
+    AVIOContext *pb = ts->stream->pb;
+    const int raw_packet_size = ts->raw_packet_size;
+    const uint8_t *p = pb->buf_ptr;
+    int i, nb, ret;
+
+    if (pb->write_flag)
+        return 0;
+    nb = (pb->buf_end - p) / raw_packet_size;
+    if (max_packets)
+        nb = FFMIN(nb, max_packets);
+    nb = count_synced_packets(p, nb, raw_packet_size);
+
+    for (i = 0; i < nb; i++, p += raw_packet_size) {
+        int pid = AV_RB16(p + 1) & 0x1fff;
+
+        if (!ts->pids[pid] && !(ts->auto_guess && (p[1] & 0x40))) {
+            pb->buf_ptr += raw_packet_size;
+            continue;
+        }
+        /* the position seen by handle_packet() is right after the packet */
+        pb->buf_ptr += TS_PACKET_SIZE;
+        ret = handle_packet(ts, p);
+        pb->buf_ptr += raw_packet_size - TS_PACKET_SIZE;
+        if (ret < 0)
+            return ret;
+        if (ts->stop_parse > 0)
+            return i + 1;
+    }
+    return nb;
+}
+
 static int handle_packets(MpegTSContext *ts, int nb_packets)
 {
     AVFormatContext *s = ts->stream;
@@ -1824,6 +1958,14 @@ static int handle_packets(MpegTSContext *ts, int nb_packets)
         packet_num++;
         if (nb_packets != 0 && packet_num >= nb_packets)
             break;
+        ret = handle_buffered_packets(ts, nb_packets ? nb_packets - packet_num : 0);
+        if (ret < 0)
+            break;
+        if (ret > 0) {
+            packet_num += ret - 1;
+            ret = 0;
+            continue;
+        }
         ret = read_packet(s, packet, ts->raw_packet_size, &data);
         if (ret != 0)
             break;
@@ -1910,6 +2052,9 @@ static int mpegts_read_header(AVFormatContext *s)
     if (s->iformat == &ff_mpegts_demuxer) {
         /* normal demux */
 
+        if (parse_programs(ts) < 0)
+            goto fail;
+
         /* first do a scan to get all the services */
         if (avio_seek(pb, pos, SEEK_SET) < 0 && pb->seekable)
             av_log(s, AV_LOG_ERROR, "Unable to seek back to the start\n");
@@ -1919,9 +2064,10 @@ static int mpegts_read_header(AVFormatContext *s)
         mpegts_open_section_filter(ts, PAT_PID, pat_cb, ts, 1);
 
         handle_packets(ts, s->probesize / ts->raw_packet_size);
-        /* if could not find service, enable auto_guess */
+        /* if could not find service, enable auto_guess, unless only
+         * selected programs are wanted */
 
-        ts->auto_guess = 1;
+        ts->auto_guess = !ts->nb_programs;
 
         av_dlog(ts->stream, "tuning done\n");
 
@@ -2068,6 +2214,8 @@ static void mpegts_free(MpegTSContext *ts)
     int i;
 
     clear_programs(ts);
+    av_freep(&ts->programs);
+    ts->nb_programs = 0;
 
     for(i=0;i<NB_PID_MAX;i++)
         if (ts->pids[i]) mpegts_close_filter(ts, ts->pids[i]);
@@ -2203,6 +2351,7 @@ AVInputFormat ff_mpegts_demuxer = {
     .read_seek      = read_seek,
     .read_timestamp = mpegts_get_pcr,
     .flags          = AVFMT_SHOW_IDS | AVFMT_TS_DISCONT,
+    .priv_class     = &mpegts_class,
 };
 
 AVInputFormat ff_mpegtsraw_demuxer = {
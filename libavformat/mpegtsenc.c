@@ -52,6 +52,8 @@ typedef struct MpegTSService {
     int pcr_pid;
     int pcr_packet_count;
     int pcr_packet_period;
+    AVStream *pcr_st;
+    int64_t pcr_pos;   ///< position of the last PCR, in T-STD mode
 } MpegTSService;
 
 typedef struct MpegTSWrite {
@@ -81,7 +83,10 @@ typedef struct MpegTSWrite {
 
 #define MPEGTS_FLAG_REEMIT_PAT_PMT  0x01
 #define MPEGTS_FLAG_AAC_LATM        0x02
+#define MPEGTS_FLAG_TSTD            0x04
     int flags;
+
+    int64_t pcr_interval; ///< bytes between two PCRs in T-STD mode
 } MpegTSWrite;
 
 /* a PES packet header is generated every DEFAULT_PES_HEADER_FREQ packets */
@@ -110,6 +115,10 @@ static const AVOption options[] = {
     { "latm", "Use LATM packetization for AAC",
       0, AV_OPT_TYPE_CONST, {.i64 = MPEGTS_FLAG_AAC_LATM}, 0, INT_MAX,
       AV_OPT_FLAG_ENCODING_PARAM, "mpegts_flags"},
+    { "tstd", "Schedule CBR packets using the T-STD transport buffers; "
+      "the multiplex and elementary stream buffers are not checked",
+      0, AV_OPT_TYPE_CONST, {.i64 = MPEGTS_FLAG_TSTD}, 0, INT_MAX,
+      AV_OPT_FLAG_ENCODING_PARAM, "mpegts_flags"},
     // backward compatibility
     { "resend_headers", "Reemit PAT/PMT before writing the next packet",
       offsetof(MpegTSWrite, reemit_pat_pmt), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM},
@@ -217,6 +226,9 @@ static int mpegts_write_section1(MpegTSSection *s, int tid, int id,
 #define PAT_RETRANS_TIME 100
 #define PCR_RETRANS_TIME 20
 
+/* size of the T-STD transport buffer of each elementary stream */
+#define TSTD_TB_SIZE 512
+
 typedef struct MpegTSWriteStream {
     struct MpegTSService *service;
     int pid; /* stream associated pid */
@@ -228,6 +240,12 @@ typedef struct MpegTSWriteStream {
     int payload_flags;
     uint8_t *payload;
     AVFormatContext *amux;
+
+    /* T-STD transport buffer, the level is in bytes multiplied by the
+     * mux rate so that it can be drained without rounding. */
+    int64_t tb_level;
+    int64_t tb_pos;
+    int64_t rx_rate; ///< transport buffer leak rate in bits per second
 } MpegTSWriteStream;
 
 static void mpegts_write_pat(AVFormatContext *s)
@@ -593,6 +611,31 @@ static int mpegts_write_header(AVFormatContext *s)
         service->pcr_pid = ts_st->pid;
     }
 
+    service->pcr_st = pcr_st;
+
+    if (ts->flags & MPEGTS_FLAG_TSTD && ts->mux_rate <= 1) {
+        av_log(s, AV_LOG_WARNING, "The tstd flag requires a muxrate, ignoring it\n");
+        ts->flags &= ~MPEGTS_FLAG_TSTD;
+    }
+
+    if (ts->flags & MPEGTS_FLAG_TSTD) {
+        ts->pcr_interval = (int64_t)ts->mux_rate * PCR_RETRANS_TIME / (8 * 1000);
+        service->pcr_pos = -ts->pcr_interval; // output a PCR as soon as possible
+        for (i = 0; i < s->nb_streams; i++) {
+            AVCodecContext *codec = s->streams[i]->codec;
+            ts_st = s->streams[i]->priv_data;
+            /* Rx is 1.2 times the maximum video bitrate and 2 Mbit/s for
+             * other streams (ISO/IEC 13818-1 2.4.2.3); without a known
+             * maximum bitrate a video stream is only limited by the mux rate. */
+            if (codec->codec_type == AVMEDIA_TYPE_VIDEO)
+                ts_st->rx_rate = codec->rc_max_rate ?
+                                 codec->rc_max_rate * 6LL / 5 : ts->mux_rate;
+            else
+                ts_st->rx_rate = 2000000;
+            ts_st->rx_rate = FFMIN(ts_st->rx_rate, ts->mux_rate);
+        }
+    }
+
     if (ts->mux_rate > 1) {
         service->pcr_packet_period = (ts->mux_rate * PCR_RETRANS_TIME) /
             (TS_PACKET_SIZE * 8 * 1000);
@@ -728,6 +771,7 @@ static void mpegts_insert_pcr_only(AVFormatContext *s, AVStream *st)
     /* Continuity Count field does not increment (see 13818-1 section 2.4.3.3) */
     *q++ = TS_PACKET_SIZE - 5; /* Adaptation Field Length */
     *q++ = 0x10;               /* Adaptation flags: PCR present */
+    ts_st->service->pcr_pos = avio_tell(s->pb);
 
     /* PCR coded into 6 bytes */
     q += write_pcr_bits(q, get_pcr(ts, s->pb));
@@ -737,6 +781,20 @@ static void mpegts_insert_pcr_only(AVFormatContext *s, AVStream *st)
     avio_write(s->pb, buf, TS_PACKET_SIZE);
 }
 
+/* Drain the T-STD transport buffer of a stream up to the current position
+ * and check whether it has room for another packet. */
+static int tstd_has_room(AVFormatContext *s, MpegTSWriteStream *ts_st)
+{
+    MpegTSWrite *ts = s->priv_data;
+    int64_t pos   = avio_tell(s->pb);
+    int64_t drain = FFMIN(pos - ts_st->tb_pos, INT_MAX) * ts_st->rx_rate;
+
+    ts_st->tb_level = FFMAX(ts_st->tb_level - drain, 0);
+    ts_st->tb_pos   = pos;
+    return ts_st->tb_level + TS_PACKET_SIZE * (int64_t)ts->mux_rate <=
+           TSTD_TB_SIZE * (int64_t)ts->mux_rate;
+}
+
 static void write_pts(uint8_t *q, int fourbits, int64_t pts)
 {
     int val;
@@ -807,7 +865,18 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
         retransmit_si_info(s);
 
         write_pcr = 0;
-        if (ts_st->pid == ts_st->service->pcr_pid) {
+        if (ts->flags & MPEGTS_FLAG_TSTD) {
+            /* PCRs are sent at a fixed interval, on a packet of their own
+             * if the current stream does not carry them. */
+            MpegTSService *service = ts_st->service;
+            if (avio_tell(s->pb) - service->pcr_pos >= ts->pcr_interval) {
+                if (ts_st->pid != service->pcr_pid) {
+                    mpegts_insert_pcr_only(s, service->pcr_st);
+                    continue;
+                }
+                write_pcr = 1;
+            }
+        } else if (ts_st->pid == ts_st->service->pcr_pid) {
             if (ts->mux_rate > 1 || is_start) // VBR pcr period is based on frames
                 ts_st->service->pcr_packet_count++;
             if (ts_st->service->pcr_packet_count >=
@@ -817,8 +886,9 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
             }
         }
 
-        if (ts->mux_rate > 1 && dts != AV_NOPTS_VALUE &&
-            (dts - get_pcr(ts, s->pb)/300) > delay) {
+        if (ts->mux_rate > 1 &&
+            (dts != AV_NOPTS_VALUE && (dts - get_pcr(ts, s->pb)/300) > delay ||
+             ts->flags & MPEGTS_FLAG_TSTD && !tstd_has_room(s, ts_st))) {
             /* pcr insert gets priority over null packet insert */
             if (write_pcr)
                 mpegts_insert_pcr_only(s, st);
@@ -855,6 +925,7 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
             if (dts != AV_NOPTS_VALUE && dts < pcr / 300)
                 av_log(s, AV_LOG_WARNING, "dts < pcr, TS is invalid\n");
             extend_af(buf, write_pcr_bits(q, pcr));
+            ts_st->service->pcr_pos = avio_tell(s->pb);
             q = get_ts_payload_start(buf);
         }
         if (is_start) {
@@ -971,6 +1042,8 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
         payload += len;
         payload_size -= len;
         avio_write(s->pb, buf, TS_PACKET_SIZE);
+        if (ts->flags & MPEGTS_FLAG_TSTD)
+            ts_st->tb_level += TS_PACKET_SIZE * (int64_t)ts->mux_rate;
     }
     avio_flush(s->pb);
 }
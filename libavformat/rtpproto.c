@@ -26,6 +26,7 @@
 
 #include "libavutil/parseutils.h"
 #include "libavutil/avstring.h"
+#include "libavutil/intreadwrite.h"
 #include "avformat.h"
 #include "avio_internal.h"
 #include "rtp.h"
@@ -41,6 +42,8 @@
 #include <sys/poll.h>
 #endif
 
+#define RTP_MAX_BATCH 256
+
 typedef struct RTPContext {
     URLContext *rtp_hd, *rtcp_hd;
     int rtp_fd, rtcp_fd, nb_ssm_include_addrs, nb_ssm_exclude_addrs;
@@ -48,6 +51,13 @@ typedef struct RTPContext {
     int write_to_source;
     struct sockaddr_storage last_rtp_source, last_rtcp_source;
     socklen_t last_rtp_source_len, last_rtcp_source_len;
+
+    /* RTP packets queued to be sent together */
+    int batch;
+    uint8_t *batch_buf;
+    uint8_t *batch_pkts[RTP_MAX_BATCH];
+    int batch_sizes[RTP_MAX_BATCH];
+    int nb_batch;
 } RTPContext;
 
 /**
@@ -261,6 +271,7 @@ static void rtp_parse_addr_list(URLContext *h, char *buf,
  *         'sources=ip[,ip]'  : list allowed source IP addresses
  *         'block=ip[,ip]'    : list disallowed source IP addresses
  *         'write_to_source=0/1' : send packets to the source address of the latest received packet
+ *         'batch=n'          : send up to n RTP packets of a frame at once
  * deprecated option:
  *         'localport=n'      : set the local port to n
  *
@@ -317,6 +328,9 @@ static int rtp_open(URLContext *h, const char *uri, int flags)
         if (av_find_info_tag(buf, sizeof(buf), "write_to_source", p)) {
             s->write_to_source = strtol(buf, NULL, 10);
         }
+        if (av_find_info_tag(buf, sizeof(buf), "batch", p)) {
+            s->batch = av_clip(strtol(buf, NULL, 10), 0, RTP_MAX_BATCH);
+        }
         if (av_find_info_tag(buf, sizeof(buf), "sources", p)) {
             av_strlcpy(include_sources, buf, sizeof(include_sources));
             rtp_parse_addr_list(h, buf, &s->ssm_include_addrs, &s->nb_ssm_include_addrs);
@@ -348,6 +362,14 @@ static int rtp_open(URLContext *h, const char *uri, int flags)
 
     h->max_packet_size = s->rtp_hd->max_packet_size;
     h->is_streamed = 1;
+
+    if (s->batch > 1 && (flags & AVIO_FLAG_WRITE) && !s->write_to_source) {
+        s->batch_buf = av_malloc(s->batch * h->max_packet_size);
+        if (!s->batch_buf)
+            goto fail;
+    } else {
+        s->batch = 0;
+    }
     return 0;
 
  fail:
@@ -400,6 +422,56 @@ static int rtp_read(URLContext *h, uint8_t *buf, int size)
     return len;
 }
 
+/* Send the queued RTP packets */
+static int rtp_flush_batch(URLContext *h)
+{
+    RTPContext *s = h->priv_data;
+    int ret;
+
+    if (!s->nb_batch)
+        return 0;
+    ret = ff_udp_write_packets(s->rtp_hd, s->batch_pkts, s->batch_sizes,
+                               s->nb_batch);
+    if (ret >= 0 && ret < s->nb_batch)
+        av_log(h, AV_LOG_WARNING, "%d of %d packets could not be sent\n",
+               s->nb_batch - ret, s->nb_batch);
+    s->nb_batch = 0;
+    return ret < 0 ? ret : 0;
+}
+
+/**
+ * Queue an RTP packet. The queue is sent when it is full, after a packet
+ * with the marker bit (the end of a video frame), or before a packet with
+ * a different timestamp or an RTCP packet.
+ */
+static int rtp_write_batched(URLContext *h, const uint8_t *buf, int size)
+{
+    RTPContext *s = h->priv_data;
+    int ret;
+
+    /* too short for an RTP header, too long to queue, or RTCP */
+    if (size < 12 || size > h->max_packet_size || RTP_PT_IS_RTCP(buf[1])) {
+        if ((ret = rtp_flush_batch(h)) < 0)
+            return ret;
+        return ffurl_write(size >= 2 && RTP_PT_IS_RTCP(buf[1]) ? s->rtcp_hd :
+                                                                  s->rtp_hd,
+                           buf, size);
+    }
+
+    if (s->nb_batch && AV_RB32(buf + 4) != AV_RB32(s->batch_pkts[0] + 4))
+        if ((ret = rtp_flush_batch(h)) < 0)
+            return ret;
+
+    s->batch_pkts[s->nb_batch]  = s->batch_buf + s->nb_batch * h->max_packet_size;
+    s->batch_sizes[s->nb_batch] = size;
+    memcpy(s->batch_pkts[s->nb_batch++], buf, size);
+
+    if (buf[1] & 0x80 || s->nb_batch == s->batch)
+        if ((ret = rtp_flush_batch(h)) < 0)
+            return ret;
+    return size;
+}
+
 static int rtp_write(URLContext *h, const uint8_t *buf, int size)
 {
     RTPContext *s = h->priv_data;
@@ -460,6 +532,9 @@ static int rtp_write(URLContext *h, const uint8_t *buf, int size)
         return ret < 0 ? ff_neterrno() : ret;
     }
 
+    if (s->batch)
+        return rtp_write_batched(h, buf, size);
+
     if (RTP_PT_IS_RTCP(buf[1])) {
         /* RTCP payload type */
         hd = s->rtcp_hd;
@@ -477,6 +552,10 @@ static int rtp_close(URLContext *h)
     RTPContext *s = h->priv_data;
     int i;
 
+    if (s->batch)
+        rtp_flush_batch(h);
+    av_freep(&s->batch_buf);
+
     for (i = 0; i < s->nb_ssm_include_addrs; i++)
         av_free(s->ssm_include_addrs[i]);
     av_freep(&s->ssm_include_addrs);
@@ -68,13 +68,15 @@ int main(int argc, char **argv)
     /* initialize libavcodec, and register all codecs and formats */
     av_register_all();
 
-    if (argc != 2) {
-        printf("usage: %s input_file\n"
+    if (argc < 2 || argc % 2) {
+        printf("usage: %s input_file [option value]...\n"
                "\n", argv[0]);
         return 1;
     }
 
     filename = argv[1];
+    for (i = 2; i < argc; i += 2)
+        av_dict_set(&format_opts, argv[i], argv[i + 1], 0);
 
     ret = avformat_open_input(&ic, filename, NULL, &format_opts);
     av_dict_free(&format_opts);
@@ -21,6 +21,14 @@
 
 #include <float.h>
 
+#include "config.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+#elif HAVE_W32THREADS
+#include "compat/w32pthreads.h"
+#endif
+
 #include "avformat.h"
 #include "internal.h"
 
@@ -43,10 +51,22 @@ typedef struct {
     int  wrap;             /**< Set by a private option. */
     int  individual_header_trailer; /**< Set by a private option. */
     int  write_header_trailer; /**< Set by a private option. */
+    int  async_close;      /**< Set by a private option. */
     int64_t offset_time;
     int64_t recording_time;
     int has_video;
     AVIOContext *pb;
+
+    /* Segment being finished in the background */
+    AVFormatContext *finish_oc;
+    AVIOContext *finish_pb;
+    char finish_filename[1024];
+    int finish_number;
+    int finish_ret;
+#if HAVE_THREADS
+    pthread_t finish_thread;
+    int finishing;
+#endif
 } SegmentContext;
 
 enum {
@@ -78,7 +98,10 @@ static int segment_mux_init(AVFormatContext *s)
     return 0;
 }
 
-static int segment_hls_window(AVFormatContext *s, int last)
+/**
+ * Write the HLS playlist, listing the segments before the given number.
+ */
+static int segment_hls_window(AVFormatContext *s, int last, int number)
 {
     SegmentContext *seg = s->priv_data;
     int i, ret = 0;
@@ -92,10 +115,10 @@ static int segment_hls_window(AVFormatContext *s, int last)
     avio_printf(seg->pb, "#EXT-X-VERSION:3\n");
     avio_printf(seg->pb, "#EXT-X-TARGETDURATION:%d\n", (int)seg->time);
     avio_printf(seg->pb, "#EXT-X-MEDIA-SEQUENCE:%d\n",
-                FFMAX(0, seg->number - seg->size));
+                FFMAX(0, number - seg->size));
 
-    for (i = FFMAX(0, seg->number - seg->size);
-         i < seg->number; i++) {
+    for (i = FFMAX(0, number - seg->size);
+         i < number; i++) {
         avio_printf(seg->pb, "#EXTINF:%d,\n", (int)seg->time);
         av_get_frame_filename(buf, sizeof(buf), s->filename, i);
         avio_printf(seg->pb, "%s\n", buf);
@@ -108,6 +131,26 @@ fail:
     return ret;
 }
 
+static int segment_list_update(AVFormatContext *s, const char *filename,
+                               int number)
+{
+    SegmentContext *seg = s->priv_data;
+    int ret;
+
+    if (seg->list_type == LIST_HLS)
+        return segment_hls_window(s, 0, number);
+
+    avio_printf(seg->pb, "%s\n", filename);
+    avio_flush(seg->pb);
+    if (seg->size && !(number % seg->size)) {
+        avio_closep(&seg->pb);
+        if ((ret = avio_open2(&seg->pb, seg->list, AVIO_FLAG_WRITE,
+                              &s->interrupt_callback, NULL)) < 0)
+            return ret;
+    }
+    return 0;
+}
+
 static int segment_start(AVFormatContext *s, int write_header)
 {
     SegmentContext *c = s->priv_data;
@@ -115,7 +158,9 @@ static int segment_start(AVFormatContext *s, int write_header)
     int err = 0;
 
     if (write_header) {
-        avformat_free_context(oc);
+        /* Already detached if it is finished in the background */
+        if (oc)
+            avformat_free_context(oc);
         c->avf = NULL;
         if ((err = segment_mux_init(s)) < 0)
             return err;
@@ -156,6 +201,85 @@ static int segment_end(AVFormatContext *oc, int write_trailer)
     return ret;
 }
 
+/**
+ * Finish the segment set up by segment_end_async(): write its trailer
+ * if it has its own muxer, close it and only then add it to the list.
+ */
+static void *segment_finish(void *arg)
+{
+    AVFormatContext *s = arg;
+    SegmentContext *seg = s->priv_data;
+    int ret;
+
+    if (seg->finish_oc) {
+        ret = segment_end(seg->finish_oc, 1);
+        avformat_free_context(seg->finish_oc);
+        seg->finish_oc = NULL;
+    } else {
+        ret = avio_close(seg->finish_pb);
+        seg->finish_pb = NULL;
+    }
+    if (ret >= 0 && seg->list)
+        ret = segment_list_update(s, seg->finish_filename, seg->finish_number);
+
+    seg->finish_ret = ret;
+    return NULL;
+}
+
+/**
+ * Wait for the segment being finished in the background, if any.
+ */
+static int segment_finish_wait(SegmentContext *seg)
+{
+#if HAVE_THREADS
+    if (seg->finishing) {
+        pthread_join(seg->finish_thread, NULL);
+        seg->finishing = 0;
+        return seg->finish_ret;
+    }
+#endif
+    return 0;
+}
+
+#if HAVE_THREADS
+/**
+ * Start the next segment while the current one is finished by a
+ * separate thread.
+ */
+static int segment_end_async(AVFormatContext *s)
+{
+    SegmentContext *seg = s->priv_data;
+    AVFormatContext *oc = seg->avf;
+    int ret;
+
+    /* Segments are added to the list in order */
+    if ((ret = segment_finish_wait(seg)) < 0)
+        return ret;
+
+    av_strlcpy(seg->finish_filename, oc->filename,
+               sizeof(seg->finish_filename));
+    seg->finish_number = seg->number;
+    if (seg->individual_header_trailer) {
+        seg->finish_oc = oc;
+        seg->avf       = NULL;
+    } else {
+        av_write_frame(oc, NULL); /* Flush any buffered data (fragmented mp4) */
+        seg->finish_pb = oc->pb;
+        oc->pb         = NULL;
+    }
+
+    if (pthread_create(&seg->finish_thread, NULL, segment_finish, s)) {
+        segment_finish(s);
+        if (seg->finish_ret < 0)
+            return seg->finish_ret;
+    } else {
+        seg->finishing = 1;
+    }
+
+    return segment_start(s, seg->individual_header_trailer);
+}
+#endif
+
 static int open_null_ctx(AVIOContext **ctx)
 {
     int buf_size = 32768;
@@ -187,6 +311,13 @@ static int seg_write_header(AVFormatContext *s)
     seg->recording_time = seg->time * 1000000;
     if (!seg->write_header_trailer)
         seg->individual_header_trailer = 0;
+#if !HAVE_THREADS
+    if (seg->async_close) {
+        av_log(s, AV_LOG_WARNING, "segment_async_close requires threads, "
+               "segments will be closed synchronously.\n");
+        seg->async_close = 0;
+    }
+#endif
 
     if (seg->list && seg->list_type != LIST_HLS)
         if ((ret = avio_open2(&seg->pb, seg->list, AVIO_FLAG_WRITE,
@@ -246,9 +377,9 @@ static int seg_write_header(AVFormatContext *s)
             goto fail;
     }
 
-    if (seg->list) {
+    if (seg->list && !seg->async_close) {
         if (seg->list_type == LIST_HLS) {
-            if ((ret = segment_hls_window(s, 0)) < 0)
+            if ((ret = segment_hls_window(s, 0, seg->number)) < 0)
                 goto fail;
         } else {
             avio_printf(seg->pb, "%s\n", oc->filename);
@@ -284,40 +415,39 @@ static int seg_write_packet(AVFormatContext *s, AVPacket *pkt)
         av_log(s, AV_LOG_DEBUG, "Next segment starts at %d %"PRId64"\n",
                pkt->stream_index, pkt->pts);
 
-        ret = segment_end(oc, seg->individual_header_trailer);
+#if HAVE_THREADS
+        if (seg->async_close) {
+            ret = segment_end_async(s);
+        } else
+#endif
+        {
+            ret = segment_end(oc, seg->individual_header_trailer);
 
-        if (!ret)
-            ret = segment_start(s, seg->individual_header_trailer);
+            if (!ret)
+                ret = segment_start(s, seg->individual_header_trailer);
+        }
+
+        oc = seg->avf;
 
         if (ret)
             goto fail;
 
-        oc = seg->avf;
-
-        if (seg->list) {
-            if (seg->list_type == LIST_HLS) {
-                if ((ret = segment_hls_window(s, 0)) < 0)
-                    goto fail;
-            } else {
-                avio_printf(seg->pb, "%s\n", oc->filename);
-                avio_flush(seg->pb);
-                if (seg->size && !(seg->number % seg->size)) {
-                    avio_closep(&seg->pb);
-                    if ((ret = avio_open2(&seg->pb, seg->list, AVIO_FLAG_WRITE,
-                                          &s->interrupt_callback, NULL)) < 0)
-                        goto fail;
-                }
-            }
-        }
+        /* With segment_async_close, the list is updated once the
+         * segment is written. */
+        if (seg->list && !seg->async_close &&
+            (ret = segment_list_update(s, oc->filename, seg->number)) < 0)
+            goto fail;
     }
 
     ret = ff_write_chained(oc, pkt->stream_index, pkt, s);
 
 fail:
     if (ret < 0) {
+        segment_finish_wait(seg);
         if (seg->list)
             avio_close(seg->pb);
-        avformat_free_context(oc);
+        if (oc)
+            avformat_free_context(oc);
     }
 
     return ret;
@@ -328,6 +458,10 @@ static int seg_write_trailer(struct AVFormatContext *s)
     SegmentContext *seg = s->priv_data;
     AVFormatContext *oc = seg->avf;
     int ret;
+
+    if ((ret = segment_finish_wait(seg)) < 0)
+        goto fail;
+
     if (!seg->write_header_trailer) {
         if ((ret = segment_end(oc, 0)) < 0)
             goto fail;
@@ -342,7 +476,10 @@ static int seg_write_trailer(struct AVFormatContext *s)
         goto fail;
 
     if (seg->list && seg->list_type == LIST_HLS) {
-        if ((ret = segment_hls_window(s, 1) < 0))
+        if ((ret = segment_hls_window(s, 1, seg->number) < 0))
+            goto fail;
+    } else if (seg->list && seg->async_close) {
+        if ((ret = segment_list_update(s, oc->filename, seg->number)) < 0)
             goto fail;
     }
 
@@ -365,6 +502,7 @@ static const AVOption options[] = {
     { "segment_wrap",      "number after which the index wraps",      OFFSET(wrap),    AV_OPT_TYPE_INT,    {.i64 = 0},     0, INT_MAX, E },
     { "individual_header_trailer", "write header/trailer to each segment", OFFSET(individual_header_trailer), AV_OPT_TYPE_INT, {.i64 = 1}, 0, 1, E },
     { "write_header_trailer", "write a header to the first segment and a trailer to the last one", OFFSET(write_header_trailer), AV_OPT_TYPE_INT, {.i64 = 1}, 0, 1, E },
+    { "segment_async_close", "finish and close segments in a separate thread", OFFSET(async_close), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 1, E },
     { NULL },
 };
 
@@ -0,0 +1,104 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/mem.h"
+#include "avformat.h"
+
+static void print_streams(AVFormatContext *ic, char *buf, int size)
+{
+    int i, len = 0;
+
+    buf[0] = 0;
+    for (i = 0; i < ic->nb_streams && len < size; i++) {
+        AVStream       *st = ic->streams[i];
+        AVCodecContext *c  = st->codec;
+
+        len += snprintf(buf + len, size - len,
+                        "stream %d: type %d codec %s %dx%d pix_fmt %d "
+                        "rate %d channels %d extradata %d tb %d/%d "
+                        "fps %d/%d start %"PRId64" duration %"PRId64"\n",
+                        i, c->codec_type, avcodec_descriptor_get(c->codec_id)->name,
+                        c->width, c->height, c->pix_fmt,
+                        c->sample_rate, c->channels, c->extradata_size,
+                        c->time_base.num, c->time_base.den,
+                        st->avg_frame_rate.num, st->avg_frame_rate.den,
+                        st->start_time, st->duration);
+    }
+}
+
+static int import(const char *filename, const uint8_t *info, int size,
+                  char *streams, int streams_size)
+{
+    AVFormatContext *ic = NULL;
+    int ret;
+
+    if ((ret = avformat_open_input(&ic, filename, NULL, NULL)) < 0)
+        return ret;
+    ret = avformat_import_stream_info(ic, info, size);
+    if (ret >= 0)
+        print_streams(ic, streams, streams_size);
+    avformat_close_input(&ic);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    AVFormatContext *ic = NULL;
+    char probed[4096], imported[4096];
+    uint8_t *info;
+    int size, ret;
+
+    if (argc < 2) {
+        printf("usage: %s input_file\n", argv[0]);
+        return 1;
+    }
+
+    av_register_all();
+
+    if ((ret = avformat_open_input(&ic, argv[1], NULL, NULL)) < 0)
+        return 1;
+    ic->flags |= AVFMT_FLAG_PARALLEL_PROBE;
+    if ((ret = avformat_find_stream_info(ic, NULL)) < 0 ||
+        (ret = avformat_export_stream_info(ic, &info, &size)) < 0) {
+        avformat_close_input(&ic);
+        return 1;
+    }
+    print_streams(ic, probed, sizeof(probed));
+    avformat_close_input(&ic);
+    printf("%s", probed);
+
+    ret = import(argv[1], info, size, imported, sizeof(imported));
+    printf("import: %s\n", ret < 0 ? "failed" :
+           strcmp(probed, imported) ? "different" : "same");
+
+    /* the data is rejected if it was made by another version */
+    info[4] ^= 1;
+    ret = import(argv[1], info, size, imported, sizeof(imported));
+    printf("import with another version: %s\n", ret < 0 ? "rejected" : "accepted");
+    info[4] ^= 1;
+
+    ret = import(argv[1], info, size - 1, imported, sizeof(imported));
+    printf("import of truncated data: %s\n", ret < 0 ? "rejected" : "accepted");
+
+    av_free(info);
+    return 0;
+}
@@ -25,6 +25,7 @@
  */
 
 #define _BSD_SOURCE     /* Needed for using struct ip_mreq with recent glibc */
+#define _GNU_SOURCE     /* Needed for sendmmsg() with glibc */
 
 #include "avformat.h"
 #include "avio_internal.h"
@@ -54,6 +55,7 @@ typedef struct {
 
 #define UDP_TX_BUF_SIZE 32768
 #define UDP_MAX_PKT_SIZE 65536
+#define UDP_MAX_BATCH 64
 
 static void log_net_error(void *ctx, int level, const char* prefix)
 {
@@ -612,6 +614,60 @@ static int udp_write(URLContext *h, const uint8_t *buf, int size)
     return ret < 0 ? ff_neterrno() : ret;
 }
 
+/**
+ * Send several datagrams, with a single system call when possible.
+ *
+ * @return the number of datagrams sent, or a negative error code if
+ *         none could be sent
+ */
+int ff_udp_write_packets(URLContext *h, uint8_t * const *bufs,
+                         const int *sizes, int nb_packets)
+{
+    int ret, sent = 0;
+#if HAVE_SENDMMSG
+    UDPContext *s = h->priv_data;
+    struct mmsghdr msgs[UDP_MAX_BATCH];
+    struct iovec iov[UDP_MAX_BATCH];
+    int i, n;
+
+    while (sent < nb_packets) {
+        n = FFMIN(nb_packets - sent, UDP_MAX_BATCH);
+        memset(msgs, 0, n * sizeof(*msgs));
+        for (i = 0; i < n; i++) {
+            iov[i].iov_base = bufs[sent + i];
+            iov[i].iov_len  = sizes[sent + i];
+            msgs[i].msg_hdr.msg_iov    = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            if (!s->is_connected) {
+                msgs[i].msg_hdr.msg_name    = &s->dest_addr;
+                msgs[i].msg_hdr.msg_namelen = s->dest_addr_len;
+            }
+        }
+
+        if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
+            ret = ff_network_wait_fd(s->udp_fd, 1);
+            if (ret < 0)
+                return sent ? sent : ret;
+        }
+        ret = sendmmsg(s->udp_fd, msgs, n, 0);
+        if (ret < 0) {
+            ret = ff_neterrno();
+            if (ret == AVERROR(EINTR))
+                continue;
+            return sent ? sent : ret;
+        }
+        sent += ret;
+    }
+#else
+    for (; sent < nb_packets; sent++) {
+        ret = udp_write(h, bufs[sent], sizes[sent]);
+        if (ret < 0)
+            return sent ? sent : ret;
+    }
+#endif
+    return sent;
+}
+
 static int udp_close(URLContext *h)
 {
     UDPContext *s = h->priv_data;
@@ -243,6 +243,17 @@ URLProtocol *ffurl_protocol_next(URLProtocol *prev);
 /* udp.c */
 int ff_udp_set_remote_url(URLContext *h, const char *uri);
 int ff_udp_get_local_port(URLContext *h);
+int ff_udp_write_packets(URLContext *h, uint8_t * const *bufs,
+                         const int *sizes, int nb_packets);
+
+/* memproto.c */
+/**
+ * Remove a file of the mem protocol. Readers which have opened it can
+ * still read it until they close it.
+ *
+ * @return 0 on success, AVERROR(ENOENT) if there is no such file
+ */
+int ff_mem_protocol_unlink(const char *url);
 
 /**
  * Assemble a URL string from components. This is the reverse operation
@@ -44,6 +44,11 @@
 #if CONFIG_NETWORK
 #include "network.h"
 #endif
+#if HAVE_PTHREADS
+#include <pthread.h>
+#elif HAVE_W32THREADS
+#include "compat/w32pthreads.h"
+#endif
 
 #undef NDEBUG
 #include <assert.h>
@@ -1922,16 +1927,11 @@ static int has_decode_delay_been_guessed(AVStream *st)
         st->info->nb_decoded_frames >= 6;
 }
 
-/* returns 1 or 0 if or if not decoded data was returned, or a negative error */
-static int try_decode_frame(AVStream *st, AVPacket *avpkt, AVDictionary **options)
+/* open the decoder used for probing, returns a negative error if there is none */
+static int try_open_decoder(AVStream *st, AVDictionary **options)
 {
     const AVCodec *codec;
-    int got_picture = 1, ret = 0;
-    AVFrame *frame = av_frame_alloc();
-    AVPacket pkt = *avpkt;
-
-    if (!frame)
-        return AVERROR(ENOMEM);
+    int ret;
 
     if (!avcodec_is_open(st->codec) && !st->info->found_decoder) {
         AVDictionary *thread_opt = NULL;
@@ -1941,8 +1941,7 @@ static int try_decode_frame(AVStream *st, AVPacket *avpkt, AVDictionary **option
 
         if (!codec) {
             st->info->found_decoder = -1;
-            ret = -1;
-            goto fail;
+            return -1;
         }
 
         /* force thread count to 1 since the h264 decoder will not extract SPS
@@ -1953,22 +1952,34 @@ static int try_decode_frame(AVStream *st, AVPacket *avpkt, AVDictionary **option
             av_dict_free(&thread_opt);
         if (ret < 0) {
             st->info->found_decoder = -1;
-            goto fail;
+            return ret;
         }
         st->info->found_decoder = 1;
     } else if (!st->info->found_decoder)
         st->info->found_decoder = 1;
 
-    if (st->info->found_decoder < 0) {
-        ret = -1;
+    return st->info->found_decoder < 0 ? -1 : 0;
+}
+
+/* returns 1 or 0 if or if not decoded data was returned, or a negative error */
+static int try_decode_frame(AVStream *st, AVPacket *avpkt, AVDictionary **options,
+                            int nb_frames)
+{
+    int got_picture = 1, ret = 0;
+    AVFrame *frame = av_frame_alloc();
+    AVPacket pkt = *avpkt;
+
+    if (!frame)
+        return AVERROR(ENOMEM);
+
+    if ((ret = try_open_decoder(st, options)) < 0)
         goto fail;
-    }
 
     while ((pkt.size > 0 || (!pkt.data && got_picture)) &&
            ret >= 0 &&
            (!has_codec_parameters(st)         ||
            !has_decode_delay_been_guessed(st) ||
-           (!st->codec_info_nb_frames && st->codec->codec->capabilities & CODEC_CAP_CHANNEL_CONF))) {
+           (!nb_frames && st->codec->codec->capabilities & CODEC_CAP_CHANNEL_CONF))) {
         got_picture = 0;
         switch(st->codec->codec_type) {
         case AVMEDIA_TYPE_VIDEO:
@@ -2115,6 +2126,202 @@ static int tb_unreliable(AVCodecContext *c){
     return 0;
 }
 
+#define PROBE_BATCH_SIZE 32
+
+/**
+ * Packets of one stream waiting to be decoded for probing.
+ */
+typedef struct ProbeJob {
+    AVStream *st;
+    AVPacket *pkt[PROBE_BATCH_SIZE];
+    int nb_frames[PROBE_BATCH_SIZE];
+    int nb_pkts;
+#if HAVE_THREADS
+    struct ProbeBatch *batch;
+    pthread_t thread;
+    pthread_cond_t cond;    ///< run or exit was set
+    int thread_started;
+    int run;                ///< the queued packets should be decoded
+#endif
+} ProbeJob;
+
+/**
+ * Packets read while probing, decoded in parallel once enough of them have
+ * been collected, by one thread per stream which lives for the whole
+ * probing.
+ */
+typedef struct ProbeBatch {
+    ProbeJob **jobs;
+    int nb_jobs;
+    int nb_pkts;
+#if HAVE_THREADS
+    pthread_mutex_t mutex;
+    pthread_cond_t done_cond;   ///< a job was run
+    int nb_running;
+    int exit;
+#endif
+} ProbeBatch;
+
+static void probe_job_run(ProbeJob *job)
+{
+    int i;
+
+    for (i = 0; i < job->nb_pkts; i++)
+        try_decode_frame(job->st, job->pkt[i], NULL, job->nb_frames[i]);
+    job->nb_pkts = 0;
+}
+
+#if HAVE_THREADS
+static void *probe_job_thread(void *arg)
+{
+    ProbeJob     *job = arg;
+    ProbeBatch *batch = job->batch;
+
+    pthread_mutex_lock(&batch->mutex);
+    for (;;) {
+        while (!job->run && !batch->exit)
+            pthread_cond_wait(&job->cond, &batch->mutex);
+        if (batch->exit)
+            break;
+        pthread_mutex_unlock(&batch->mutex);
+
+        probe_job_run(job);
+
+        pthread_mutex_lock(&batch->mutex);
+        job->run = 0;
+        batch->nb_running--;
+        pthread_cond_signal(&batch->done_cond);
+    }
+    pthread_mutex_unlock(&batch->mutex);
+    return NULL;
+}
+
+static int probe_job_start(ProbeBatch *batch, ProbeJob *job)
+{
+    if (!job->thread_started) {
+        job->batch = batch;
+        if (pthread_create(&job->thread, NULL, probe_job_thread, job))
+            return AVERROR(EAGAIN);
+        job->thread_started = 1;
+    }
+    pthread_mutex_lock(&batch->mutex);
+    job->run = 1;
+    batch->nb_running++;
+    pthread_cond_signal(&job->cond);
+    pthread_mutex_unlock(&batch->mutex);
+    return 0;
+}
+#endif
+
+static void probe_batch_init(ProbeBatch *batch)
+{
+    memset(batch, 0, sizeof(*batch));
+#if HAVE_THREADS
+    pthread_mutex_init(&batch->mutex, NULL);
+    pthread_cond_init(&batch->done_cond, NULL);
+#endif
+}
+
+static void probe_batch_free(ProbeBatch *batch)
+{
+    int i;
+
+#if HAVE_THREADS
+    pthread_mutex_lock(&batch->mutex);
+    batch->exit = 1;
+    for (i = 0; i < batch->nb_jobs; i++)
+        pthread_cond_signal(&batch->jobs[i]->cond);
+    pthread_mutex_unlock(&batch->mutex);
+#endif
+    for (i = 0; i < batch->nb_jobs; i++) {
+#if HAVE_THREADS
+        if (batch->jobs[i]->thread_started)
+            pthread_join(batch->jobs[i]->thread, NULL);
+        pthread_cond_destroy(&batch->jobs[i]->cond);
+#endif
+        av_freep(&batch->jobs[i]);
+    }
+    av_freep(&batch->jobs);
+    batch->nb_jobs = 0;
+#if HAVE_THREADS
+    pthread_cond_destroy(&batch->done_cond);
+    pthread_mutex_destroy(&batch->mutex);
+#endif
+}
+
+/* decode the queued packets, the streams are left alone by the threads once
+ * this returns */
+static void probe_batch_run(ProbeBatch *batch)
+{
+    ProbeJob *local = NULL;
+    int i;
+
+    for (i = 0; i < batch->nb_jobs; i++) {
+        ProbeJob *job = batch->jobs[i];
+
+        if (!job->nb_pkts)
+            continue;
+        /* decode one of the streams on the calling thread */
+        if (!local) {
+            local = job;
+            continue;
+        }
+#if HAVE_THREADS
+        if (probe_job_start(batch, job) >= 0)
+            continue;
+#endif
+        probe_job_run(job);
+    }
+    if (local)
+        probe_job_run(local);
+#if HAVE_THREADS
+    pthread_mutex_lock(&batch->mutex);
+    while (batch->nb_running)
+        pthread_cond_wait(&batch->done_cond, &batch->mutex);
+    pthread_mutex_unlock(&batch->mutex);
+#endif
+    batch->nb_pkts = 0;
+}
+
+static int probe_batch_add(ProbeBatch *batch, AVFormatContext *ic, AVStream *st,
+                           AVPacket *pkt, AVDictionary **options)
+{
+    ProbeJob *job;
+    int ret;
+
+    /* the jobs are allocated one by one, since the threads refer to them */
+    if (batch->nb_jobs < ic->nb_streams) {
+        if ((ret = av_reallocp_array(&batch->jobs, ic->nb_streams,
+                                     sizeof(*batch->jobs))) < 0) {
+            batch->nb_jobs = 0;
+            return ret;
+        }
+        while (batch->nb_jobs < ic->nb_streams) {
+            if (!(job = av_mallocz(sizeof(*job))))
+                return AVERROR(ENOMEM);
+#if HAVE_THREADS
+            pthread_cond_init(&job->cond, NULL);
+#endif
+            batch->jobs[batch->nb_jobs++] = job;
+        }
+    }
+
+    /* avcodec_open2() must not be called concurrently, so decoders are
+     * opened before the packets are handed to the decoding threads */
+    if (try_open_decoder(st, options) < 0)
+        return 0;
+
+    job = batch->jobs[st->index];
+    job->st                      = st;
+    job->pkt[job->nb_pkts]       = pkt;
+    job->nb_frames[job->nb_pkts] = st->codec_info_nb_frames;
+    job->nb_pkts++;
+
+    if (++batch->nb_pkts >= PROBE_BATCH_SIZE)
+        probe_batch_run(batch);
+    return 0;
+}
+
 int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
 {
     int i, count, ret, read_size, j;
@@ -2122,6 +2329,12 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
     AVPacket pkt1, *pkt;
     int64_t old_offset = avio_tell(ic->pb);
     int orig_nb_streams = ic->nb_streams;        // new streams might appear, no options for those
+    ProbeBatch batch;
+    /* decoding is deferred, so the packets must stay in the packet buffer */
+    int parallel = (ic->flags & AVFMT_FLAG_PARALLEL_PROBE) &&
+                   !(ic->flags & AVFMT_FLAG_NOBUFFER);
+
+    probe_batch_init(&batch);
 
     for(i=0;i<ic->nb_streams;i++) {
         const AVCodec *codec;
@@ -2228,6 +2441,8 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
             int err = 0;
             av_init_packet(&empty_pkt);
 
+            probe_batch_run(&batch);
+
             ret = -1; /* we could not have all the codec parameters before EOF */
             for(i=0;i<ic->nb_streams;i++) {
                 st = ic->streams[i];
@@ -2237,7 +2452,8 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
                     do {
                         err = try_decode_frame(st, &empty_pkt,
                                                (options && i < orig_nb_streams) ?
-                                               &options[i] : NULL);
+                                               &options[i] : NULL,
+                                               st->codec_info_nb_frames);
                     } while (err > 0 && !has_codec_parameters(st));
                 }
 
@@ -2312,8 +2528,10 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
             if (i > 0 && i < FF_MAX_EXTRADATA_SIZE) {
                 st->codec->extradata_size= i;
                 st->codec->extradata= av_malloc(st->codec->extradata_size + FF_INPUT_BUFFER_PADDING_SIZE);
-                if (!st->codec->extradata)
-                    return AVERROR(ENOMEM);
+                if (!st->codec->extradata) {
+                    ret = AVERROR(ENOMEM);
+                    goto find_stream_info_err;
+                }
                 memcpy(st->codec->extradata, pkt->data, st->codec->extradata_size);
                 memset(st->codec->extradata + i, 0, FF_INPUT_BUFFER_PADDING_SIZE);
             }
@@ -2328,11 +2546,20 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
            least one frame of codec data, this makes sure the codec initializes
            the channel configuration and does not only trust the values from the container.
         */
-        try_decode_frame(st, pkt, (options && i < orig_nb_streams ) ? &options[i] : NULL);
+        if (parallel) {
+            ret = probe_batch_add(&batch, ic, st, pkt,
+                                  (options && st->index < orig_nb_streams) ?
+                                  &options[st->index] : NULL);
+            if (ret < 0)
+                goto find_stream_info_err;
+        } else
+            try_decode_frame(st, pkt, (options && i < orig_nb_streams ) ? &options[i] : NULL,
+                             st->codec_info_nb_frames);
 
         st->codec_info_nb_frames++;
         count++;
     }
+    probe_batch_run(&batch);
 
     // close codecs which were opened in try_decode_frame()
     for(i=0;i<ic->nb_streams;i++) {
@@ -2397,6 +2624,7 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
     compute_chapters_end(ic);
 
  find_stream_info_err:
+    probe_batch_free(&batch);
     for (i=0; i < ic->nb_streams; i++) {
         ic->streams[i]->codec->thread_count = 0;
         av_freep(&ic->streams[i]->info);
@@ -2404,6 +2632,216 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
     return ret;
 }
 
+#define STREAM_INFO_TAG      MKBETAG('L', 'S', 'I', 'B')
+#define STREAM_INFO_HDR_SIZE 16
+#define STREAM_INFO_ST_SIZE  (33 * 4 + 8)
+
+int avformat_export_stream_info(AVFormatContext *ic, uint8_t **buf, int *size)
+{
+    PutByteContext pb;
+    int64_t total = STREAM_INFO_HDR_SIZE;
+    int i;
+
+    *buf  = NULL;
+    *size = 0;
+
+    for (i = 0; i < ic->nb_streams; i++)
+        total += STREAM_INFO_ST_SIZE + FFMAX(ic->streams[i]->codec->extradata_size, 0);
+    if (total > INT_MAX)
+        return AVERROR(EINVAL);
+    if (!(*buf = av_malloc(total)))
+        return AVERROR(ENOMEM);
+    *size = total;
+
+    bytestream2_init_writer(&pb, *buf, total);
+    bytestream2_put_be32(&pb, STREAM_INFO_TAG);
+    bytestream2_put_be32(&pb, LIBAVFORMAT_VERSION_INT);
+    bytestream2_put_be32(&pb, LIBAVCODEC_VERSION_INT);
+    bytestream2_put_be32(&pb, ic->nb_streams);
+
+    for (i = 0; i < ic->nb_streams; i++) {
+        AVStream       *st = ic->streams[i];
+        AVCodecContext *c  = st->codec;
+
+        bytestream2_put_be32(&pb, st->id);
+        bytestream2_put_be32(&pb, c->codec_type);
+        bytestream2_put_be32(&pb, c->codec_id);
+        bytestream2_put_be32(&pb, c->codec_tag);
+        bytestream2_put_be32(&pb, c->bit_rate);
+        bytestream2_put_be32(&pb, c->profile);
+        bytestream2_put_be32(&pb, c->level);
+        bytestream2_put_be32(&pb, c->time_base.num);
+        bytestream2_put_be32(&pb, c->time_base.den);
+        bytestream2_put_be32(&pb, c->ticks_per_frame);
+        bytestream2_put_be32(&pb, c->width);
+        bytestream2_put_be32(&pb, c->height);
+        bytestream2_put_be32(&pb, c->pix_fmt);
+        bytestream2_put_be32(&pb, c->has_b_frames);
+        bytestream2_put_be32(&pb, c->sample_aspect_ratio.num);
+        bytestream2_put_be32(&pb, c->sample_aspect_ratio.den);
+        bytestream2_put_be32(&pb, c->field_order);
+        bytestream2_put_be32(&pb, c->sample_rate);
+        bytestream2_put_be32(&pb, c->channels);
+        bytestream2_put_be64(&pb, c->channel_layout);
+        bytestream2_put_be32(&pb, c->sample_fmt);
+        bytestream2_put_be32(&pb, c->frame_size);
+        bytestream2_put_be32(&pb, c->block_align);
+        bytestream2_put_be32(&pb, c->bits_per_coded_sample);
+        bytestream2_put_be32(&pb, c->bits_per_raw_sample);
+        bytestream2_put_be32(&pb, c->audio_service_type);
+        bytestream2_put_be32(&pb, st->avg_frame_rate.num);
+        bytestream2_put_be32(&pb, st->avg_frame_rate.den);
+        bytestream2_put_be32(&pb, st->sample_aspect_ratio.num);
+        bytestream2_put_be32(&pb, st->sample_aspect_ratio.den);
+        bytestream2_put_be32(&pb, st->disposition);
+        bytestream2_put_be32(&pb, st->codec_info_nb_frames);
+        bytestream2_put_be32(&pb, c->extradata_size);
+        bytestream2_put_be32(&pb, 0); /* reserved */
+        if (c->extradata_size > 0)
+            bytestream2_put_buffer(&pb, c->extradata, c->extradata_size);
+    }
+
+    return 0;
+}
+
+/* check that the stream info matches the streams known to the demuxer */
+static int check_stream_info(AVFormatContext *ic, GetByteContext *gb)
+{
+    int i;
+
+    if (bytestream2_get_be32(gb) != STREAM_INFO_TAG  ||
+        bytestream2_get_be32(gb) != LIBAVFORMAT_VERSION_INT ||
+        bytestream2_get_be32(gb) != LIBAVCODEC_VERSION_INT  ||
+        bytestream2_get_be32(gb) != ic->nb_streams)
+        return AVERROR(EINVAL);
+
+    for (i = 0; i < ic->nb_streams; i++) {
+        AVStream *st = ic->streams[i];
+        int codec_type, extradata_size;
+
+        if (bytestream2_get_bytes_left(gb) < STREAM_INFO_ST_SIZE ||
+            bytestream2_get_be32(gb) != st->id)
+            return AVERROR(EINVAL);
+        /* the codec id may be refined by probing, the type may not */
+        codec_type = bytestream2_get_be32(gb);
+        if (st->codec->codec_type != AVMEDIA_TYPE_UNKNOWN &&
+            st->codec->codec_type != AVMEDIA_TYPE_DATA &&
+            st->codec->codec_type != codec_type)
+            return AVERROR(EINVAL);
+        bytestream2_skip(gb, STREAM_INFO_ST_SIZE - 16);
+        extradata_size = bytestream2_get_be32(gb);
+        bytestream2_skip(gb, 4);
+        if (extradata_size < 0 ||
+            extradata_size > bytestream2_get_bytes_left(gb))
+            return AVERROR(EINVAL);
+        bytestream2_skip(gb, extradata_size);
+    }
+    return 0;
+}
+
+int avformat_import_stream_info(AVFormatContext *ic, const uint8_t *buf, int size)
+{
+    GetByteContext gb;
+    int64_t old_offset = avio_tell(ic->pb);
+    int i, ret, read_size;
+
+    bytestream2_init(&gb, buf, size);
+    if ((ret = check_stream_info(ic, &gb)) < 0) {
+        av_log(ic, AV_LOG_WARNING, "Stream info does not match the input\n");
+        return ret;
+    }
+
+    bytestream2_init(&gb, buf, size);
+    bytestream2_skip(&gb, STREAM_INFO_HDR_SIZE);
+    for (i = 0; i < ic->nb_streams; i++) {
+        AVStream       *st = ic->streams[i];
+        AVCodecContext *c  = st->codec;
+        int extradata_size;
+
+        bytestream2_skip(&gb, 4);
+        c->codec_type              = bytestream2_get_be32(&gb);
+        c->codec_id                = bytestream2_get_be32(&gb);
+        c->codec_tag               = bytestream2_get_be32(&gb);
+        c->bit_rate                = bytestream2_get_be32(&gb);
+        c->profile                 = bytestream2_get_be32(&gb);
+        c->level                   = bytestream2_get_be32(&gb);
+        c->time_base.num           = bytestream2_get_be32(&gb);
+        c->time_base.den           = bytestream2_get_be32(&gb);
+        c->ticks_per_frame         = bytestream2_get_be32(&gb);
+        c->width                   = bytestream2_get_be32(&gb);
+        c->height                  = bytestream2_get_be32(&gb);
+        c->pix_fmt                 = bytestream2_get_be32(&gb);
+        c->has_b_frames            = bytestream2_get_be32(&gb);
+        c->sample_aspect_ratio.num = bytestream2_get_be32(&gb);
+        c->sample_aspect_ratio.den = bytestream2_get_be32(&gb);
+        c->field_order             = bytestream2_get_be32(&gb);
+        c->sample_rate             = bytestream2_get_be32(&gb);
+        c->channels                = bytestream2_get_be32(&gb);
+        c->channel_layout          = bytestream2_get_be64(&gb);
+        c->sample_fmt              = bytestream2_get_be32(&gb);
+        c->frame_size              = bytestream2_get_be32(&gb);
+        c->block_align             = bytestream2_get_be32(&gb);
+        c->bits_per_coded_sample   = bytestream2_get_be32(&gb);
+        c->bits_per_raw_sample     = bytestream2_get_be32(&gb);
+        c->audio_service_type      = bytestream2_get_be32(&gb);
+        st->avg_frame_rate.num     = bytestream2_get_be32(&gb);
+        st->avg_frame_rate.den     = bytestream2_get_be32(&gb);
+        st->sample_aspect_ratio.num = bytestream2_get_be32(&gb);
+        st->sample_aspect_ratio.den = bytestream2_get_be32(&gb);
+        st->disposition            = bytestream2_get_be32(&gb);
+        st->codec_info_nb_frames   = bytestream2_get_be32(&gb);
+        extradata_size             = bytestream2_get_be32(&gb);
+        bytestream2_skip(&gb, 4);
+
+        if (extradata_size && (extradata_size != c->extradata_size ||
+                               memcmp(c->extradata, gb.buffer, extradata_size))) {
+            av_freep(&c->extradata);
+            c->extradata_size = 0;
+            c->extradata = av_mallocz(extradata_size + FF_INPUT_BUFFER_PADDING_SIZE);
+            if (!c->extradata)
+                return AVERROR(ENOMEM);
+            c->extradata_size = extradata_size;
+        }
+        if (extradata_size)
+            bytestream2_get_buffer(&gb, c->extradata, extradata_size);
+    }
+
+    /* read the first packets of each stream to get their start times, the
+     * packets are buffered like in avformat_find_stream_info() */
+    read_size = 0;
+    while (read_size < ic->probesize) {
+        AVPacket pkt1, *pkt;
+
+        for (i = 0; i < ic->nb_streams; i++) {
+            AVStream *st = ic->streams[i];
+            if (st->first_dts == AV_NOPTS_VALUE &&
+                (st->codec->codec_type == AVMEDIA_TYPE_VIDEO ||
+                 st->codec->codec_type == AVMEDIA_TYPE_AUDIO))
+                break;
+        }
+        if (i == ic->nb_streams)
+            break;
+
+        ret = read_frame_internal(ic, &pkt1);
+        if (ret == AVERROR(EAGAIN))
+            continue;
+        if (ret < 0)
+            break;
+        pkt = add_to_pktbuf(&ic->packet_buffer, &pkt1, &ic->packet_buffer_end);
+        if ((ret = av_dup_packet(pkt)) < 0)
+            return ret;
+        read_size += pkt->size;
+    }
+
+    estimate_timings(ic, old_offset);
+
+    compute_chapters_end(ic);
+
+    for (i = 0; i < ic->nb_streams; i++)
+        av_freep(&ic->streams[i]->info);
+    return 0;
+}
+
 static AVProgram *find_program_from_stream(AVFormatContext *ic, int s)
 {
     int i, j;
@@ -0,0 +1,269 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+#elif HAVE_W32THREADS
+#include "compat/w32pthreads.h"
+#endif
+
+#include "atomic.h"
+#include "common.h"
+#include "error.h"
+#include "mem.h"
+#include "spsc_queue.h"
+
+struct AVSPSCQueue {
+    uint8_t *elems;
+    unsigned elem_size;
+    unsigned nb_elems;
+    unsigned mask;          ///< size of the element array - 1, a power of 2 - 1
+
+    /* The positions only grow (modulo 2^32), each one is written by one side.
+     * The atomic accessors act as memory barriers, so an element is fully
+     * written or read before the position moves past it. */
+    volatile int send_pos;  ///< number of elements sent
+    volatile int recv_pos;  ///< number of elements received
+
+    volatile int err_send;
+    volatile int err_recv;
+
+    volatile int send_waiting;  ///< the sender is, or is about to be, waiting
+    volatile int recv_waiting;  ///< the receiver is, or is about to be, waiting
+#if HAVE_THREADS
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+#endif
+};
+
+int av_spsc_queue_alloc(AVSPSCQueue **queue, unsigned nb_elems,
+                        unsigned elem_size)
+{
+    AVSPSCQueue *q;
+    unsigned size = 1;
+
+    if (!nb_elems || !elem_size || nb_elems > INT_MAX / 2 / elem_size)
+        return AVERROR(EINVAL);
+    while (size < nb_elems)
+        size <<= 1;
+
+    if (!(q = av_mallocz(sizeof(*q))))
+        return AVERROR(ENOMEM);
+    if (!(q->elems = av_malloc(size * elem_size))) {
+        av_free(q);
+        return AVERROR(ENOMEM);
+    }
+    q->elem_size = elem_size;
+    q->nb_elems  = nb_elems;
+    q->mask      = size - 1;
+#if HAVE_THREADS
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->cond, NULL);
+#endif
+
+    *queue = q;
+    return 0;
+}
+
+void av_spsc_queue_free(AVSPSCQueue **queue)
+{
+    AVSPSCQueue *q = *queue;
+
+    if (!q)
+        return;
+#if HAVE_THREADS
+    pthread_cond_destroy(&q->cond);
+    pthread_mutex_destroy(&q->lock);
+#endif
+    av_free(q->elems);
+    av_freep(queue);
+}
+
+static int can_send(AVSPSCQueue *q)
+{
+    return avpriv_atomic_int_get(&q->err_send) < 0 ||
+           (unsigned)q->send_pos -
+           (unsigned)avpriv_atomic_int_get(&q->recv_pos) < q->nb_elems;
+}
+
+static int can_recv(AVSPSCQueue *q)
+{
+    return avpriv_atomic_int_get(&q->err_recv) < 0 ||
+           q->recv_pos != avpriv_atomic_int_get(&q->send_pos);
+}
+
+static int queue_wait(AVSPSCQueue *q, volatile int *waiting,
+                      int (*ready)(AVSPSCQueue *q))
+{
+#if HAVE_THREADS
+    pthread_mutex_lock(&q->lock);
+    /* Setting the flag before checking again pairs with the other side
+     * moving its position before checking the flag, so that either this
+     * side sees the new position or the other side sees the flag. */
+    avpriv_atomic_int_set(waiting, 1);
+    while (!ready(q))
+        pthread_cond_wait(&q->cond, &q->lock);
+    avpriv_atomic_int_set(waiting, 0);
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+#else
+    /* nobody else could make progress */
+    return AVERROR(EAGAIN);
+#endif
+}
+
+static void queue_wake(AVSPSCQueue *q, volatile int *waiting)
+{
+#if HAVE_THREADS
+    if (!waiting || avpriv_atomic_int_get(waiting)) {
+        pthread_mutex_lock(&q->lock);
+        pthread_cond_broadcast(&q->cond);
+        pthread_mutex_unlock(&q->lock);
+    }
+#endif
+}
+
+int av_spsc_queue_send(AVSPSCQueue *q, const void *elem, unsigned flags)
+{
+    unsigned pos = q->send_pos;
+    int ret;
+
+    while (!can_send(q)) {
+        if (flags & AV_SPSC_QUEUE_FLAG_NONBLOCK)
+            return AVERROR(EAGAIN);
+        if ((ret = queue_wait(q, &q->send_waiting, can_send)) < 0)
+            return ret;
+    }
+    if ((ret = avpriv_atomic_int_get(&q->err_send)) < 0)
+        return ret;
+
+    memcpy(q->elems + (pos & q->mask) * q->elem_size, elem, q->elem_size);
+    avpriv_atomic_int_set(&q->send_pos, pos + 1);
+    queue_wake(q, &q->recv_waiting);
+
+    return 0;
+}
+
+int av_spsc_queue_recv(AVSPSCQueue *q, void *elem, unsigned flags)
+{
+    unsigned pos = q->recv_pos;
+    int ret;
+
+    while (!can_recv(q)) {
+        if (flags & AV_SPSC_QUEUE_FLAG_NONBLOCK)
+            return AVERROR(EAGAIN);
+        if ((ret = queue_wait(q, &q->recv_waiting, can_recv)) < 0)
+            return ret;
+    }
+    /* The error is read before the position, so that elements sent before
+     * the error was set are always received. */
+    ret = avpriv_atomic_int_get(&q->err_recv);
+    if (pos == avpriv_atomic_int_get(&q->send_pos))
+        return ret;
+
+    memcpy(elem, q->elems + (pos & q->mask) * q->elem_size, q->elem_size);
+    avpriv_atomic_int_set(&q->recv_pos, pos + 1);
+    queue_wake(q, &q->send_waiting);
+
+    return 0;
+}
+
+void av_spsc_queue_set_err_send(AVSPSCQueue *q, int err)
+{
+    avpriv_atomic_int_set(&q->err_send, err);
+    queue_wake(q, NULL);
+}
+
+void av_spsc_queue_set_err_recv(AVSPSCQueue *q, int err)
+{
+    avpriv_atomic_int_set(&q->err_recv, err);
+    queue_wake(q, NULL);
+}
+
+#ifdef TEST
+#include <assert.h>
+
+#define NB_ELEMS 100000
+
+#if HAVE_THREADS
+static void *sender(void *arg)
+{
+    AVSPSCQueue *q = arg;
+    int i;
+
+    for (i = 0; i < NB_ELEMS; i++)
+        if (av_spsc_queue_send(q, &i, 0) < 0)
+            break;
+    av_spsc_queue_set_err_recv(q, AVERROR_EOF);
+    return NULL;
+}
+#endif
+
+int main(void)
+{
+    AVSPSCQueue *q;
+    int i, val, ret;
+
+    ret = av_spsc_queue_alloc(&q, 3, sizeof(int));
+    assert(ret == 0);
+
+    /* single thread */
+    for (i = 0; i < 3; i++) {
+        ret = av_spsc_queue_send(q, &i, AV_SPSC_QUEUE_FLAG_NONBLOCK);
+        assert(ret == 0);
+    }
+    ret = av_spsc_queue_send(q, &i, AV_SPSC_QUEUE_FLAG_NONBLOCK);
+    assert(ret == AVERROR(EAGAIN));
+    av_spsc_queue_set_err_recv(q, AVERROR_EOF);
+    for (i = 0; i < 3; i++) {
+        ret = av_spsc_queue_recv(q, &val, AV_SPSC_QUEUE_FLAG_NONBLOCK);
+        assert(ret == 0 && val == i);
+    }
+    ret = av_spsc_queue_recv(q, &val, 0);
+    assert(ret == AVERROR_EOF);
+    av_spsc_queue_set_err_send(q, AVERROR_EXIT);
+    ret = av_spsc_queue_send(q, &i, 0);
+    assert(ret == AVERROR_EXIT);
+    av_spsc_queue_free(&q);
+    assert(!q);
+
+#if HAVE_THREADS
+    {
+        pthread_t thread;
+
+        /* a small queue, so that both sides have to wait */
+        ret = av_spsc_queue_alloc(&q, 3, sizeof(int));
+        assert(ret == 0);
+        ret = pthread_create(&thread, NULL, sender, q);
+        assert(ret == 0);
+        for (i = 0; (ret = av_spsc_queue_recv(q, &val, 0)) >= 0; i++)
+            assert(val == i);
+        assert(ret == AVERROR_EOF && i == NB_ELEMS);
+        pthread_join(thread, NULL);
+        av_spsc_queue_free(&q);
+    }
+#endif
+
+    return 0;
+}
+#endif
@@ -0,0 +1,103 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * lock-free single producer, single consumer queue
+ */
+
+#ifndef AVUTIL_SPSC_QUEUE_H
+#define AVUTIL_SPSC_QUEUE_H
+
+/**
+ * A bounded queue of fixed size elements, passed from one sending thread to
+ * one receiving thread.
+ *
+ * Elements are copied in and out of the queue, so e.g. an AVPacket or a
+ * pointer to an AVFrame can be sent to hand its ownership over to the
+ * receiver. Sending and receiving do not take any lock unless the queue is
+ * full or empty and the caller has to wait.
+ */
+typedef struct AVSPSCQueue AVSPSCQueue;
+
+/**
+ * Do not wait if the queue is full when sending, or empty when receiving,
+ * return AVERROR(EAGAIN) instead.
+ */
+#define AV_SPSC_QUEUE_FLAG_NONBLOCK 1
+
+/**
+ * Allocate a new queue.
+ *
+ * @param queue     pointer to the new queue on success
+ * @param nb_elems  maximum number of elements in the queue
+ * @param elem_size size of an element in bytes
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int av_spsc_queue_alloc(AVSPSCQueue **queue, unsigned nb_elems,
+                        unsigned elem_size);
+
+/**
+ * Free a queue and set the pointer to NULL.
+ *
+ * Elements still in the queue are not released, they should be received
+ * first if they own anything.
+ */
+void av_spsc_queue_free(AVSPSCQueue **queue);
+
+/**
+ * Send an element, waiting for free space unless
+ * AV_SPSC_QUEUE_FLAG_NONBLOCK is set.
+ *
+ * Must only be called from the sending thread.
+ *
+ * @return 0 on success, AVERROR(EAGAIN) if the queue is full and
+ *         AV_SPSC_QUEUE_FLAG_NONBLOCK is set, or the error set by
+ *         av_spsc_queue_set_err_send(); the element is not queued on failure
+ */
+int av_spsc_queue_send(AVSPSCQueue *queue, const void *elem, unsigned flags);
+
+/**
+ * Receive an element, waiting for one unless AV_SPSC_QUEUE_FLAG_NONBLOCK
+ * is set.
+ *
+ * Must only be called from the receiving thread.
+ *
+ * @return 0 on success, AVERROR(EAGAIN) if the queue is empty and
+ *         AV_SPSC_QUEUE_FLAG_NONBLOCK is set, or the error set by
+ *         av_spsc_queue_set_err_recv() once the queue is empty
+ */
+int av_spsc_queue_recv(AVSPSCQueue *queue, void *elem, unsigned flags);
+
+/**
+ * Make all following and currently waiting av_spsc_queue_send() calls
+ * return err, e.g. when the receiver stops.
+ *
+ * @param err a negative AVERROR code
+ */
+void av_spsc_queue_set_err_send(AVSPSCQueue *queue, int err);
+
+/**
+ * Make av_spsc_queue_recv() return err once the queue is empty, e.g.
+ * AVERROR_EOF when the sender has sent its last element.
+ *
+ * @param err a negative AVERROR code
+ */
+void av_spsc_queue_set_err_recv(AVSPSCQueue *queue, int err);
+
+#endif /* AVUTIL_SPSC_QUEUE_H */
@@ -0,0 +1,588 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+#elif HAVE_W32THREADS
+#include "compat/w32pthreads.h"
+#endif
+
+#include "atomic.h"
+#include "common.h"
+#include "cpu.h"
+#include "error.h"
+#include "internal.h"
+#include "mem.h"
+#include "threadpool.h"
+
+/* maximum number of ranges in the deque of a worker */
+#define MAX_RANGES 64
+/* maximum number of threads running the jobs of a batch */
+#define MAX_SLOTS  64
+
+#if HAVE_THREADS
+typedef struct Batch {
+    AVThreadPoolJobFunc *func;
+    void *opaque;
+    int *rets;
+    int nb_jobs;
+
+    /* Protected by the mutex. The caller keeps thread number 0 for itself,
+     * the others are taken from free_slots for each job. */
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int nb_done;
+    int waiting;                ///< the caller waits for a job to finish
+    int free_slots[MAX_SLOTS];
+    int nb_free_slots;
+} Batch;
+
+/* The jobs from start to end - 1 of a batch */
+typedef struct Range {
+    Batch *batch;
+    int start;
+    int end;
+} Range;
+
+typedef struct Job {
+    Batch *batch;
+    int jobnr;
+    int slot;
+    int release_slot;
+} Job;
+
+/* A ring of ranges, run from the front by its worker and stolen from the
+ * back by the other threads. */
+typedef struct Deque {
+    pthread_mutex_t mutex;
+    Range ranges[MAX_RANGES];
+    int first;
+    int nb;
+    int nb_reserved;            ///< room kept for the ranges split by the worker
+} Deque;
+
+typedef struct Worker {
+    AVThreadPool *pool;
+    pthread_t thread;
+    int thread_init;
+    Deque deque;
+} Worker;
+
+struct AVThreadPool {
+    Worker *workers;
+    int nb_threads;
+    volatile int next_worker;   ///< the worker to give the next range to
+
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;        ///< ranges were queued, or exit was set
+    unsigned work_seq;          ///< incremented when ranges are queued
+    int exit;
+};
+
+#define RANGE(d, i) (&(d)->ranges[((d)->first + (i)) % MAX_RANGES])
+
+static int push_range(Deque *d, const Range *r)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&d->mutex);
+    if (d->nb + d->nb_reserved < MAX_RANGES) {
+        *RANGE(d, d->nb++) = *r;
+        ret = 1;
+    }
+    pthread_mutex_unlock(&d->mutex);
+    return ret;
+}
+
+/* Keep room in d for a range, so that the range can be pushed later. */
+static int reserve_range(Deque *d)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&d->mutex);
+    if (d->nb + d->nb_reserved < MAX_RANGES) {
+        d->nb_reserved++;
+        ret = 1;
+    }
+    pthread_mutex_unlock(&d->mutex);
+    return ret;
+}
+
+/* Release the room reserved in d, pushing r into it if r is not NULL. */
+static void push_reserved_range(Deque *d, const Range *r)
+{
+    pthread_mutex_lock(&d->mutex);
+    d->nb_reserved--;
+    if (r)
+        *RANGE(d, d->nb++) = *r;
+    pthread_mutex_unlock(&d->mutex);
+}
+
+static void remove_range(Deque *d, int i)
+{
+    for (; i < d->nb - 1; i++)
+        *RANGE(d, i) = *RANGE(d, i + 1);
+    d->nb--;
+}
+
+/* Must be called with the deque mutex held. */
+static int get_slot(Batch *b, Batch *own, int *slot, int *release_slot)
+{
+    int ret = 0;
+
+    if (b == own) {
+        *slot         = 0;
+        *release_slot = 0;
+        return 1;
+    }
+    pthread_mutex_lock(&b->mutex);
+    if (b->nb_free_slots) {
+        *slot         = b->free_slots[--b->nb_free_slots];
+        *release_slot = 1;
+        ret = 1;
+    }
+    pthread_mutex_unlock(&b->mutex);
+    return ret;
+}
+
+/**
+ * Take a job from the front of the deque of self, or steal from the back of
+ * another deque. A worker steals the second half of a range if its deque
+ * has room for the rest, else it takes single jobs like the caller of a
+ * batch (self == NULL), which only takes jobs of its own batch.
+ */
+static int find_job(AVThreadPool *pool, Worker *self, Batch *own, Job *job)
+{
+    int self_idx = self ? self - pool->workers : 0;
+    int i, k, can_split;
+
+    if (self) {
+        Deque *d = &self->deque;
+
+        pthread_mutex_lock(&d->mutex);
+        for (i = 0; i < d->nb; i++) {
+            Range *r = RANGE(d, i);
+
+            if (!get_slot(r->batch, own, &job->slot, &job->release_slot))
+                continue;
+            job->batch = r->batch;
+            job->jobnr = r->start++;
+            if (r->start == r->end)
+                remove_range(d, i);
+            pthread_mutex_unlock(&d->mutex);
+            return 1;
+        }
+        pthread_mutex_unlock(&d->mutex);
+    }
+
+    /* the room is reserved before the range is split, so that no job is
+     * lost if the deque of the victim fills up meanwhile */
+    can_split = self && reserve_range(&self->deque);
+
+    for (k = !!self; k < pool->nb_threads; k++) {
+        Deque *d = &pool->workers[(self_idx + k) % pool->nb_threads].deque;
+        Range stolen = { NULL };
+
+        pthread_mutex_lock(&d->mutex);
+        for (i = d->nb - 1; i >= 0; i--) {
+            Range *r = RANGE(d, i);
+
+            if (own && r->batch != own)
+                continue;
+            if (!get_slot(r->batch, own, &job->slot, &job->release_slot))
+                continue;
+            job->batch = r->batch;
+            if (can_split && r->end - r->start > 1) {
+                int mid = (r->start + r->end + 1) / 2;
+                job->jobnr   = mid;
+                stolen.batch = r->batch;
+                stolen.start = mid + 1;
+                stolen.end   = r->end;
+                r->end       = mid;
+            } else {
+                job->jobnr = --r->end;
+                if (r->start == r->end)
+                    remove_range(d, i);
+            }
+            break;
+        }
+        pthread_mutex_unlock(&d->mutex);
+
+        if (i >= 0) {
+            if (can_split)
+                push_reserved_range(&self->deque,
+                                    stolen.start < stolen.end ? &stolen : NULL);
+            return 1;
+        }
+    }
+    if (can_split)
+        push_reserved_range(&self->deque, NULL);
+    return 0;
+}
+
+static void run_job(Job *job)
+{
+    Batch *b = job->batch;
+    int ret = b->func(b->opaque, job->jobnr, job->slot);
+
+    if (b->rets)
+        b->rets[job->jobnr] = ret;
+
+    pthread_mutex_lock(&b->mutex);
+    b->nb_done++;
+    if (job->release_slot)
+        b->free_slots[b->nb_free_slots++] = job->slot;
+    if (b->waiting)
+        pthread_cond_signal(&b->cond);
+    pthread_mutex_unlock(&b->mutex);
+}
+
+static void *attribute_align_arg worker_thread(void *arg)
+{
+    Worker *w = arg;
+    AVThreadPool *pool = w->pool;
+    Job job;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (!pool->exit) {
+        unsigned seq = pool->work_seq;
+        pthread_mutex_unlock(&pool->mutex);
+
+        while (find_job(pool, w, NULL, &job))
+            run_job(&job);
+
+        pthread_mutex_lock(&pool->mutex);
+        while (seq == pool->work_seq && !pool->exit)
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+int av_thread_pool_alloc(AVThreadPool **ppool, int nb_threads)
+{
+    AVThreadPool *pool;
+    int i, ret;
+
+#if HAVE_W32THREADS
+    w32thread_init();
+#endif
+
+    if (nb_threads < 0)
+        return AVERROR(EINVAL);
+    if (!nb_threads)
+        nb_threads = av_cpu_count();
+
+    if (!(pool = av_mallocz(sizeof(*pool))))
+        return AVERROR(ENOMEM);
+    if (!(pool->workers = av_mallocz(nb_threads * sizeof(*pool->workers)))) {
+        av_free(pool);
+        return AVERROR(ENOMEM);
+    }
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    for (i = 0; i < nb_threads; i++) {
+        pool->workers[i].pool = pool;
+        pthread_mutex_init(&pool->workers[i].deque.mutex, NULL);
+    }
+    pool->nb_threads = nb_threads;
+
+    for (i = 0; i < nb_threads; i++) {
+        Worker *w = &pool->workers[i];
+
+        if ((ret = pthread_create(&w->thread, NULL, worker_thread, w))) {
+            av_thread_pool_free(&pool);
+            return AVERROR(ret);
+        }
+        w->thread_init = 1;
+    }
+
+    *ppool = pool;
+    return 0;
+}
+
+void av_thread_pool_free(AVThreadPool **ppool)
+{
+    AVThreadPool *pool = *ppool;
+    int i;
+
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->exit = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (i = 0; i < pool->nb_threads; i++) {
+        if (pool->workers[i].thread_init)
+            pthread_join(pool->workers[i].thread, NULL);
+        pthread_mutex_destroy(&pool->workers[i].deque.mutex);
+    }
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->mutex);
+    av_free(pool->workers);
+    av_freep(ppool);
+}
+
+AVThreadPool *av_thread_pool_get_shared(void)
+{
+    static AVThreadPool * volatile shared_pool;
+    AVThreadPool *pool = shared_pool;
+
+    if (!pool) {
+        if (av_thread_pool_alloc(&pool, 0) < 0)
+            return NULL;
+        /* another thread may have been faster */
+        if (avpriv_atomic_ptr_cas((void * volatile *)&shared_pool, NULL, pool)) {
+            av_thread_pool_free(&pool);
+            pool = shared_pool;
+        }
+    }
+    return pool;
+}
+
+int av_thread_pool_get_nb_threads(AVThreadPool *pool)
+{
+    return pool->nb_threads;
+}
+
+int av_thread_pool_execute(AVThreadPool *pool, AVThreadPoolJobFunc *func,
+                           void *opaque, int *rets, int nb_jobs,
+                           int max_threads)
+{
+    Range local[MAX_SLOTS];
+    Batch b = { 0 };
+    Job job;
+    int nb_parts, nb_local = 0, i;
+
+    if (nb_jobs <= 0)
+        return 0;
+    if (max_threads < 1)
+        return AVERROR(EINVAL);
+
+    max_threads = FFMIN3(max_threads, MAX_SLOTS, pool ? pool->nb_threads + 1 : 1);
+    nb_parts    = FFMIN(max_threads, nb_jobs);
+    if (nb_parts == 1) {
+        for (i = 0; i < nb_jobs; i++) {
+            int ret = func(opaque, i, 0);
+            if (rets)
+                rets[i] = ret;
+        }
+        return 0;
+    }
+
+    b.func    = func;
+    b.opaque  = opaque;
+    b.rets    = rets;
+    b.nb_jobs = nb_jobs;
+    for (i = 1; i < max_threads; i++)
+        b.free_slots[b.nb_free_slots++] = max_threads - i;
+    pthread_mutex_init(&b.mutex, NULL);
+    pthread_cond_init(&b.cond, NULL);
+
+    /* Split the jobs in contiguous parts, the first one is run by the
+     * caller and the others are spread over the deques of the workers. */
+    local[nb_local++] = (Range){ &b, 0, nb_jobs / nb_parts };
+    for (i = 1; i < nb_parts; i++) {
+        Range r = { &b, i * nb_jobs / nb_parts, (i + 1) * nb_jobs / nb_parts };
+        int w   = (unsigned)avpriv_atomic_int_add_and_fetch(&pool->next_worker, 1) %
+                  pool->nb_threads;
+
+        if (!push_range(&pool->workers[w].deque, &r))
+            local[nb_local++] = r;
+    }
+    pthread_mutex_lock(&pool->mutex);
+    pool->work_seq++;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (i = 0; i < nb_local; i++) {
+        Range *r = &local[i];
+        for (job.jobnr = r->start; job.jobnr < r->end; job.jobnr++) {
+            job.batch        = &b;
+            job.slot         = 0;
+            job.release_slot = 0;
+            run_job(&job);
+        }
+    }
+
+    /* help with the rest of the batch, then wait for the jobs run by others */
+    for (;;) {
+        while (find_job(pool, NULL, &b, &job))
+            run_job(&job);
+
+        pthread_mutex_lock(&b.mutex);
+        if (b.nb_done == nb_jobs) {
+            pthread_mutex_unlock(&b.mutex);
+            break;
+        }
+        b.waiting = 1;
+        pthread_cond_wait(&b.cond, &b.mutex);
+        b.waiting = 0;
+        pthread_mutex_unlock(&b.mutex);
+    }
+
+    pthread_cond_destroy(&b.cond);
+    pthread_mutex_destroy(&b.mutex);
+    return 0;
+}
+
+#else /* HAVE_THREADS */
+
+int av_thread_pool_alloc(AVThreadPool **pool, int nb_threads)
+{
+    return AVERROR(ENOSYS);
+}
+
+void av_thread_pool_free(AVThreadPool **pool)
+{
+}
+
+AVThreadPool *av_thread_pool_get_shared(void)
+{
+    return NULL;
+}
+
+int av_thread_pool_get_nb_threads(AVThreadPool *pool)
+{
+    return 0;
+}
+
+int av_thread_pool_execute(AVThreadPool *pool, AVThreadPoolJobFunc *func,
+                           void *opaque, int *rets, int nb_jobs,
+                           int max_threads)
+{
+    int i;
+
+    if (max_threads < 1)
+        return AVERROR(EINVAL);
+    for (i = 0; i < nb_jobs; i++) {
+        int ret = func(opaque, i, 0);
+        if (rets)
+            rets[i] = ret;
+    }
+    return 0;
+}
+
+#endif /* HAVE_THREADS */
+
+#ifdef TEST
+#include <assert.h>
+
+#define NB_JOBS 1000
+
+typedef struct TestBatch {
+    AVThreadPool *pool;
+    int max_threads;
+    volatile int runs[NB_JOBS];
+    volatile int busy[MAX_SLOTS];
+    int nested;
+} TestBatch;
+
+static int test_job(void *opaque, int jobnr, int threadnr)
+{
+    TestBatch *t = opaque;
+    int rets[4];
+    int busy;
+
+    assert(threadnr >= 0 && threadnr < t->max_threads);
+    busy = avpriv_atomic_int_add_and_fetch(&t->busy[threadnr], 1);
+    assert(busy == 1);
+    avpriv_atomic_int_add_and_fetch(&t->runs[jobnr], 1);
+    if (t->nested && !(jobnr % 100)) {
+        TestBatch *n = av_mallocz(sizeof(*n));
+        int i;
+
+        n->pool        = t->pool;
+        n->max_threads = 2;
+        av_thread_pool_execute(n->pool, test_job, n, rets, 4, n->max_threads);
+        for (i = 0; i < 4; i++)
+            assert(n->runs[i] == 1 && rets[i] == i);
+        av_free(n);
+    }
+    busy = avpriv_atomic_int_add_and_fetch(&t->busy[threadnr], -1);
+    assert(busy == 0);
+    return jobnr;
+}
+
+static void check_batch(AVThreadPool *pool, int max_threads, int nested)
+{
+    TestBatch *t = av_mallocz(sizeof(*t));
+    int *rets    = av_malloc(NB_JOBS * sizeof(*rets));
+    int i, ret;
+
+    t->pool        = pool;
+    t->max_threads = max_threads;
+    t->nested      = nested;
+    ret = av_thread_pool_execute(pool, test_job, t, rets, NB_JOBS, max_threads);
+    assert(ret == 0);
+    for (i = 0; i < NB_JOBS; i++)
+        assert(t->runs[i] == 1 && rets[i] == i);
+    av_free(rets);
+    av_free(t);
+}
+
+#if HAVE_THREADS
+static void *caller_thread(void *arg)
+{
+    int i;
+
+    for (i = 0; i < 20; i++)
+        check_batch(arg, 1 + i % 5, i & 1);
+    return NULL;
+}
+#endif
+
+int main(void)
+{
+    AVThreadPool *pool = NULL;
+
+    check_batch(NULL, 4, 0);
+
+#if HAVE_THREADS
+    {
+        pthread_t threads[3];
+        int i, ret;
+
+        ret = av_thread_pool_alloc(&pool, 4);
+        assert(ret == 0 && av_thread_pool_get_nb_threads(pool) == 4);
+        check_batch(pool, 1, 0);
+        check_batch(pool, 3, 0);
+        check_batch(pool, 16, 1);
+
+        /* several callers sharing the pool */
+        for (i = 0; i < 3; i++) {
+            ret = pthread_create(&threads[i], NULL, caller_thread, pool);
+            assert(ret == 0);
+        }
+        for (i = 0; i < 3; i++)
+            pthread_join(threads[i], NULL);
+
+        av_thread_pool_free(&pool);
+        assert(!pool);
+
+        assert(av_thread_pool_get_shared() == av_thread_pool_get_shared());
+    }
+#endif
+
+    return 0;
+}
+#endif
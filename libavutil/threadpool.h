@@ -0,0 +1,100 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * work-stealing thread pool
+ */
+
+#ifndef AVUTIL_THREADPOOL_H
+#define AVUTIL_THREADPOOL_H
+
+/**
+ * A set of worker threads running batches of independent jobs, e.g. the
+ * slices of a frame, for any number of callers.
+ *
+ * Each worker has a deque of job ranges. It runs the jobs from the front of
+ * its own deque, and steals half of the last range of another worker's
+ * deque when its own is empty, so that the workers stay busy without a
+ * central job counter. The caller runs a part of its jobs itself.
+ */
+typedef struct AVThreadPool AVThreadPool;
+
+/**
+ * A job of a batch.
+ *
+ * @param opaque   the opaque pointer passed to av_thread_pool_execute()
+ * @param jobnr    index of the job, from 0 to nb_jobs - 1
+ * @param threadnr index of the thread running the job, from 0 to
+ *                 max_threads - 1, unique among the jobs of the batch
+ *                 running at the same time
+ * @return a value stored in the rets array of av_thread_pool_execute()
+ */
+typedef int (AVThreadPoolJobFunc)(void *opaque, int jobnr, int threadnr);
+
+/**
+ * Allocate a new thread pool.
+ *
+ * @param pool       pointer to the new pool on success
+ * @param nb_threads number of worker threads, 0 for one per logical core
+ * @return 0 on success, a negative AVERROR code on failure, in particular
+ *         AVERROR(ENOSYS) if Libav was built without thread support
+ */
+int av_thread_pool_alloc(AVThreadPool **pool, int nb_threads);
+
+/**
+ * Stop the workers, free a pool and set the pointer to NULL.
+ * No batch may be running.
+ */
+void av_thread_pool_free(AVThreadPool **pool);
+
+/**
+ * Get the pool shared by the whole process, with one worker per logical
+ * core. It is created on the first call and never freed.
+ *
+ * @return the pool, or NULL if it could not be created
+ */
+AVThreadPool *av_thread_pool_get_shared(void);
+
+/**
+ * @return the number of worker threads of the pool
+ */
+int av_thread_pool_get_nb_threads(AVThreadPool *pool);
+
+/**
+ * Run a batch of jobs and wait for them to finish.
+ *
+ * The jobs are run by the calling thread and the workers of the pool.
+ * This function may be called by several threads at the same time,
+ * including from a job.
+ *
+ * @param pool        the pool, or NULL to run the jobs in the calling thread
+ * @param func        the job function
+ * @param opaque      passed to func
+ * @param rets        if not NULL, an array of nb_jobs values receiving the
+ *                    return value of each job
+ * @param nb_jobs     number of jobs
+ * @param max_threads maximum number of jobs of the batch running at the same
+ *                    time, at least 1
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int av_thread_pool_execute(AVThreadPool *pool, AVThreadPoolJobFunc *func,
+                           void *opaque, int *rets, int nb_jobs,
+                           int max_threads);
+
+#endif /* AVUTIL_THREADPOOL_H */
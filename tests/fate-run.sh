@@ -146,6 +146,33 @@ enc_dec(){
     tests/tiny_psnr $srcfile $decfile $cmp_unit $cmp_shift
 }
 
+transcode(){
+    src_fmt=$1
+    srcfile=$2
+    enc_fmt=$3
+    enc_opt=$4
+    dec_opt=$5
+    encfile="${outdir}/${test}.${enc_fmt}"
+    cleanfiles="$cleanfiles $encfile"
+    tsrcfile=$(target_path $srcfile)
+    tencfile=$(target_path $encfile)
+    avconv -f $src_fmt $DEC_OPTS -i $tsrcfile $ENC_OPTS $enc_opt $FLAGS \
+        -f $enc_fmt -y $tencfile || return
+    framecrc $dec_opt -i $tencfile -c copy || return
+    framecrc $dec_opt -i $tencfile $FLAGS
+}
+
+hlstest(){
+    srcfile=$1
+    dec_opt=$2
+    playlist="${outdir}/${test}.m3u8"
+    cleanfiles="$cleanfiles $playlist ${outdir}/${test}[0-9]*.ts"
+    tsrcfile=$(target_path $srcfile)
+    tplaylist=$(target_path $playlist)
+    avconv -i $tsrcfile -c copy -hls_time 0.2 -hls_list_size 100 -f hls -y $tplaylist || return
+    framecrc $dec_opt -i $tplaylist -c copy
+}
+
 lavftest(){
     t="${test#lavf-}"
     ref=${base}/ref/lavf/$t
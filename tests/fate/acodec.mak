@@ -66,5 +66,10 @@ FATE_ACODEC += $(FATE_ACODEC-yes)
 
 $(FATE_ACODEC): tests/data/asynth-44100-2.wav
 
-FATE_AVCONV += $(FATE_ACODEC)
-fate-acodec: $(FATE_ACODEC)
+# decoding in a thread of its own must give the same samples and timestamps
+FATE_MP2_PARALLEL-$(call ENCDEC, MP2, MP2 MP3) += fate-mp2-parallel-decoding
+fate-mp2-parallel-decoding: fate-acodec-mp2
+fate-mp2-parallel-decoding: CMD = framecrc -parallel_decoding -i $(TARGET_PATH)/tests/data/fate/acodec-mp2.mp2
+
+FATE_AVCONV += $(FATE_ACODEC) $(FATE_MP2_PARALLEL-yes)
+fate-acodec: $(FATE_ACODEC) $(FATE_MP2_PARALLEL-yes)
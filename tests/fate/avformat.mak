@@ -51,3 +51,35 @@ $(FATE_LAVF): CMD = lavftest
 
 FATE_AVCONV += $(FATE_LAVF)
 fate-lavf:     $(FATE_LAVF)
+
+# the program numbers are decimal, even with a leading zero
+FATE_MPEGTS-$(call ENCDEC2, MPEG2VIDEO, MP2, MPEGTS) += fate-mpegts-programs
+fate-mpegts-programs: fate-lavf-ts
+fate-mpegts-programs: CMD = transcode mpegts tests/data/lavf/lavf.ts mpegts "-c copy -mpegts_service_id 10" "-programs 010"
+
+# CBR muxing with T-STD transport buffer scheduling
+FATE_MPEGTS-$(call ENCDEC2, MPEG2VIDEO, MP2, MPEGTS) += fate-mpegts-tstd
+fate-mpegts-tstd: fate-lavf-ts
+fate-mpegts-tstd: CMD = md5 -i $(TARGET_PATH)/tests/data/lavf/lavf.ts -c copy -muxrate 4000000 -mpegts_flags tstd -f mpegts
+fate-mpegts-tstd: CMP = oneline
+fate-mpegts-tstd: REF = 111af69ae7f8a2403a0f93bdab1c2ca1
+
+FATE_AVCONV += $(FATE_MPEGTS-yes)
+fate-mpegts: $(FATE_MPEGTS-yes)
+
+# segments read ahead by the prefetch thread must give the same packets
+FATE_HLS-$(call ALLYES, MPEGTS_DEMUXER HLS_MUXER HLS_DEMUXER FILE_PROTOCOL) += fate-hls fate-hls-prefetch
+fate-hls fate-hls-prefetch: fate-lavf-ts
+fate-hls: CMD = hlstest tests/data/lavf/lavf.ts
+fate-hls-prefetch: CMD = hlstest tests/data/lavf/lavf.ts "-prefetch_segments 2 -prefetch_size 65536"
+fate-hls-prefetch: REF = $(SRC_PATH)/tests/ref/fate/hls
+
+FATE_AVCONV += $(FATE_HLS-yes)
+
+# clusters written without seeking back must demux to the same packets
+FATE_MATROSKA-$(call ENCDEC2, MPEG4, MP2, MATROSKA) += fate-matroska-live
+fate-matroska-live: fate-lavf-mkv
+fate-matroska-live: CMD = transcode matroska tests/data/lavf/lavf.mkv matroska "-c copy -live 1"
+
+FATE_AVCONV += $(FATE_MATROSKA-yes)
+fate-matroska: $(FATE_MATROSKA-yes)
@@ -1,3 +1,7 @@
+FATE_LIBAVFORMAT-$(call ALLYES, MEM_PROTOCOL NUT_MUXER NUT_DEMUXER MPEG4_ENCODER MP2_ENCODER) += fate-memproto
+fate-memproto: libavformat/memproto-test$(EXESUF) fate-lavf-nut
+fate-memproto: CMD = run libavformat/memproto-test $(TARGET_PATH)/tests/data/lavf/lavf.nut
+
 FATE_LIBAVFORMAT-$(CONFIG_NETWORK) += fate-noproxy
 fate-noproxy: libavformat/noproxy-test$(EXESUF)
 fate-noproxy: CMD = run libavformat/noproxy-test
@@ -6,6 +10,10 @@ FATE_LIBAVFORMAT-yes += fate-srtp
 fate-srtp: libavformat/srtp-test$(EXESUF)
 fate-srtp: CMD = run libavformat/srtp-test
 
+FATE_LIBAVFORMAT-$(call ENCDEC2, MPEG4, MP2, NUT) += fate-stream-info
+fate-stream-info: libavformat/streaminfo-test$(EXESUF) fate-lavf-nut
+fate-stream-info: CMD = run libavformat/streaminfo-test $(TARGET_PATH)/tests/data/lavf/lavf.nut
+
 FATE_LIBAVFORMAT-yes += fate-url
 fate-url: libavformat/url-test$(EXESUF)
 fate-url: CMD = run libavformat/url-test
@@ -58,6 +58,16 @@ FATE_LIBAVUTIL += fate-sha
 fate-sha: libavutil/sha-test$(EXESUF)
 fate-sha: CMD = run libavutil/sha-test
 
+FATE_LIBAVUTIL += fate-spsc_queue
+fate-spsc_queue: libavutil/spsc_queue-test$(EXESUF)
+fate-spsc_queue: CMD = run libavutil/spsc_queue-test
+fate-spsc_queue: REF = /dev/null
+
+FATE_LIBAVUTIL += fate-threadpool
+fate-threadpool: libavutil/threadpool-test$(EXESUF)
+fate-threadpool: CMD = run libavutil/threadpool-test
+fate-threadpool: REF = /dev/null
+
 FATE_LIBAVUTIL += fate-tree
 fate-tree: libavutil/tree-test$(EXESUF)
 fate-tree: CMD = run libavutil/tree-test
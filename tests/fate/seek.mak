@@ -225,5 +225,11 @@ $(FATE_SEEK): CMD = run libavformat/seek-test$(EXESUF) $(TARGET_PATH)/tests/data
 $(FATE_SEEK): fate-seek-%: fate-%
 fate-seek-%: REF = $(SRC_PATH)/tests/ref/seek/$(@:fate-seek-%=%)
 
-FATE_AVCONV += $(FATE_SEEK)
-fate-seek:     $(FATE_SEEK)
+# the mov lazy index must give the same packets and seek results
+FATE_SEEK_LAZY_INDEX-$(call ENCDEC2, MPEG4, PCM_ALAW, MOV) += fate-seek-lavf-mov-lazy-index
+fate-seek-lavf-mov-lazy-index: libavformat/seek-test$(EXESUF) fate-lavf-mov
+fate-seek-lavf-mov-lazy-index: CMD = run libavformat/seek-test$(EXESUF) $(TARGET_PATH)/tests/data/lavf/lavf.mov lazy_index 1
+fate-seek-lavf-mov-lazy-index: REF = $(SRC_PATH)/tests/ref/seek/lavf-mov
+
+FATE_AVCONV += $(FATE_SEEK) $(FATE_SEEK_LAZY_INDEX-yes)
+fate-seek:     $(FATE_SEEK) $(FATE_SEEK_LAZY_INDEX-yes)
@@ -74,9 +74,12 @@ fate-vsynth%-h263:               ENCOPTS = -qscale 10
 fate-vsynth%-h263-obmc:          ENCOPTS = -qscale 10 -obmc 1
 fate-vsynth%-h263p:              ENCOPTS = -qscale 2 -flags +aic -umv 1 -aiv 1 -ps 300
 
-FATE_VCODEC-$(call ENCDEC, HUFFYUV, AVI) += huffyuv
+FATE_VCODEC-$(call ENCDEC, HUFFYUV, AVI) += huffyuv huffyuv-thread
 fate-vsynth%-huffyuv:            ENCOPTS = -pix_fmt yuv422p -sws_flags neighbor
 fate-vsynth%-huffyuv:            DECOPTS = -strict -2 -sws_flags neighbor
+fate-vsynth%-huffyuv-thread:     ENCOPTS = -pix_fmt yuv422p -sws_flags neighbor \
+                                           -threads 2 -thread_type frame
+fate-vsynth%-huffyuv-thread:     DECOPTS = -strict -2 -sws_flags neighbor
 
 FATE_VCODEC-$(call ENCDEC, JPEGLS, AVI) += jpegls
 fate-vsynth%-jpegls:             ENCOPTS = -sws_flags neighbor+full_chroma_int
@@ -178,6 +181,39 @@ fate-vsynth%-mpeg4-thread:       ENCOPTS = -b 500k -flags +mv4+aic         \
                                            -mbd bits -ps 200 -bf 2         \
                                            -threads 2 -slices 2
 
+# decoding with a frame threading delay limit must give the same frames
+FATE_MPEG4_THREAD-$(call ENCDEC, MPEG4, AVI) += fate-mpeg4-thread-max-delay
+fate-mpeg4-thread-max-delay: fate-vsynth1-mpeg4-qprd
+fate-mpeg4-thread-max-delay: CMD = framemd5 -thread_max_delay 1 -i $(TARGET_PATH)/tests/data/fate/vsynth1-mpeg4-qprd.avi
+fate-mpeg4-thread-max-delay: THREADS = 4
+fate-mpeg4-thread-max-delay: THREAD_TYPE = frame
+
+# so must decoding in a thread of its own
+FATE_MPEG4_THREAD-$(call ENCDEC, MPEG4, AVI) += fate-mpeg4-parallel-decoding
+fate-mpeg4-parallel-decoding: fate-vsynth1-mpeg4-qprd
+fate-mpeg4-parallel-decoding: CMD = framemd5 -parallel_decoding -i $(TARGET_PATH)/tests/data/fate/vsynth1-mpeg4-qprd.avi
+fate-mpeg4-parallel-decoding: REF = $(SRC_PATH)/tests/ref/fate/mpeg4-thread-max-delay
+
+# transcoding in parallel time ranges must give increasing packet timestamps
+# and all the frames
+FATE_MPEG4_CHUNKS-$(call ENCDEC, MPEG4 FFVHUFF, MP4 AVI) += fate-mpeg4-chunks
+fate-mpeg4-chunks: fate-vsynth1-ffvhuff
+fate-mpeg4-chunks: CMD = transcode avi tests/data/fate/vsynth1-ffvhuff.avi mp4 "-c mpeg4 -b 400k -bf 2 -chunks 3 -threads 1"
+
+# two renditions, encoded serially and in parallel, must give the same packets
+FATE_MPEG4_RENDITIONS-$(call ENCDEC, MPEG4 FFVHUFF, AVI) += fate-mpeg4-renditions fate-mpeg4-renditions-parallel
+fate-mpeg4-renditions fate-mpeg4-renditions-parallel: fate-vsynth1-ffvhuff
+fate-mpeg4-renditions: CMD = framecrc -i $(TARGET_PATH)/tests/data/fate/vsynth1-ffvhuff.avi -map 0 -map 0 -c mpeg4 -b:v:0 400k -b:v:1 200k -s:v:1 176x144 -bf 2 -threads 1 -flags +bitexact
+fate-mpeg4-renditions-parallel: CMD = framecrc -parallel_encoding -i $(TARGET_PATH)/tests/data/fate/vsynth1-ffvhuff.avi -map 0 -map 0 -c mpeg4 -b:v:0 400k -b:v:1 200k -s:v:1 176x144 -bf 2 -threads 1 -flags +bitexact
+fate-mpeg4-renditions-parallel: REF = $(SRC_PATH)/tests/ref/fate/mpeg4-renditions
+
+# the scaled renditions must not change when they share their scaler
+FATE_MPEG4_RENDITIONS-$(call ENCDEC, MPEG4 FFVHUFF, AVI) += fate-mpeg4-scaling fate-mpeg4-shared-scaling
+fate-mpeg4-scaling fate-mpeg4-shared-scaling: fate-vsynth1-ffvhuff
+fate-mpeg4-scaling: CMD = framecrc -i $(TARGET_PATH)/tests/data/fate/vsynth1-ffvhuff.avi -map 0 -map 0 -map 0 -c mpeg4 -b:v:0 400k -b:v:1 200k -b:v:2 100k -s:v:1 176x144 -s:v:2 176x144 -bf 2 -threads 1 -flags +bitexact
+fate-mpeg4-shared-scaling: CMD = framecrc -shared_scaling -i $(TARGET_PATH)/tests/data/fate/vsynth1-ffvhuff.avi -map 0 -map 0 -map 0 -c mpeg4 -b:v:0 400k -b:v:1 200k -b:v:2 100k -s:v:1 176x144 -s:v:2 176x144 -bf 2 -threads 1 -flags +bitexact
+fate-mpeg4-shared-scaling: REF = $(SRC_PATH)/tests/ref/fate/mpeg4-scaling
+
 FATE_VCODEC-$(call ENCDEC, MSMPEG4V3, AVI) += msmpeg4
 fate-vsynth%-msmpeg4:            ENCOPTS = -qscale 10
 
@@ -230,8 +266,8 @@ FATE_VSYNTH2 = $(FATE_VCODEC:%=fate-vsynth2-%)
 $(FATE_VSYNTH1): tests/data/vsynth1.yuv
 $(FATE_VSYNTH2): tests/data/vsynth2.yuv
 
-FATE_AVCONV += $(FATE_VSYNTH1) $(FATE_VSYNTH2)
+FATE_AVCONV += $(FATE_VSYNTH1) $(FATE_VSYNTH2) $(FATE_MPEG4_THREAD-yes) $(FATE_MPEG4_CHUNKS-yes) $(FATE_MPEG4_RENDITIONS-yes)
 
 fate-vsynth1: $(FATE_VSYNTH1)
 fate-vsynth2: $(FATE_VSYNTH2)
-fate-vcodec:  fate-vsynth1 fate-vsynth2
+fate-vcodec:  fate-vsynth1 fate-vsynth2 $(FATE_MPEG4_THREAD-yes) $(FATE_MPEG4_CHUNKS-yes) $(FATE_MPEG4_RENDITIONS-yes)